@@ -0,0 +1,195 @@
+#include "Benchmark.h"
+
+#include <Parallel.h>
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <ctime>
+
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+// Resets the peak resident set size of the process, so that the peak of
+// each case can be measured separately. Only supported on Linux.
+static bool
+resetPeakRSS() {
+#ifdef __GLIBC__
+  // return the memory freed by earlier cases
+  malloc_trim(0);
+#endif
+  ofstream out("/proc/self/clear_refs");
+  if (!out) return false;
+  out << "5";
+  out.flush();
+  return bool(out);
+}
+
+// returns the peak resident set size in bytes
+static size_t
+getPeakRSS() {
+  ifstream in("/proc/self/status");
+  string line;
+  while (getline(in, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return size_t(strtoull(line.c_str() + 6, 0, 10)) * 1024;
+    }
+  }
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+  return size_t(usage.ru_maxrss);
+#else
+  return size_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+// nearest rank percentile of sorted values
+static double
+getPercentile(const vector<double> & v, double p) {
+  if (v.empty()) return 0.0;
+  size_t rank = size_t(p / 100.0 * v.size() + 0.5);
+  if (rank < 1) rank = 1;
+  if (rank > v.size()) rank = v.size();
+  return v[rank - 1];
+}
+
+static string
+escapeJSON(const string & s) {
+  string r;
+  for (auto c : s) {
+    if (c == '"' || c == '\\') {
+      r += '\\';
+      r += c;
+    } else if ((unsigned char)c < 0x20) {
+      char buffer[8];
+      snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+      r += buffer;
+    } else {
+      r += c;
+    }
+  }
+  return r;
+}
+
+std::vector<benchmark_scale_s>
+BenchmarkSuite::getDefaultScales() {
+  return { { "small", 10000 }, { "medium", 100000 } };
+}
+
+bool
+BenchmarkSuite::getScale(const std::string & name, benchmark_scale_s & scale) {
+  if (name == "small") scale = { name, 10000 };
+  else if (name == "medium") scale = { name, 100000 };
+  else if (name == "large") scale = { name, 1000000 };
+  else if (name == "huge") scale = { name, 10000000 };
+  else {
+    char * end = 0;
+    unsigned long long n = strtoull(name.c_str(), &end, 10);
+    if (!n || *end) return false;
+    scale = { name, size_t(n) };
+  }
+  return true;
+}
+
+std::vector<std::string>
+BenchmarkSuite::getNames() const {
+  vector<string> r;
+  for (auto & c : cases) r.push_back(c.name);
+  return r;
+}
+
+void
+BenchmarkSuite::run(const std::vector<benchmark_scale_s> & scales, const std::string & filter, unsigned int _repetitions) {
+  repetitions = _repetitions ? _repetitions : 1;
+  for (auto & c : cases) {
+    if (!filter.empty() && c.name.find(filter) == string::npos) continue;
+    for (auto & scale : scales) {
+      if (c.max_size && scale.size > c.max_size) {
+	cerr << c.name << " [" << scale.name << "]: skipped, the largest supported size is " << c.max_size << endl;
+	continue;
+      }
+      resetPeakRSS();
+      vector<double> samples, times;
+      size_t operations = 0;
+      double checksum = 0.0;
+      for (unsigned int i = 0; i < repetitions; i++) {
+	BenchmarkTimer timer;
+	c.function(timer, scale.size);
+	if (i == 0) {
+	  operations = timer.getOperations();
+	  checksum = timer.getChecksum();
+	} else if (timer.getChecksum() != checksum) {
+	  cerr << c.name << " [" << scale.name << "]: checksum differs between repetitions\n";
+	}
+	times.push_back(timer.getSeconds());
+	samples.insert(samples.end(), timer.getSamples().begin(), timer.getSamples().end());
+      }
+      sort(times.begin(), times.end());
+      sort(samples.begin(), samples.end());
+
+      result_s r;
+      r.name = c.name;
+      r.unit = c.unit;
+      r.scale = scale.name;
+      r.size = scale.size;
+      r.operations = operations;
+      r.repetitions = repetitions;
+      r.seconds = times[times.size() / 2];
+      r.throughput = r.seconds > 0 ? operations / r.seconds : 0.0;
+      r.checksum = checksum;
+      r.p50 = getPercentile(samples, 50);
+      r.p90 = getPercentile(samples, 90);
+      r.p99 = getPercentile(samples, 99);
+      r.max = samples.empty() ? 0.0 : samples.back();
+      r.peak_rss = getPeakRSS();
+      results.push_back(r);
+
+      cerr << c.name << " [" << scale.name << "]: " << r.operations << " " << c.unit << " in " << r.seconds << " s, " << r.throughput << " " << c.unit << "/s, peak RSS " << (r.peak_rss >> 20) << " MiB\n";
+    }
+  }
+}
+
+void
+BenchmarkSuite::writeJSON(std::ostream & out) const {
+  char date[32];
+  time_t t = time(0);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+
+  ostringstream s;
+  s.precision(6);
+  s << "{\n";
+  s << "  \"suite\": \"graphlib\",\n";
+  s << "  \"date\": \"" << date << "\",\n";
+#ifdef __VERSION__
+  s << "  \"compiler\": \"" << escapeJSON(__VERSION__) << "\",\n";
+#endif
+  s << "  \"threads\": " << getThreadCount() << ",\n";
+  s << "  \"repetitions\": " << repetitions << ",\n";
+  s << "  \"results\": [";
+  for (size_t i = 0; i < results.size(); i++) {
+    auto & r = results[i];
+    s << (i ? ",\n" : "\n");
+    s << "    {\n";
+    s << "      \"name\": \"" << escapeJSON(r.name) << "\",\n";
+    s << "      \"scale\": \"" << escapeJSON(r.scale) << "\",\n";
+    s << "      \"size\": " << r.size << ",\n";
+    s << "      \"unit\": \"" << escapeJSON(r.unit) << "\",\n";
+    s << "      \"operations\": " << r.operations << ",\n";
+    s << "      \"seconds\": " << r.seconds << ",\n";
+    s << "      \"throughput\": " << r.throughput << ",\n";
+    s << "      \"latency_ns\": { \"p50\": " << r.p50 * 1e9 << ", \"p90\": " << r.p90 * 1e9 << ", \"p99\": " << r.p99 * 1e9 << ", \"max\": " << r.max * 1e9 << " },\n";
+    s << "      \"peak_rss_bytes\": " << r.peak_rss << ",\n";
+    s << "      \"checksum\": " << setprecision(17) << r.checksum << setprecision(6) << "\n";
+    s << "    }";
+  }
+  s << "\n  ]\n}\n";
+  out << s.str();
+}
@@ -0,0 +1,96 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <ostream>
+
+// Times the measured part of a benchmark case. Work is timed in batches and
+// each batch gives one latency sample, its average time per operation, so
+// that the clock overhead does not dominate fast operations.
+class BenchmarkTimer {
+ public:
+  BenchmarkTimer() { }
+
+  template<class F>
+  void measure(size_t operations, F f) {
+    auto t0 = std::chrono::steady_clock::now();
+    f();
+    add(operations, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+  }
+
+  void add(size_t operations, double seconds) {
+    if (!operations) return;
+    total_operations += operations;
+    total_seconds += seconds;
+    samples.push_back(seconds / operations);
+  }
+
+  // a value derived from the results, so that the work is not optimized
+  // away and runs can be checked to have done the same work
+  void addChecksum(double v) { checksum += v; }
+
+  size_t getOperations() const { return total_operations; }
+  double getSeconds() const { return total_seconds; }
+  double getChecksum() const { return checksum; }
+  const std::vector<double> & getSamples() const { return samples; }
+
+ private:
+  size_t total_operations = 0;
+  double total_seconds = 0.0, checksum = 0.0;
+  std::vector<double> samples;
+};
+
+struct benchmark_scale_s {
+  std::string name;
+  size_t size;
+};
+
+// Runs benchmark cases at several scales and reports throughput, latency
+// percentiles and peak memory as JSON. Setup done by a case outside of
+// BenchmarkTimer::measure() is not timed.
+class BenchmarkSuite {
+ public:
+  typedef std::function<void(BenchmarkTimer & timer, size_t size)> Function;
+
+  BenchmarkSuite() { }
+
+  // unit names the operations counted by the case. Scales larger than
+  // max_size are skipped (0 = no limit).
+  void add(const std::string & name, const std::string & unit, Function f, size_t max_size = 0) {
+    cases.push_back({ name, unit, f, max_size });
+  }
+
+  // runs the cases whose name contains filter, each repeated with a fresh setup
+  void run(const std::vector<benchmark_scale_s> & scales, const std::string & filter, unsigned int repetitions);
+  void writeJSON(std::ostream & out) const;
+
+  std::vector<std::string> getNames() const;
+
+  static std::vector<benchmark_scale_s> getDefaultScales();
+  static bool getScale(const std::string & name, benchmark_scale_s & scale);
+
+ private:
+  struct case_s {
+    std::string name, unit;
+    Function function;
+    size_t max_size;
+  };
+
+  struct result_s {
+    std::string name, unit, scale;
+    size_t size, operations;
+    unsigned int repetitions;
+    double seconds, throughput, checksum;
+    double p50, p90, p99, max; // seconds per operation
+    size_t peak_rss;
+  };
+
+  std::vector<case_s> cases;
+  std::vector<result_s> results;
+  unsigned int repetitions = 1;
+};
+
+#endif
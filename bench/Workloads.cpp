@@ -0,0 +1,43 @@
+#include "Workloads.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static const char * words[] = {
+  "the", "graph", "of", "and", "news", "today", "city", "vote", "new", "people",
+  "music", "game", "weather", "open", "data", "time", "great", "map", "story", "live",
+  "election", "report", "photo", "video", "road", "market", "school", "health", "team", "night"
+};
+
+#define NUM_WORDS	(sizeof(words) / sizeof(words[0]))
+
+void
+generateGridMesh(size_t rows, size_t cols, std::vector<glm::vec3> & vertices, std::vector<int> & triangles) {
+  vertices.clear();
+  triangles.clear();
+  if (rows < 2 || cols < 2) return;
+  vertices.reserve(rows * cols);
+  for (size_t r = 0; r < rows; r++) {
+    for (size_t c = 0; c < cols; c++) {
+      vertices.push_back(glm::vec3(float(c), float(r), 0.0f));
+    }
+  }
+  triangles.reserve((rows - 1) * (cols - 1) * 6);
+  for (size_t r = 0; r + 1 < rows; r++) {
+    for (size_t c = 0; c + 1 < cols; c++) {
+      int a = int(r * cols + c), b = a + 1, d = a + int(cols), e = d + 1;
+      triangles.insert(triangles.end(), { a, b, e, a, e, d });
+    }
+  }
+}
+
+std::string
+generateText(WorkloadRandom & rnd, unsigned int num_words) {
+  string s;
+  for (unsigned int i = 0; i < num_words; i++) {
+    if (i) s += ' ';
+    s += words[rnd.skewed(NUM_WORDS)];
+  }
+  return s;
+}
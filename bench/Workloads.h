@@ -0,0 +1,42 @@
+#ifndef _WORKLOADS_H_
+#define _WORKLOADS_H_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <string>
+
+// Seeded random numbers (splitmix64), the same on every platform unlike
+// the standard distributions
+class WorkloadRandom {
+ public:
+  WorkloadRandom(unsigned long long _state) : state(_state) { }
+
+  unsigned long long next() {
+    unsigned long long z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+  // uniform in [0, n)
+  size_t below(size_t n) { return n ? size_t(next() % n) : 0; }
+  // uniform in [0, 1)
+  double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+  // in [0, n) with a heavy head, small values are the most popular
+  size_t skewed(size_t n) {
+    double u = uniform();
+    return size_t(n * u * u * u);
+  }
+
+ private:
+  unsigned long long state;
+};
+
+// A rows x cols grid of vertices split into two triangles per cell, the
+// triangles given as triples of vertex indices
+void generateGridMesh(size_t rows, size_t cols, std::vector<glm::vec3> & vertices, std::vector<int> & triangles);
+
+// a sentence of words picked with a skewed frequency, for text columns
+std::string generateText(WorkloadRandom & rnd, unsigned int num_words);
+
+#endif
@@ -0,0 +1,496 @@
+#include "Benchmark.h"
+#include "Workloads.h"
+
+#include <Graph.h>
+#include <SyntheticGraphGenerator.h>
+#include <GraphFilter.h>
+#include <Louvain.h>
+#include <DisplayInfo.h>
+#include <CompressedTextColumn.h>
+#include <CSVLoader.h>
+#include <WavefrontObjLoader.h>
+#include <ShapefileLoader.h>
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <unistd.h>
+
+#define EDGES_PER_NODE	8
+#define BATCH_SIZE	4096
+#define SEED		12345
+
+using namespace std;
+
+static string tmp_dir = "/tmp";
+
+static string
+getTempFile(const char * extension) {
+  return tmp_dir + "/graphlib-bench-" + to_string(getpid()) + "." + extension;
+}
+
+// runs the temporal filter over the whole source graph
+class BenchmarkFilter : public GraphFilter {
+ public:
+  BenchmarkFilter() { }
+
+  std::shared_ptr<GraphFilter> dup() const override { return std::make_shared<BenchmarkFilter>(*this); }
+  bool apply(Graph & target_graph, time_t start_time, time_t end_time, float start_sentiment, float end_sentiment, Graph & source_graph, RawStatistics & stats) override {
+    return processTemporalData(target_graph, start_time, end_time, start_sentiment, end_sentiment, source_graph, stats);
+  }
+};
+
+// edges of a Barabási–Albert graph with EDGES_PER_NODE edges per node
+static void
+generatePowerLawEdges(size_t num_nodes, vector<int> & tails, vector<int> & heads) {
+  SyntheticGraphGenerator(SEED).generateBarabasiAlbertEdges(num_nodes, EDGES_PER_NODE, tails, heads);
+}
+
+// a power-law graph with num_nodes nodes and EDGES_PER_NODE edges per node
+static void
+createSocialGraph(Graph & graph, size_t num_nodes, bool dynamic = false) {
+  auto nodes = std::make_shared<NodeArray>();
+  nodes->setDynamic(dynamic);
+  graph.setNodeArray(nodes);
+  nodes->createNodes(num_nodes);
+  vector<int> tails, heads;
+  generatePowerLawEdges(num_nodes, tails, heads);
+  graph.addEdges(tails, heads);
+}
+
+static DisplayInfo
+createDisplay() {
+  DisplayInfo display(DisplayInfo::TOPOLOGICAL_VIEW);
+  display.setViewport(glm::ivec4(0, 0, 1920, 1080));
+  display.setModelViewMatrix(glm::lookAt(glm::vec3(0.0f, 0.0f, 400.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+  display.setProjectionMatrix(glm::perspective(0.785f, 1920.0f / 1080.0f, 1.0f, 10000.0f));
+  return display;
+}
+
+static void
+addGraphBenchmarks(BenchmarkSuite & suite) {
+  suite.add("graph/add_edge", "edges", [](BenchmarkTimer & timer, size_t size) {
+      Graph graph;
+      graph.setNodeArray(std::make_shared<NodeArray>());
+      graph.getNodeArray().createNodes(size);
+      vector<int> tails, heads;
+      generatePowerLawEdges(size, tails, heads);
+      for (size_t b = 0; b < tails.size(); b += BATCH_SIZE) {
+	size_t e = min(tails.size(), b + BATCH_SIZE);
+	timer.measure(e - b, [&]() {
+	    for (size_t i = b; i < e; i++) graph.addEdge(tails[i], heads[i]);
+	  });
+      }
+      timer.addChecksum(graph.getTotalWeightedOutdegree() + graph.getNodeFirstEdge(0));
+    });
+
+  suite.add("graph/add_edges", "edges", [](BenchmarkTimer & timer, size_t size) {
+      Graph graph;
+      graph.setNodeArray(std::make_shared<NodeArray>());
+      graph.getNodeArray().createNodes(size);
+      vector<int> tails, heads;
+      generatePowerLawEdges(size, tails, heads);
+      timer.measure(tails.size(), [&]() {
+	  graph.addEdges(tails, heads);
+	});
+      timer.addChecksum(graph.getTotalWeightedOutdegree() + graph.getNodeFirstEdge(0));
+    });
+
+  suite.add("graph/has_edge", "queries", [](BenchmarkTimer & timer, size_t size) {
+      Graph graph;
+      createSocialGraph(graph, size);
+      // half of the queries are for existing edges
+      WorkloadRandom rnd(SEED);
+      vector<pair<int, int> > queries;
+      for (size_t i = 0; i < 4 * size; i++) {
+	if (i & 1) {
+	  queries.push_back(make_pair(int(rnd.below(size)), int(rnd.below(size))));
+	} else {
+	  auto & ed = graph.getEdgeAttributes(int(rnd.below(graph.getEdgeCount())));
+	  queries.push_back(make_pair(ed.tail, ed.head));
+	}
+      }
+      size_t found = 0;
+      for (size_t b = 0; b < queries.size(); b += BATCH_SIZE) {
+	size_t e = min(queries.size(), b + BATCH_SIZE);
+	timer.measure(e - b, [&]() {
+	    for (size_t i = b; i < e; i++) found += graph.hasEdge(queries[i].first, queries[i].second);
+	  });
+      }
+      timer.addChecksum(double(found));
+    });
+
+  suite.add("graph/visible_nodes", "nodes", [](BenchmarkTimer & timer, size_t size) {
+      Graph graph;
+      createSocialGraph(graph, size);
+      for (unsigned int i = 0; i < 5; i++) {
+	size_t n = 0;
+	long long sum = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	auto end = graph.end_visible_nodes();
+	for (auto it = graph.begin_visible_nodes(); it != end; ++it) {
+	  n++;
+	  sum += *it;
+	}
+	timer.add(n, std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count());
+	if (i == 0) timer.addChecksum(double(sum));
+      }
+    });
+
+  suite.add("graph/update_visibilities", "nodes", [](BenchmarkTimer & timer, size_t size) {
+      Graph graph;
+      createSocialGraph(graph, size, true);
+      auto display = createDisplay();
+      for (unsigned int i = 0; i < 5; i++) {
+	bool changed = false;
+	timer.measure(size, [&]() {
+	    changed = graph.updateVisibilities(display);
+	  });
+	timer.addChecksum(changed);
+      }
+    });
+
+  // the same pass over a hierarchy of one community per 100 nodes, which
+  // walks the child and sibling links
+  suite.add("graph/update_visibilities_hierarchy", "nodes", [](BenchmarkTimer & timer, size_t size) {
+      Graph graph;
+      createSocialGraph(graph, size, true);
+      WorkloadRandom rnd(SEED);
+      auto & nodes = graph.getNodeArray();
+      for (size_t i = 0; i < size; i++) {
+	graph.addChild(nodes.createCommunity(int(rnd.below(size / 100 + 1))), int(i), 0);
+      }
+      auto display = createDisplay();
+      for (unsigned int i = 0; i < 5; i++) {
+	bool changed = false;
+	timer.measure(size, [&]() {
+	    changed = graph.updateVisibilities(display);
+	  });
+	timer.addChecksum(changed);
+      }
+    });
+
+  suite.add("graph/modularity", "nodes", [](BenchmarkTimer & timer, size_t size) {
+      Graph graph;
+      createSocialGraph(graph, size, true);
+      // one community per 100 nodes
+      WorkloadRandom rnd(SEED);
+      auto & nodes = graph.getNodeArray();
+      for (size_t i = 0; i < size; i++) {
+	graph.addChild(nodes.createCommunity(int(rnd.below(size / 100 + 1))), int(i), 0);
+      }
+      for (unsigned int i = 0; i < 5; i++) {
+	double q = 0.0;
+	timer.measure(size, [&]() {
+	    q = graph.modularity();
+	  });
+	if (i == 0) timer.addChecksum(q);
+      }
+    });
+
+  // relaxLinks() keeps a bit per node pair, which limits the size
+  suite.add("graph/relax_links", "edges", [](BenchmarkTimer & timer, size_t size) {
+      Graph graph;
+      createSocialGraph(graph, size, true);
+      graph.resume();
+      vector<node_position_data_s> v;
+      graph.getNodeArray().updatePositions(v);
+      for (unsigned int i = 0; i < 5; i++) {
+	timer.measure(graph.getEdgeCount(), [&]() {
+	    graph.relaxLinks(v);
+	  });
+      }
+      timer.addChecksum(v[0].position.x + v[size - 1].position.y);
+    }, 20000);
+
+  // a single pass, since getAllNeighbors() scans every edge and a pass is
+  // quadratic in the size
+  suite.add("louvain/one_level", "edges", [](BenchmarkTimer & timer, size_t size) {
+      Graph graph;
+      createSocialGraph(graph, size, true);
+      Louvain louvain(&graph, 1, 0.0001);
+      timer.measure(graph.getEdgeCount(), [&]() {
+	  louvain.oneLevel();
+	});
+      timer.addChecksum(graph.modularity());
+    }, 10000);
+}
+
+static void
+addFilterBenchmarks(BenchmarkSuite & suite) {
+  suite.add("filter/process_temporal_data", "edges", [](BenchmarkTimer & timer, size_t size) {
+      // the filtered graph shares the nodes of the post stream
+      auto nodes = std::make_shared<NodeArray>();
+      social_media_params_s params;
+      params.num_users = size;
+      params.num_posts = 4 * size;
+      auto source = SyntheticGraphGenerator(SEED).createSocialMedia(SyntheticGraphGenerator::BARABASI_ALBERT, params, nodes);
+      auto & source_graph = *source;
+      Graph target_graph;
+      target_graph.setNodeArray(nodes);
+      BenchmarkFilter filter;
+      filter.keepHashtags(true);
+      filter.keepLinks(true);
+      RawStatistics stats;
+      timer.measure(source_graph.getEdgeCount(), [&]() {
+	  filter.apply(target_graph, 0, 0, -1.0f, 1.0f, source_graph, stats);
+	});
+      timer.addChecksum(double(target_graph.getEdgeCount()));
+    });
+}
+
+static void
+addGeneratorBenchmarks(BenchmarkSuite & suite) {
+  suite.add("generator/rmat_edges", "edges", [](BenchmarkTimer & timer, size_t size) {
+      unsigned int scale = 1;
+      while ((size_t(1) << scale) < size) scale++;
+      vector<int> tails, heads;
+      timer.measure(EDGES_PER_NODE * size, [&]() {
+	  SyntheticGraphGenerator(SEED).generateRMATEdges(scale, EDGES_PER_NODE * size, tails, heads);
+	});
+      timer.addChecksum(double(tails[size / 2]) + double(heads.back()));
+    });
+
+  suite.add("generator/social_media", "posts", [](BenchmarkTimer & timer, size_t size) {
+      auto nodes = std::make_shared<NodeArray>();
+      social_media_params_s params;
+      params.num_users = size;
+      params.num_posts = 4 * size;
+      std::shared_ptr<Graph> graph;
+      timer.measure(params.num_posts, [&]() {
+	  graph = SyntheticGraphGenerator(SEED).createSocialMedia(SyntheticGraphGenerator::RMAT, params, nodes);
+	});
+      timer.addChecksum(double(graph->getEdgeCount()) + double(graph->getEdgeTargetNode(int(graph->getEdgeCount()) - 1)));
+    });
+}
+
+static void
+addTableBenchmarks(BenchmarkSuite & suite) {
+  auto createTextColumn = [](table::CompressedTextColumn & col, size_t n) {
+    WorkloadRandom rnd(SEED);
+    for (size_t i = 0; i < n; i++) col.pushValue(generateText(rnd, 4 + unsigned(rnd.below(16))));
+  };
+
+  suite.add("table/compressed_text_sequential", "values", [=](BenchmarkTimer & timer, size_t size) {
+      table::CompressedTextColumn col;
+      createTextColumn(col, size);
+      size_t total = 0;
+      for (size_t b = 0; b < size; b += BATCH_SIZE) {
+	size_t e = min(size, b + BATCH_SIZE);
+	timer.measure(e - b, [&]() {
+	    for (size_t i = b; i < e; i++) total += col.getText(int(i)).size();
+	  });
+      }
+      timer.addChecksum(double(total));
+    });
+
+  suite.add("table/compressed_text_random", "values", [=](BenchmarkTimer & timer, size_t size) {
+      table::CompressedTextColumn col;
+      createTextColumn(col, size);
+      WorkloadRandom rnd(SEED + 1);
+      vector<int> rows;
+      for (size_t i = 0; i < size; i++) rows.push_back(int(rnd.below(size)));
+      size_t total = 0;
+      for (size_t b = 0; b < size; b += BATCH_SIZE) {
+	size_t e = min(size, b + BATCH_SIZE);
+	timer.measure(e - b, [&]() {
+	    for (size_t i = b; i < e; i++) total += col.getText(rows[i]).size();
+	  });
+      }
+      timer.addChecksum(double(total));
+    });
+
+  // the same random rows, read a batch at a time with gatherText()
+  suite.add("table/compressed_text_gather", "values", [=](BenchmarkTimer & timer, size_t size) {
+      table::CompressedTextColumn col;
+      createTextColumn(col, size);
+      WorkloadRandom rnd(SEED + 1);
+      vector<int> rows;
+      for (size_t i = 0; i < size; i++) rows.push_back(int(rnd.below(size)));
+      vector<string> values;
+      size_t total = 0;
+      for (size_t b = 0; b < size; b += BATCH_SIZE) {
+	size_t e = min(size, b + BATCH_SIZE);
+	timer.measure(e - b, [&]() {
+	    col.gatherText(rows.data() + b, e - b, values);
+	    for (auto & v : values) total += v.size();
+	  });
+      }
+      timer.addChecksum(double(total));
+    });
+}
+
+static void
+addLoaderBenchmarks(BenchmarkSuite & suite, const string & shapefile, size_t shapefile_size) {
+  suite.add("loader/table_csv_join", "rows", [](BenchmarkTimer & timer, size_t size) {
+      string filename = getTempFile("csv");
+      {
+	WorkloadRandom rnd(SEED);
+	ofstream out(filename);
+	out << "id;name;count;text\n";
+	for (size_t i = 0; i < size; i++) {
+	  out << "user" << i << ";User " << i << ";" << rnd.below(1000) << ";" << generateText(rnd, 8) << "\n";
+	}
+      }
+      table::Table t;
+      auto & id_column = t.addTextColumn("id");
+      for (size_t i = 0; i < size; i++) {
+	t.addRow();
+	id_column.setValue(int(i), "user" + to_string(size - 1 - i));
+      }
+      size_t n = 0;
+      timer.measure(size, [&]() {
+	  n = t.loadCSV(filename.c_str(), "id", ';');
+	});
+      timer.addChecksum(double(n));
+      remove(filename.c_str());
+    });
+
+  suite.add("loader/csv", "rows", [](BenchmarkTimer & timer, size_t size) {
+      string filename = getTempFile("csv");
+      {
+	WorkloadRandom rnd(SEED);
+	ofstream out(filename);
+	out << "name\tlikes\tX\tY\n";
+	for (size_t i = 0; i < size; i++) {
+	  out << "Place " << i << "\t" << rnd.below(1000) << "\t" << rnd.uniform() * 180.0 << "\t" << rnd.uniform() * 90.0 << "\n";
+	}
+      }
+      CSVLoader loader;
+      std::shared_ptr<Graph> graph;
+      timer.measure(size, [&]() {
+	  graph = loader.openGraph(filename.c_str(), std::make_shared<NodeArray>());
+	});
+      timer.addChecksum(graph.get() ? double(graph->getNodeArray().size()) : 0.0);
+      remove(filename.c_str());
+    });
+
+  // a triangulated grid with about size vertices
+  suite.add("loader/wavefront_obj", "faces", [](BenchmarkTimer & timer, size_t size) {
+      string filename = getTempFile("obj");
+      size_t side = 2;
+      while (side * side < size) side++;
+      vector<glm::vec3> vertices;
+      vector<int> triangles;
+      generateGridMesh(side, side, vertices, triangles);
+      {
+	ofstream out(filename);
+	for (auto & v : vertices) out << "v " << v.x << " " << v.y << " " << v.z << "\n";
+	out << "vt 0 0\nvn 0 0 1\n";
+	for (size_t i = 0; i < triangles.size(); i += 3) {
+	  out << "f " << triangles[i] + 1 << "/1/1 " << triangles[i + 1] + 1 << "/1/1 " << triangles[i + 2] + 1 << "/1/1\n";
+	}
+      }
+      WavefrontObjLoader loader;
+      std::shared_ptr<Graph> graph;
+      timer.measure(triangles.size() / 3, [&]() {
+	  graph = loader.openGraph(filename.c_str(), std::make_shared<NodeArray>());
+	});
+      timer.addChecksum(graph.get() ? double(graph->getEdgeCount()) : 0.0);
+      remove(filename.c_str());
+    });
+
+  // the given file does not depend on the scale, so it is only loaded at the smallest one
+  if (!shapefile.empty()) {
+    suite.add("loader/shapefile", "records", [=](BenchmarkTimer & timer, size_t size) {
+	ShapefileLoader loader;
+	std::shared_ptr<Graph> graph;
+	auto t0 = std::chrono::steady_clock::now();
+	graph = loader.openGraph(shapefile.c_str(), std::make_shared<NodeArray>());
+	double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	if (graph.get()) {
+	  timer.add(graph->getFaceCount(), t);
+	  timer.addChecksum(double(graph->getEdgeCount()));
+	}
+      }, shapefile_size);
+  }
+}
+
+static void
+printUsage(const char * program) {
+  cerr << "usage: " << program << " [options]\n"
+       << "  --scales s1,s2,...  small (10k), medium (100k), large (1M), huge (10M) or a number, default small,medium\n"
+       << "  --repeat n          repetitions of each case, default 3\n"
+       << "  --filter text       only run the cases whose name contains text\n"
+       << "  --output file       write the JSON results to file instead of stdout\n"
+       << "  --shapefile file    also benchmark loading the given shapefile\n"
+       << "  --tmpdir dir        directory for the generated input files, default /tmp\n"
+       << "  --list              list the cases\n";
+}
+
+int
+main(int argc, char * argv[]) {
+  vector<benchmark_scale_s> scales = BenchmarkSuite::getDefaultScales();
+  unsigned int repetitions = 3;
+  string filter, output, shapefile;
+  bool list = false;
+
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--scales" && has_value) {
+      scales.clear();
+      string s = argv[++i];
+      size_t pos = 0;
+      while (pos <= s.size()) {
+	size_t end = s.find(',', pos);
+	if (end == string::npos) end = s.size();
+	benchmark_scale_s scale;
+	if (!BenchmarkSuite::getScale(s.substr(pos, end - pos), scale)) {
+	  cerr << "invalid scale " << s.substr(pos, end - pos) << endl;
+	  return 1;
+	}
+	scales.push_back(scale);
+	pos = end + 1;
+      }
+    } else if (arg == "--repeat" && has_value) {
+      repetitions = atoi(argv[++i]);
+    } else if (arg == "--filter" && has_value) {
+      filter = argv[++i];
+    } else if (arg == "--output" && has_value) {
+      output = argv[++i];
+    } else if (arg == "--shapefile" && has_value) {
+      shapefile = argv[++i];
+    } else if (arg == "--tmpdir" && has_value) {
+      tmp_dir = argv[++i];
+    } else if (arg == "--list") {
+      list = true;
+    } else {
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  size_t smallest = scales.front().size;
+  for (auto & s : scales) smallest = min(smallest, s.size);
+
+  BenchmarkSuite suite;
+  addGraphBenchmarks(suite);
+  addFilterBenchmarks(suite);
+  addGeneratorBenchmarks(suite);
+  addTableBenchmarks(suite);
+  addLoaderBenchmarks(suite, shapefile, smallest);
+
+  if (list) {
+    for (auto & name : suite.getNames()) cout << name << endl;
+    return 0;
+  }
+
+  suite.run(scales, filter, repetitions);
+
+  if (output.empty()) {
+    suite.writeJSON(cout);
+  } else {
+    ofstream out(output);
+    if (!out) {
+      cerr << "Cannot open " << output << endl;
+      return 1;
+    }
+    suite.writeJSON(out);
+  }
+  return 0;
+}
@@ -5,11 +5,109 @@
 #include <memory>
 #include <vector>
 #include <cassert>
+#include <cstdlib>
+#include <type_traits>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// rows per zone in the zone maps of numeric columns
+#define COLUMN_ZONE_SIZE	4096
 
 namespace table {
+  // read-only view of contiguous column values in the manner of std::span<const T>
+  template<class T>
+  class ColumnView {
+  public:
+  ColumnView() : ptr(0), n(0) { }
+  ColumnView(const T * _ptr, size_t _n) : ptr(_ptr), n(_n) { }
+
+    const T * data() const { return ptr; }
+    size_t size() const { return n; }
+    bool empty() const { return n == 0; }
+    const T & operator[] (size_t i) const { return ptr[i]; }
+    const T * begin() const { return ptr; }
+    const T * end() const { return ptr + n; }
+
+  private:
+    const T * ptr;
+    size_t n;
+  };
+
+  // non-owning reference to text in the manner of std::string_view
+  class TextView {
+  public:
+  TextView() : ptr(""), len(0) { }
+  TextView(const char * _ptr, size_t _len) : ptr(_ptr), len(_len) { }
+  TextView(const std::string & s) : ptr(s.data()), len(s.size()) { }
+
+    const char * data() const { return ptr; }
+    size_t size() const { return len; }
+    bool empty() const { return len == 0; }
+    std::string str() const { return std::string(ptr, len); }
+
+    bool operator==(const TextView & other) const {
+      return len == other.len && memcmp(ptr, other.ptr, len) == 0;
+    }
+    bool operator!=(const TextView & other) const { return !(*this == other); }
+    bool operator<(const TextView & other) const {
+      int r = memcmp(ptr, other.ptr, len < other.len ? len : other.len);
+      return r < 0 || (r == 0 && len < other.len);
+    }
+
+  private:
+    const char * ptr;
+    size_t len;
+  };
+
+  // value range of COLUMN_ZONE_SIZE consecutive rows, NaNs count as nulls
+  struct column_zone_s {
+    double min_value, max_value, sum;
+    unsigned int null_count;
+  };
+
+  struct column_statistics_s {
+    double min_value, max_value, sum;
+    size_t count, null_count;
+  };
+
+  // moves the values of the ascending rows to the front in order
+  template<class T>
+  void retainValues(std::vector<T> & data, const std::vector<int> & rows) {
+    size_t n = 0;
+    for (int row : rows) {
+      if (row >= 0 && size_t(row) < data.size()) {
+	if (size_t(row) != n) data[n] = std::move(data[row]);
+	n++;
+      }
+    }
+    data.resize(n);
+  }
+
+  class ColumnBase;
+
+  // Secondary index that a column keeps up to date as it is modified, the
+  // implementations and the lookup functions are in TableIndex.h
+  class ColumnIndex {
+  public:
+    virtual ~ColumnIndex() = default;
+
+    // Adds row with its current value. Keys are read back from the column, so
+    // the index is told about a row before its value changes and again after.
+    virtual void insert(const ColumnBase & col, int row) = 0;
+    // removes row with its current value
+    virtual void erase(const ColumnBase & col, int row) = 0;
+    virtual void clear() = 0;
+
+    // returns the rows whose value matches key when parsed to the key type of the index
+    virtual void findRows(const std::string & key, std::vector<int> & rows) const = 0;
+  };
+
   class ColumnBase {
   public:
   ColumnBase() { }
+    // a copy is not indexed
+  ColumnBase(const ColumnBase & other) { }
 
     ColumnBase & operator= (const ColumnBase & other) = delete;
 
@@ -37,6 +135,64 @@ namespace table {
     virtual void pushValue(const std::string & v) = 0;
 
     virtual void remove(int row) = 0;
+    // keeps the given rows, which are in ascending order, and removes the rest without reordering
+    virtual void retainRows(const std::vector<int> & rows) = 0;
+
+    // batch getters that read n rows with a single virtual call
+    virtual void gather(const int * rows, size_t n, double * out) const {
+      for (size_t i = 0; i < n; i++) out[i] = getDouble(rows[i]);
+    }
+    virtual void gather(const int * rows, size_t n, int * out) const {
+      for (size_t i = 0; i < n; i++) out[i] = getInt(rows[i]);
+    }
+    virtual void gather(const int * rows, size_t n, long long * out) const {
+      for (size_t i = 0; i < n; i++) out[i] = getInt64(rows[i]);
+    }
+    // batch setters that write n rows with a single virtual call
+    virtual void scatter(const int * rows, size_t n, const double * values) {
+      for (size_t i = 0; i < n; i++) setValue(rows[i], values[i]);
+    }
+    virtual void scatter(const int * rows, size_t n, const long long * values) {
+      for (size_t i = 0; i < n; i++) setValue(rows[i], values[i]);
+    }
+
+    // returns the text of row i without copying when the column stores it
+    // contiguously, otherwise the value is copied to buffer first
+    virtual TextView getTextView(int i, std::string & buffer) const {
+      buffer = getText(i);
+      return TextView(buffer);
+    }
+
+    // zone map and summary of columns that maintain them on update
+    virtual const std::vector<column_zone_s> * getZones() const { return 0; }
+    virtual bool getStatistics(column_statistics_s & stats) const { return false; }
+
+    // attaches an index that is built from the current values, or removes it when null
+    void setIndex(const std::shared_ptr<ColumnIndex> & _index) {
+      index = _index;
+      if (index) {
+	index->clear();
+	for (size_t i = 0; i < size(); i++) index->insert(*this, int(i));
+      }
+    }
+    const ColumnIndex * getIndex() const { return index.get(); }
+
+  protected:
+    // called by the implementations before and after modifying the value of a row
+    void unindexRow(int row) { if (index) index->erase(*this, row); }
+    void indexRow(int row) { if (index) index->insert(*this, row); }
+    // called before row is replaced by the last row and the last row is removed
+    void unindexRemovedRow(int row) {
+      if (index) {
+	index->erase(*this, row);
+	if (size_t(row) + 1 < size()) index->erase(*this, int(size()) - 1);
+      }
+    }
+    void clearIndex() { if (index) index->clear(); }
+    void rebuildIndex() { setIndex(index); }
+
+  private:
+    std::shared_ptr<ColumnIndex> index;
   };
 
   template<class T>
@@ -50,52 +206,170 @@ namespace table {
     std::string getText(int i) const override { return std::to_string(data[i]); }
     int getInt(int i) const override { return (int)data[i]; }
     
-    void setValue(int i, double v) override {
-      assert(i >= 0);
-      while (i >= data.size()) data.push_back(T());
-      data[i] = T(v);
-    }
-    void setValue(int i, long long v) override {
-      assert(i >= 0);
-      while (i >= data.size()) data.push_back(T());
-      data[i] = T(v);
-    }
+    void setValue(int i, double v) override { assign(i, T(v)); }
+    void setValue(int i, long long v) override { assign(i, T(v)); }
     void setValue(int i, const std::string & v) override {
-      // setValue(i, stoi(v));
-    }
-    void setValue(int i, int v) override {
-      assert(i >= 0);
-      while (i >= data.size()) data.push_back(T());
-      data[i] = T(v);
+      if (std::is_integral<T>::value) {
+	setValue(i, (long long)strtoll(v.c_str(), 0, 10));
+      } else {
+	setValue(i, strtod(v.c_str(), 0));
+      }
     }
+    void setValue(int i, int v) override { assign(i, T(v)); }
     
-    void pushValue(double v) override { data.push_back(T(v)); }
+    void pushValue(double v) override { append(T(v)); }
     void pushValue(const std::string & v) override {
-      // data.push_back(v);
-    }
-    void pushValue(long long v) override {
-      data.push_back(T(v));
-    }
-    void pushValue(int v) override {
-      data.push_back(T(v));
+      if (std::is_integral<T>::value) {
+	pushValue((long long)strtoll(v.c_str(), 0, 10));
+      } else {
+	pushValue(strtod(v.c_str(), 0));
+      }
     }
+    void pushValue(long long v) override { append(T(v)); }
+    void pushValue(int v) override { append(T(v)); }
 
     bool compare(int a, int b) const override {
       return data[a] < data[b];
     }
-    void clear() override { data.clear(); }
+    void clear() override {
+      data.clear();
+      zones.clear();
+      clearIndex();
+    }
+
+    // non-virtual typed access
+    const T & get(int i) const { return data[i]; }
+    ColumnView<T> view() const { return ColumnView<T>(data.data(), data.size()); }
+
+    void gather(const int * rows, size_t n, double * out) const override { gatherTyped(rows, n, out); }
+    void gather(const int * rows, size_t n, int * out) const override { gatherTyped(rows, n, out); }
+    void gather(const int * rows, size_t n, long long * out) const override { gatherTyped(rows, n, out); }
+    void scatter(const int * rows, size_t n, const double * values) override {
+      for (size_t i = 0; i < n; i++) assign(rows[i], T(values[i]));
+    }
+    void scatter(const int * rows, size_t n, const long long * values) override {
+      for (size_t i = 0; i < n; i++) assign(rows[i], T(values[i]));
+    }
 
     void remove(int row) override {
       if (row >= 0 && row < data.size()) {
+	unindexRemovedRow(row);
 	data[row] = data.back();
 	data.pop_back();
+	zones.resize((data.size() + COLUMN_ZONE_SIZE - 1) / COLUMN_ZONE_SIZE);
+	// the zone of the row and the last zone have changed
+	if (row < data.size()) {
+	  rebuildZone(row / COLUMN_ZONE_SIZE);
+	  indexRow(row);
+	}
+	if (!zones.empty()) rebuildZone(zones.size() - 1);
       }
     }
 
+    void retainRows(const std::vector<int> & rows) override {
+      retainValues(data, rows);
+      zones.resize((data.size() + COLUMN_ZONE_SIZE - 1) / COLUMN_ZONE_SIZE);
+      for (size_t z = 0; z < zones.size(); z++) rebuildZone(z);
+      rebuildIndex();
+    }
+
+    // the zones are kept up to date by the writers, so reading them does not modify the column
+    const std::vector<column_zone_s> * getZones() const override { return &zones; }
+
+    bool getStatistics(column_statistics_s & stats) const override {
+      stats = { 0.0, 0.0, 0.0, 0, 0 };
+      bool first = true;
+      for (auto & zone : zones) {
+	size_t n = COLUMN_ZONE_SIZE;
+	if (&zone == &(zones.back())) n = data.size() - (zones.size() - 1) * COLUMN_ZONE_SIZE;
+	stats.null_count += zone.null_count;
+	if (zone.null_count == n) continue;
+	if (first || zone.min_value < stats.min_value) stats.min_value = zone.min_value;
+	if (first || zone.max_value > stats.max_value) stats.max_value = zone.max_value;
+	stats.sum += zone.sum;
+	first = false;
+      }
+      stats.count = data.size() - stats.null_count;
+      return true;
+    }
+
   private:
+    static bool isNull(double x) { return x != x; }
+
+    void append(T v) {
+      if (data.size() % COLUMN_ZONE_SIZE == 0) {
+	zones.push_back({ std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), 0.0, 0 });
+      }
+      data.push_back(v);
+      addToZone(zones.back(), double(v));
+      indexRow(int(data.size()) - 1);
+    }
+
+    void assign(int i, T v) {
+      assert(i >= 0);
+      while (i > data.size()) append(T());
+      if (i == data.size()) {
+	append(v);
+	return;
+      }
+      unindexRow(i);
+      size_t z = i / COLUMN_ZONE_SIZE;
+      auto & zone = zones[z];
+      double old = double(data[i]), x = double(v);
+      data[i] = v;
+      if (!isNull(old) && ((old <= zone.min_value && !(x <= old)) || (old >= zone.max_value && !(x >= old)))) {
+	// the old value was the minimum or the maximum and the new one does not replace it
+	rebuildZone(z);
+      } else {
+	if (isNull(old)) {
+	  zone.null_count--;
+	} else {
+	  zone.sum -= old;
+	}
+	addToZone(zone, x);
+      }
+      indexRow(i);
+    }
+
+    static void addToZone(column_zone_s & zone, double x) {
+      if (isNull(x)) {
+	zone.null_count++;
+      } else {
+	if (x < zone.min_value) zone.min_value = x;
+	if (x > zone.max_value) zone.max_value = x;
+	zone.sum += x;
+      }
+    }
+
+    void rebuildZone(size_t z) {
+      auto & zone = zones[z];
+      zone = { std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), 0.0, 0 };
+      size_t end = std::min(data.size(), (z + 1) * COLUMN_ZONE_SIZE);
+      for (size_t i = z * COLUMN_ZONE_SIZE; i < end; i++) {
+	addToZone(zone, double(data[i]));
+      }
+    }
+
+    template<class U>
+    void gatherTyped(const int * rows, size_t n, U * out) const {
+      const T * d = data.data();
+      size_t s = data.size();
+      for (size_t i = 0; i < n; i++) {
+	size_t row = (size_t)rows[i];
+	out[i] = row < s ? U(d[row]) : U();
+      }
+    }
+
     std::vector<T> data;
+    std::vector<column_zone_s> zones;
   };
 
+  // returns the column as Column<T> if it stores values of type T, or null
+  template<class T>
+  const Column<T> * getTypedColumn(const ColumnBase & col) {
+    return dynamic_cast<const Column<T> *>(&col);
+  }
+
   class NullColumn : public ColumnBase {
   public:
   NullColumn() { }
@@ -116,6 +390,7 @@ namespace table {
     void pushValue(long long v) override { }
     void pushValue(const std::string & v) override { }
     void remove(int row) override { }
+    void retainRows(const std::vector<int> & rows) override { }
   };
 };
 
@@ -0,0 +1,56 @@
+#ifndef _TABLE_COLUMNKERNELS_H_
+#define _TABLE_COLUMNKERNELS_H_
+
+#include "Column.h"
+
+#include <vector>
+#include <cstdint>
+
+// Bulk operations on numeric columns. Typed columns are processed from
+// their contiguous storage in tight loops that the compiler can vectorise,
+// other columns are read through getDouble(). Large columns are split
+// across threads.
+
+namespace table {
+  // one bit per row
+  class SelectionBitmap {
+  public:
+  SelectionBitmap() : num_rows(0) { }
+
+    void resize(size_t n) {
+      num_rows = n;
+      words.assign((n + 63) / 64, 0);
+    }
+    size_t size() const { return num_rows; }
+    bool test(size_t row) const { return (words[row >> 6] >> (row & 63)) & 1; }
+    void set(size_t row) { words[row >> 6] |= uint64_t(1) << (row & 63); }
+    size_t count() const;
+    // returns the selected rows in ascending order
+    std::vector<int> getRows() const;
+
+    std::vector<uint64_t> & getWords() { return words; }
+    const std::vector<uint64_t> & getWords() const { return words; }
+
+  private:
+    size_t num_rows;
+    std::vector<uint64_t> words;
+  };
+
+  struct column_summary_s {
+    double min_value, max_value, sum;
+    size_t count; // number of non-NaN values
+  };
+
+  // selects the rows with min_value <= v <= max_value
+  void filterRange(const ColumnBase & col, double min_value, double max_value, SelectionBitmap & selection);
+  column_summary_s summarize(const ColumnBase & col);
+  // returns num_buckets + 1 bucket boundaries that split the values into equally populated buckets
+  std::vector<double> getQuantiles(const ColumnBase & col, unsigned int num_buckets);
+  // counts values per bucket [boundaries[i], boundaries[i + 1]), the last bucket is closed
+  std::vector<size_t> getHistogram(const ColumnBase & col, const std::vector<double> & boundaries);
+  // returns the row permutation that sorts the column, ties keep the row order
+  // and NaNs come last
+  std::vector<int> argsort(const ColumnBase & col, bool descending = false);
+};
+
+#endif
@@ -3,23 +3,38 @@
 
 #include "Column.h"
 
-#include <Deflate.h>
-#include <Inflate.h>
+#include <TextCodec.h>
 
 #include <string>
 #include <cstring>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <utility>
 
-#define MAX_BLOCK_SIZE 1048576
+// values are packed into independently compressed blocks of about this size
+#define COMPRESSED_BLOCK_SIZE	32768
+#define COMPRESSED_BLOCK_CACHE_SIZE	4
 
 namespace table {
   struct data_ptr_s {
-    unsigned short block_number, data_length;
-    unsigned int data_offset;
+    unsigned int block_number, data_offset, data_length;
   };
   
   class CompressedTextColumn : public ColumnBase {
   public:
-  CompressedTextColumn() { }
+  CompressedTextColumn(TextCodecType _codec_type = CODEC_ZLIB)
+    : codec_type(_codec_type), codec(createTextCodec(_codec_type)) { }
+  CompressedTextColumn(const CompressedTextColumn & other)
+    : ColumnBase(other),
+      codec_type(other.codec_type),
+      codec(createTextCodec(other.codec_type)),
+      data(other.data),
+      compressed_blocks(other.compressed_blocks),
+      active_block(other.active_block),
+      uncompressed_size(other.uncompressed_size),
+      compressed_size(other.compressed_size) { }
     
     size_t size() const override { return data.size(); }
     void reserve(size_t n) override { data.reserve(n); }
@@ -32,31 +47,81 @@ namespace table {
 	auto & p = data[i];
 	if (p.data_length) {
 	  if (p.block_number < compressed_blocks.size()) {
-	    Inflate inflate(&(compressed_blocks[p.block_number]));
-	    return inflate.decompressString(p.data_offset, p.data_length);
+	    std::lock_guard<std::mutex> lock(cache_mutex);
+	    auto & block = getBlock(p.block_number);
+	    return block.substr(p.data_offset, p.data_length);
 	  } else {
-	    Deflate tmp(active_block);
-	    tmp.flush();
-	    Inflate inflate(&(tmp.data()));
-	    return inflate.decompressString(p.data_offset, p.data_length);
+	    return active_block.substr(p.data_offset, p.data_length);
 	  }
 	}
       }
       return "";
     }
     
+    // reads the values of n rows into output. The rows that fall into the
+    // same sealed block are extracted with one pass over it, which stops at
+    // the last value needed and leaves the block cache as it is.
+    void gatherText(const int * rows, size_t n, std::vector<std::string> & output) const {
+      output.assign(n, std::string());
+      std::vector<std::pair<unsigned int, size_t> > order; // (block, index in rows)
+      for (size_t i = 0; i < n; i++) {
+	int row = rows[i];
+	if (row < 0 || size_t(row) >= data.size() || !data[row].data_length) continue;
+	auto & p = data[row];
+	if (p.block_number < compressed_blocks.size()) {
+	  order.push_back(std::make_pair(p.block_number, i));
+	} else {
+	  output[i] = active_block.substr(p.data_offset, p.data_length);
+	}
+      }
+      std::sort(order.begin(), order.end());
+
+      std::vector<std::pair<unsigned int, unsigned int> > ranges;
+      std::vector<std::string> values;
+      for (size_t b = 0, e = 0; b < order.size(); b = e) {
+	unsigned int block_number = order[b].first;
+	size_t block_end = 0;
+	ranges.clear();
+	for (e = b; e < order.size() && order[e].first == block_number; e++) {
+	  auto & p = data[rows[order[e].second]];
+	  ranges.push_back(std::make_pair(p.data_offset, p.data_length));
+	  block_end = std::max(block_end, size_t(p.data_offset) + p.data_length);
+	}
+	{
+	  std::lock_guard<std::mutex> lock(cache_mutex);
+	  if (auto block = findCachedBlock(block_number)) {
+	    for (size_t k = b; k < e; k++) output[order[k].second] = block->substr(ranges[k - b].first, ranges[k - b].second);
+	    continue;
+	  }
+	}
+	auto t0 = std::chrono::steady_clock::now();
+	codec->decompressRanges(compressed_blocks[block_number], ranges.data(), ranges.size(), values);
+	{
+	  std::lock_guard<std::mutex> lock(cache_mutex);
+	  decode_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	  decoded_bytes += block_end;
+	}
+	for (size_t k = b; k < e; k++) output[order[k].second] = std::move(values[k - b]);
+      }
+    }
+
     void setValue(int i, double v) override { setValue(i, std::to_string(v)); }
     void setValue(int i, int v) override { setValue(i, std::to_string(v)); }
     void setValue(int i, long long v) override { setValue(i, std::to_string(v)); }
     void setValue(int i, const std::string & v) override { setValue(i, v.c_str(), v.size()); }
     void setValue(int i, const char * v, const size_t len) {
       // std::cerr << "setValue(" << i << ", " << v << ", " << len << ")\n";
-      while (i >= data.size()) data.push_back({ 0, 0, 0 });
+      while (i >= data.size()) {
+	data.push_back({ 0, 0, 0 });
+	indexRow(int(data.size()) - 1);
+      }
+      unindexRow(i);
       if (len) {
 	data[i] = compressValue(v, len);
       } else if (data[i].data_length) {
 	data[i] = { 0, 0, 0 };
       }      
+      indexRow(i);
     }
 
     void pushValue(double v) override { pushValue(std::to_string(v)); }
@@ -69,44 +134,123 @@ namespace table {
       } else {
 	data.push_back({ 0, 0, 0 });
       }
+      indexRow(int(data.size()) - 1);
     }    
 
     bool compare(int a, int b) const override { return 0; }
     void clear() override {
       data.clear();
       compressed_blocks.clear();
-      active_block.reset();
+      active_block.clear();
       uncompressed_size = compressed_size = 0;
+      clearIndex();
+      std::lock_guard<std::mutex> lock(cache_mutex);
+      cache.clear();
     }
 
     void remove(int row) override {
       if (row >= 0 && row < data.size()) {
+	unindexRemovedRow(row);
 	data[row] = data.back();
 	data.pop_back();
+	if (row < data.size()) indexRow(row);
       }
     }
 
+    // the values of removed rows stay in the blocks
+    void retainRows(const std::vector<int> & rows) override {
+      retainValues(data, rows);
+      rebuildIndex();
+    }
+
+    TextCodecType getCodecType() const { return codec_type; }
+    const char * getCodecName() const { return codec->getName(); }
+
+    size_t getUncompressedSize() const { return uncompressed_size; }
+    size_t getCompressedSize() const { return compressed_size + active_block.size(); }
+    double getCompressionRatio() const {
+      return uncompressed_size ? double(getCompressedSize()) / uncompressed_size : 1.0;
+    }
+
+    // bytes decompressed on reads and the throughput in bytes per second
+    size_t getDecodedBytes() const { return decoded_bytes; }
+    double getDecodeThroughput() const {
+      return decode_time > 0 ? decoded_bytes / decode_time : 0.0;
+    }
+
   private:
+    struct cached_block_s {
+      unsigned int block_number;
+      unsigned int last_used;
+      std::string data;
+    };
+
     data_ptr_s compressValue(const char * v, size_t len) {
-      unsigned short block_num = compressed_blocks.size();
-      unsigned int offset = active_block.compress(v, len);
-      if (active_block.size() >= MAX_BLOCK_SIZE) {
-	active_block.flush();
-	compressed_blocks.push_back(active_block.data());
-	compressed_size += active_block.size();
-	active_block.reset();
-      }
+      unsigned int block_num = compressed_blocks.size();
+      unsigned int offset = active_block.size();
+      active_block.append(v, len);
       uncompressed_size += len;
-      unsigned int tmp = compressed_size + active_block.size();
-      // std::cerr << "compressed text " << v << " (blocks = " << (compressed_blocks.size() + 1) << ", total = " << uncompressed_size << ", compressed = " << tmp << ", ratio = " << (100.0 * tmp / uncompressed_size) << std::endl;
+      if (active_block.size() >= COMPRESSED_BLOCK_SIZE) {
+	sealBlock();
+      }
+      return { block_num, offset, (unsigned int)len };
+    }
+
+    // compresses the active block as a stream of its own
+    void sealBlock() {
+      compressed_blocks.push_back(std::basic_string<unsigned char>());
+      codec->compress(active_block.data(), active_block.size(), compressed_blocks.back());
+      compressed_size += compressed_blocks.back().size();
+      active_block.clear();
+    }
 
-      return { block_num, (unsigned short)len, offset };
+    // returns the block if it is in the cache, cache_mutex must be held
+    const std::string * findCachedBlock(unsigned int block_number) const {
+      for (auto & b : cache) {
+	if (b.block_number == block_number) {
+	  b.last_used = ++cache_clock;
+	  return &(b.data);
+	}
+      }
+      return 0;
+    }
+
+    // returns a decompressed block from the LRU cache, cache_mutex must be held
+    const std::string & getBlock(unsigned int block_number) const {
+      if (auto block = findCachedBlock(block_number)) return *block;
+      cache_clock++;
+      cached_block_s * slot = 0;
+      if (cache.size() < COMPRESSED_BLOCK_CACHE_SIZE) {
+	cache.push_back(cached_block_s());
+	slot = &(cache.back());
+      } else {
+	slot = &(cache.front());
+	for (auto & b : cache) {
+	  if (b.last_used < slot->last_used) slot = &b;
+	}
+      }
+      slot->block_number = block_number;
+      slot->last_used = cache_clock;
+      slot->data.clear();
+      auto t0 = std::chrono::steady_clock::now();
+      codec->decompress(compressed_blocks[block_number], slot->data);
+      decode_time += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      decoded_bytes += slot->data.size();
+      return slot->data;
     }
 
+    TextCodecType codec_type;
+    std::unique_ptr<TextCodec> codec;
     std::vector<data_ptr_s> data;
     std::vector<std::basic_string<unsigned char> > compressed_blocks;
-    Deflate active_block;
-    unsigned int uncompressed_size = 0, compressed_size = 0;
+    std::string active_block;
+    size_t uncompressed_size = 0, compressed_size = 0;
+
+    mutable std::mutex cache_mutex;
+    mutable std::vector<cached_block_s> cache;
+    mutable unsigned int cache_clock = 0;
+    mutable size_t decoded_bytes = 0;
+    mutable double decode_time = 0;
   };
 };
 
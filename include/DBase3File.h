@@ -33,26 +33,32 @@ namespace table {
     void pushValue(long long v) override { }
     void pushValue(const std::string & v) override { }
 
-    bool compare(int a, int b) const override { return getText(a) < getText(b); }
+    bool compare(int a, int b) const override;
     void clear() override { }
 
     void remove(int row) override { }
+    void retainRows(const std::vector<int> & rows) override { }
 
   private:
     std::shared_ptr<DBase3Handle> dbf;
     int column_index;
     unsigned int num_rows;
+    bool is_numeric, is_integral;
   };
 
   class DBase3File {
   public:
-    DBase3File(const std::string & filename);
+    // with materialize set the whole file is decoded into typed in-memory
+    // columns in one pass, otherwise cells are read through shapelib on access.
+    // Both give the same text for a cell.
+    DBase3File(const std::string & filename, bool materialize = false);
     
     unsigned int getRecordCount() const { return record_count; }
     std::map<std::string, std::shared_ptr<ColumnBase> > & getColumns() { return columns; }
     
   private:
     bool openDBF(const std::string & filename);
+    bool loadDBF(const std::string & filename);
     
     std::shared_ptr<DBase3Handle> dbf;
     unsigned int record_count;
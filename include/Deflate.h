@@ -18,6 +18,8 @@ class Deflate {
 
   size_t size() const { return output_buffer.size(); }
   const std::basic_string<unsigned char> & data() const { return output_buffer; }
+  // moves the compressed output to other and leaves the buffer empty
+  void swapData(std::basic_string<unsigned char> & other);
   
  private:
   bool init();
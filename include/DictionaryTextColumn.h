@@ -0,0 +1,110 @@
+#ifndef _TABLE_DICTIONARYTEXTCOLUMN_H_
+#define _TABLE_DICTIONARYTEXTCOLUMN_H_
+
+#include "Column.h"
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace table {
+  // Text column for low-cardinality values (languages, user names, types).
+  // Each row stores a code into a dictionary of distinct values and code 0 is
+  // the empty string.
+  class DictionaryTextColumn : public ColumnBase {
+  public:
+  DictionaryTextColumn() : dictionary(1) { }
+    
+    size_t size() const override { return codes.size(); }
+    void reserve(size_t n) override { codes.reserve(n); }
+    
+    double getDouble(int i) const override { return 0; }
+    int getInt(int i) const override { return 0; }
+    long long getInt64(int i) const override { return 0; }
+    std::string getText(int i) const override {
+      if (i >= 0 && i < codes.size()) {
+	return dictionary[codes[i]];
+      } else {
+	return "";
+      }
+    }
+
+    TextView getTextView(int i, std::string & buffer) const override {
+      return TextView(dictionary[getCode(i)]);
+    }
+
+    unsigned int getCode(int i) const { return i >= 0 && i < codes.size() ? codes[i] : 0; }
+    const std::string & getDictionaryValue(unsigned int code) const { return dictionary[code]; }
+    size_t getDictionarySize() const { return dictionary.size(); }
+    
+    void setValue(int i, double v) override { setValue(i, std::to_string(v)); }
+    void setValue(int i, int v) override { setValue(i, std::to_string(v)); }
+    void setValue(int i, long long v) override { setValue(i, std::to_string(v)); }
+    void setValue(int i, const std::string & v) override {
+      while (i >= codes.size()) {
+	codes.push_back(0);
+	indexRow(int(codes.size()) - 1);
+      }
+      unindexRow(i);
+      codes[i] = encode(v);
+      indexRow(i);
+    }
+
+    void pushValue(double v) override { pushValue(std::to_string(v)); }
+    void pushValue(int v) override { pushValue(std::to_string(v)); }
+    void pushValue(long long v) override { pushValue(std::to_string(v)); }
+    void pushValue(const std::string & v) override {
+      codes.push_back(encode(v));
+      indexRow(int(codes.size()) - 1);
+    }
+
+    bool compare(int a, int b) const override { return dictionary[codes[a]] < dictionary[codes[b]]; }
+    void clear() override {
+      codes.clear();
+      dictionary.resize(1);
+      index.clear();
+      uncompressed_size = 0;
+      clearIndex();
+    }
+
+    void remove(int row) override {
+      if (row >= 0 && row < codes.size()) {
+	unindexRemovedRow(row);
+	codes[row] = codes.back();
+	codes.pop_back();
+	if (row < codes.size()) indexRow(row);
+      }
+    }
+
+    void retainRows(const std::vector<int> & rows) override {
+      retainValues(codes, rows);
+      rebuildIndex();
+    }
+
+    size_t getUncompressedSize() const { return uncompressed_size; }
+    size_t getCompressedSize() const {
+      size_t s = codes.size() * sizeof(unsigned int);
+      for (auto & v : dictionary) s += v.size();
+      return s;
+    }
+    double getCompressionRatio() const {
+      return uncompressed_size ? double(getCompressedSize()) / uncompressed_size : 1.0;
+    }
+
+  private:
+    unsigned int encode(const std::string & v) {
+      uncompressed_size += v.size();
+      if (v.empty()) return 0;
+      auto r = index.emplace(v, (unsigned int)dictionary.size());
+      if (r.second) dictionary.push_back(v);
+      return r.first->second;
+    }
+
+    std::vector<unsigned int> codes;
+    std::vector<std::string> dictionary;
+    std::unordered_map<std::string, unsigned int> index;
+    size_t uncompressed_size = 0;
+  };
+};
+
+#endif
@@ -16,14 +16,13 @@
 #define NODE_LABEL_VISIBLE	2
 #define NODE_IS_INITIALIZED	4
 
-struct node_tertiary_data_s {
-  int first_edge = -1;
-  int indegree = 0, outdegree = 0;
-  float weighted_indegree = 0.0f, weighted_outdegree = 0.0f, weighted_selfdegree = 0.0f;
+// the per-node data of a graph is split by access pattern into separately
+// allocated arrays, so that a pass only pulls the fields it uses into cache
+
+// hierarchy links
+struct node_hierarchy_data_s {
   int first_child = -1, next_child = -1, parent_node = -1;
   unsigned int child_count = 0, descendant_count = 0;
-  unsigned short flags = NODE_IS_SELECTED;
-  unsigned short label_visibility_val = 0;
   int group_leader = -1;
 
   bool hasChildren() const { return first_child != -1; }
@@ -36,7 +35,20 @@ struct node_tertiary_data_s {
       return false;
     }
   }
-  
+};
+
+// the first outgoing edge and the degree counters
+struct node_degree_data_s {
+  int first_edge = -1;
+  int indegree = 0, outdegree = 0;
+  float weighted_indegree = 0.0f, weighted_outdegree = 0.0f, weighted_selfdegree = 0.0f;
+};
+
+// render state that changes every frame
+struct node_render_data_s {
+  unsigned short flags = NODE_IS_SELECTED;
+  unsigned short label_visibility_val = 0;
+
   bool setIsInitialized(bool t) {
     if ((t && !isInitialized()) || (!t && isInitialized())) {
       if (t) flags |= NODE_IS_INITIALIZED;
@@ -71,13 +83,20 @@ struct node_tertiary_data_s {
   }
 };
 
+// the fields read by traversals, layout and clustering
 struct edge_data_s {
-edge_data_s() : weight(1.0f), tail(-1), head(-1), next_node_edge(-1), face(-1), next_face_edge(-1), arc(0) { }
-edge_data_s(float _weight, int _tail, int _head, int _next_node_edge, int _face, int _next_face_edge, int _arc)
-: weight(_weight), tail(_tail), head(_head), next_node_edge(_next_node_edge), face(_face), next_face_edge(_next_face_edge), arc(_arc) { }
+edge_data_s() : weight(1.0f), tail(-1), head(-1), next_node_edge(-1) { }
+edge_data_s(float _weight, int _tail, int _head, int _next_node_edge)
+: weight(_weight), tail(_tail), head(_head), next_node_edge(_next_node_edge) { }
   
-  float weight, weight_divisor = 1.0f;
-  int tail, head, next_node_edge, face, next_face_edge, arc, pair_edge = -1, parent_edge = -1;
+  float weight;
+  int tail, head, next_node_edge;
+};
+
+// rarely used edge fields, stored apart from edge_data_s
+struct edge_secondary_data_s {
+  int next_face_edge = -1, arc = 0, pair_edge = -1, parent_edge = -1;
+  float weight_divisor = 1.0f;
 };
 
 struct face_data_s {
@@ -160,13 +179,13 @@ class Graph {
   bool isNodeVisible(int node) const;
 
   void setGroupLeader(int node, int leader) {
-    if (node_geometry3.size() <= node) node_geometry3.resize(node + 1);
-    node_geometry3[node].group_leader = leader;
+    growNodeData(node);
+    node_hierarchy[node].group_leader = leader;
   }
 
   void setIsInitialized(int node, bool t) {
-    if (node_geometry3.size() <= node) node_geometry3.resize(node + 1);
-    node_geometry3[node].setIsInitialized(t);
+    growNodeData(node);
+    node_render[node].setIsInitialized(t);
   }
 
   int getFaceFirstEdge(int i) const { return face_attributes[i].first_edge; }
@@ -183,28 +202,34 @@ class Graph {
   int getEdgeTargetNode(int edge) const {
     return getEdgeAttributes(edge).head;
   }
+  int getEdgeFace(int edge) const { return edge_faces[edge]; }
   void setEdgeFace(int edge, int face) {
-    auto & ed = getEdgeAttributes(edge);
-    ed.face = face;
+    edge_faces[edge] = face;
     if (face != -1) {
-      ed.next_face_edge = getFaceFirstEdge(face);
+      getEdgeSecondaryAttributes(edge).next_face_edge = getFaceFirstEdge(face);
       face_attributes[face].first_edge = edge;
     }
   }
 
   int addEdge(int n1, int n2, int face = -1, float weight = 1.0f, int arc_id = 0);
+  // Adds edges in bulk and returns the id of the first one. weights and faces
+  // may be left empty for weight 1 and no face. The nodes must exist, see
+  // NodeArray::createNodes(). The result is the same as calling addEdge() for
+  // each edge in order, but the arrays are sized once and the degrees and
+  // edge lists are built in a single sweep, in parallel by node range.
+  int addEdges(const std::vector<int> & tails, const std::vector<int> & heads, const std::vector<float> & weights = std::vector<float>(), const std::vector<int> & faces = std::vector<int>(), bool parallel = true);
 
   void connectEdgePair(int e1, int e2) {
-    getEdgeAttributes(e1).pair_edge = e2;
-    getEdgeAttributes(e2).pair_edge = e1;
+    getEdgeSecondaryAttributes(e1).pair_edge = e2;
+    getEdgeSecondaryAttributes(e2).pair_edge = e1;
   }
 
   void setParentEdge(int child, int parent) {
-    getEdgeAttributes(child).parent_edge = parent;
+    getEdgeSecondaryAttributes(child).parent_edge = parent;
   }
   
   int getNextFaceEdge(int edge) const {
-    return edge_attributes[edge].next_face_edge;
+    return getEdgeSecondaryAttributes(edge).next_face_edge;
   }
 
   void setFaceLabelTexture(int i, int texture) {
@@ -237,22 +262,22 @@ class Graph {
   bool hasEdge(int n1, int n2) const;
 
   void setNodeFirstEdge(int n, int edge) {
-    if (node_geometry3.size() <= n) node_geometry3.resize(n + 1);
-    node_geometry3[n].first_edge = edge;
+    growNodeData(n);
+    node_degrees[n].first_edge = edge;
   }
 
   void updateOutdegree(int n, float weight) {
-    if (node_geometry3.size() <= n) node_geometry3.resize(n + 1);
-    node_geometry3[n].weighted_outdegree += weight;
-    node_geometry3[n].outdegree++;
+    growNodeData(n);
+    node_degrees[n].weighted_outdegree += weight;
+    node_degrees[n].outdegree++;
     total_outdegree++;
     total_weighted_outdegree += weight;
   }
 
   void updateIndegree(int n, float weight) {
-    if (node_geometry3.size() <= n) node_geometry3.resize(n + 1);
-    node_geometry3[n].weighted_indegree += weight;
-    node_geometry3[n].indegree++;
+    growNodeData(n);
+    node_degrees[n].weighted_indegree += weight;
+    node_degrees[n].indegree++;
     total_indegree++;
     total_weighted_indegree += weight;
   }
@@ -269,8 +294,8 @@ class Graph {
   }
  
   int getNodeFirstEdge(int i) const {
-    if (i >= 0 && i < node_geometry3.size()) {
-      return node_geometry3[i].first_edge;
+    if (i >= 0 && i < node_degrees.size()) {
+      return node_degrees[i].first_edge;
     } else {
       return -1;
     }
@@ -278,13 +303,13 @@ class Graph {
 
   // return the weighted degree of the node
   float weightedDegree(int n) {
-    if (node_geometry3.size() <= n) return 0.0f;
-    return node_geometry3[n].weighted_indegree + node_geometry3[n].weighted_outdegree;    
+    if (node_degrees.size() <= n) return 0.0f;
+    return node_degrees[n].weighted_indegree + node_degrees[n].weighted_outdegree;    
   }
 
   unsigned int numberOfNeighbors(int n) {
-    if (node_geometry3.size() <= n) return 0;
-    return node_geometry3[n].indegree + node_geometry3[n].outdegree;
+    if (node_degrees.size() <= n) return 0;
+    return node_degrees[n].indegree + node_degrees[n].outdegree;
   }
 
   // float numberOfSelfLoops(int node);
@@ -330,6 +355,13 @@ class Graph {
     faces.addRow();
     return face_id;
   }
+  // Adds n faces with default attributes at once and returns the id of the first
+  int createFaces(size_t n) {
+    int first_face = (int)face_attributes.size();
+    face_attributes.resize(face_attributes.size() + n, { glm::vec2(0, 0), -1, 0, 0, 0, 0, -1, 0, 0 });
+    faces.addRows(n);
+    return first_face;
+  }
   
   virtual bool checkConsistency() const { return true; }
           
@@ -371,11 +403,15 @@ class Graph {
     faces.clear();    
     face_attributes.clear();
     edge_attributes.clear();
+    edge_faces.clear();
+    edge_secondary_attributes.clear();
 
     max_edge_weight = 0.0f;
     final_graph.reset();
     face_cache.clear();
-    node_geometry3.clear();
+    node_hierarchy.clear();
+    node_degrees.clear();
+    node_render.clear();
     
     total_weighted_outdegree = total_weighted_indegree = 0.0;
     total_outdegree = total_indegree = 0;
@@ -396,6 +432,17 @@ class Graph {
 
   edge_data_s & getEdgeAttributes(int i) { return edge_attributes[i]; }
   const edge_data_s & getEdgeAttributes(int i) const { return edge_attributes[i]; }
+  // edges to or from nodes marked removed are skipped until the nodes are compacted
+  bool isEdgeRemoved(const edge_data_s & ed) const { return nodes->isRemoved(ed.tail) || nodes->isRemoved(ed.head); }
+  // the secondary data is only allocated once some edge uses it
+  edge_secondary_data_s & getEdgeSecondaryAttributes(int i) {
+    if (i >= edge_secondary_attributes.size()) edge_secondary_attributes.resize(edge_attributes.size());
+    return edge_secondary_attributes[i];
+  }
+  const edge_secondary_data_s & getEdgeSecondaryAttributes(int i) const {
+    static const edge_secondary_data_s default_data;
+    return i < edge_secondary_attributes.size() ? edge_secondary_attributes[i] : default_data;
+  }
   EdgeIterator begin_edges() { return EdgeIterator(&(edge_attributes.front())); }
   EdgeIterator end_edges() {
     EdgeIterator it(&(edge_attributes.back()));
@@ -409,7 +456,7 @@ class Graph {
     return it;
   }
 
-  ConstVisibleNodeIterator begin_visible_nodes() const { return ConstVisibleNodeIterator(&(edge_attributes.front()), &(edge_attributes.back()) + 1, &(node_geometry3.front()), &(node_geometry3.back()) + 1, nodes->size(), active_child_node); }
+  ConstVisibleNodeIterator begin_visible_nodes() const { return ConstVisibleNodeIterator(&(edge_attributes.front()), &(edge_attributes.back()) + 1, node_hierarchy.data(), node_hierarchy.data() + node_hierarchy.size(), nodes->size(), active_child_node, nodes->getRemovedCount() ? &(nodes->getRemovedNodes()) : 0); }
   ConstVisibleNodeIterator end_visible_nodes() const { return ConstVisibleNodeIterator(); }
   
   bool updateSelection(time_t start_time, time_t end_time, float start_sentiment, float end_sentiment);
@@ -423,28 +470,36 @@ class Graph {
   bool updateVisibilities(const DisplayInfo & display, bool reset = false);
 
   bool updateNodeLabelValues(int n, float visibility) {
-    if (node_geometry3.size() <= n) node_geometry3.resize(n + 1);
-    auto & td = node_geometry3[n];
-    float vv = td.getLabelVisibilityValue() + visibility;
+    growNodeData(n);
+    auto & rd = node_render[n];
+    float vv = rd.getLabelVisibilityValue() + visibility;
     if (vv < 0) vv = 0;
     else if (vv > 1) vv = 1;
-    td.setLabelVisibilityValue(vv);
-    if (vv >= 0.75) return td.setLabelVisibility(true);
-    else if (vv <= 0.25) return td.setLabelVisibility(false);
+    rd.setLabelVisibilityValue(vv);
+    if (vv >= 0.75) return rd.setLabelVisibility(true);
+    else if (vv <= 0.25) return rd.setLabelVisibility(false);
     else return false;
   }
 
-  const node_tertiary_data_s & getNodeTertiaryData(int n) const {
-    if (n >= 0 && n < node_geometry3.size()) {
-      return node_geometry3[n];
-    } else {
-      return null_geometry3;
-    }
+  const node_hierarchy_data_s & getNodeHierarchyData(int n) const {
+    static const node_hierarchy_data_s null_data;
+    return n >= 0 && n < node_hierarchy.size() ? node_hierarchy[n] : null_data;
+  }
+  const node_degree_data_s & getNodeDegreeData(int n) const {
+    static const node_degree_data_s null_data;
+    return n >= 0 && n < node_degrees.size() ? node_degrees[n] : null_data;
+  }
+  const node_render_data_s & getNodeRenderData(int n) const {
+    static const node_render_data_s null_data;
+    return n >= 0 && n < node_render.size() ? node_render[n] : null_data;
+  }
+  int getParentNode(int n) const {
+    return n >= 0 && n < node_hierarchy.size() ? node_hierarchy[n].parent_node : -1;
   }
 
   int getNodeDepth(int n) const {
     int l = 0;
-    for (int p = node_geometry3[n].parent_node; p != -1; p = node_geometry3[p].parent_node) l++;
+    for (int p = node_hierarchy[n].parent_node; p != -1; p = node_hierarchy[p].parent_node) l++;
     return l;
   }
 
@@ -526,14 +581,35 @@ class Graph {
 
   void convertParentToEdge(int node_id);
 
+  // Drops the nodes marked removed in the node array. Nodes are renumbered in
+  // order, and edges to or from removed nodes are removed. Returns the new id
+  // of each old node or -1.
+  std::vector<int> compactNodes();
+  // applies a node renumbering from NodeArray::compact() to the edges,
+  // hierarchy and node data of the graph (and of the final graph sharing the nodes)
+  virtual void remapNodes(const std::vector<int> & remap);
+
  protected:
   void incLabelVersion() { label_version++; }
 
+  // the single growth point of the per-node arrays
+  void growNodeData(int n) {
+    if (n >= int(node_degrees.size())) resizeNodeData(n + 1);
+  }
+  void resizeNodeData(size_t n) {
+    node_hierarchy.resize(n);
+    node_degrees.resize(n);
+    node_render.resize(n);
+  }
+
   bool setActiveChildNode(int id);
 
   table::Table faces;
+  table::ColumnRef face_label_column{"label", true}, face_name_column{"name", true}, face_text_column{"text", true}, face_id_column{"id", true};
   std::vector<face_data_s> face_attributes;
   std::vector<edge_data_s> edge_attributes;
+  std::vector<int> edge_faces;
+  std::vector<edge_secondary_data_s> edge_secondary_attributes;
   float max_edge_weight = 0.0f;
   std::shared_ptr<NodeArray> nodes;
  
@@ -555,10 +631,11 @@ class Graph {
   int server_search_id = 0;
   bool is_loaded = false;
   float line_width = 1.0f;
-  std::vector<node_tertiary_data_s> node_geometry3;
+  std::vector<node_hierarchy_data_s> node_hierarchy;
+  std::vector<node_degree_data_s> node_degrees;
+  std::vector<node_render_data_s> node_render;
   double total_weighted_outdegree = 0, total_weighted_indegree = 0;
   unsigned int total_outdegree = 0, total_indegree = 0;
-  node_tertiary_data_s null_geometry3;
   int default_symbol_id = 0;
   bool show_nodes = true, show_edges = true, show_faces = true, show_labels = true;
   glm::vec4 node_color, edge_color, face_color;
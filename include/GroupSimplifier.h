@@ -6,7 +6,7 @@
 #include <unordered_set>
 #include <unordered_map>
 
-struct node_tertiary_data_s;
+struct node_degree_data_s;
 
 class GroupSimplifier : public GraphFilter {
  public:
@@ -38,7 +38,7 @@ class GroupSimplifier : public GraphFilter {
   void breakNodePair(Graph & target_graph, int node_id);
   void breakOneDegreeNode(Graph & target_graph, int node_id);
   void breakZeroDegreeNode(Graph & target_graph, int node_id);
-  bool canPair(int n1, int n2, const node_tertiary_data_s & td1, const node_tertiary_data_s & td2) const;
+  bool canPair(int n1, int n2, const node_degree_data_s & td1, const node_degree_data_s & td2) const;
 
  private:
   std::unordered_set<int> seen_nodes;
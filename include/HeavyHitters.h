@@ -0,0 +1,230 @@
+#ifndef _HEAVYHITTERS_H_
+#define _HEAVYHITTERS_H_
+
+#include <vector>
+#include <unordered_map>
+#include <set>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+// Counts keys exactly, or with a capacity keeps only the most frequent keys
+// using the Space-Saving algorithm: when a new key arrives and the table is
+// full, the key with the smallest count is replaced and the new key inherits
+// its count as an error bound. Counts are exact while the number of distinct
+// keys stays within the capacity, and otherwise overestimate by at most
+// total / capacity. A min-heap over the counts finds the replaced key.
+// With a top size the largest counts are also kept sorted while adding, so
+// that reading the top does not need to visit every entry.
+template<class K>
+class HeavyHitters {
+ public:
+  struct entry_s {
+    K key;
+    int count, error;
+  };
+
+  HeavyHitters(size_t _capacity = 0) { setCapacity(_capacity); }
+
+  // 0 means unbounded exact counting
+  void setCapacity(size_t _capacity) {
+    capacity = _capacity;
+    if (capacity) {
+      buildHeap();
+      while (entries.size() > capacity) removeMinimum();
+    } else {
+      heap.clear();
+    }
+    rebuildTop();
+  }
+  size_t getCapacity() const { return capacity; }
+
+  // keeps the k largest counts sorted, 0 disables
+  void setTopSize(size_t k) {
+    top_size = k;
+    rebuildTop();
+  }
+  size_t getTopSize() const { return top_size; }
+
+  // returns the count of the key after the addition
+  int add(const K & key, int weight = 1) { return add(key, weight, 0); }
+
+  int add(const K & key, int weight, int error) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+      auto & e = entries[it->second];
+      int old_count = e.count;
+      e.count += weight;
+      e.error += error;
+      int count = e.count;
+      if (capacity) siftDown(heap_pos[it->second]);
+      updateTop(key, old_count, count);
+      return count;
+    } else if (!capacity || entries.size() < capacity) {
+      size_t i = entries.size();
+      entries.push_back({ key, weight, error });
+      index[key] = i;
+      if (capacity) {
+	heap_pos.push_back(heap.size());
+	heap.push_back(i);
+	siftUp(heap.size() - 1);
+      }
+      updateTop(key, 0, weight);
+      return weight;
+    } else {
+      // replace the key with the smallest count
+      size_t i = heap[0];
+      auto & e = entries[i];
+      index.erase(e.key);
+      int min_count = e.count;
+      // The replaced key has the smallest count, so if it was in the top,
+      // the keys outside the top all have that count and the new key, which
+      // has a larger one, takes its place.
+      bool in_top = top_size && top.erase(std::make_pair(min_count, e.key));
+      e = { key, min_count + weight, min_count + error };
+      index[key] = i;
+      siftDown(0);
+      if (in_top && weight <= 0) rebuildTop();
+      else updateTop(key, 0, min_count + weight);
+      return min_count + weight;
+    }
+  }
+
+  // adds the counts of another counter, keys dropped from either side are
+  // accounted for by the error bounds
+  void merge(const HeavyHitters & other) {
+    for (auto & e : other.entries) add(e.key, e.count, e.error);
+  }
+
+  void clear() {
+    entries.clear();
+    index.clear();
+    heap.clear();
+    heap_pos.clear();
+    top.clear();
+  }
+
+  bool contains(const K & key) const { return index.count(key) != 0; }
+  size_t size() const { return entries.size(); }
+  bool empty() const { return entries.empty(); }
+  // the tracked keys in no particular order
+  const std::vector<entry_s> & getEntries() const { return entries; }
+
+  // the k keys with the largest counts in descending order, ties by key
+  std::vector<std::pair<K, int> > getTop(size_t k) const {
+    std::vector<std::pair<K, int> > r;
+    if (k <= top_size) {
+      for (auto it = top.begin(); it != top.end() && r.size() < k; it++) {
+	r.push_back(std::make_pair(it->second, it->first));
+      }
+      return r;
+    }
+    r.reserve(entries.size());
+    for (auto & e : entries) r.push_back(std::make_pair(e.key, e.count));
+    auto cmp = [](const std::pair<K, int> & a, const std::pair<K, int> & b) {
+      return a.second > b.second || (a.second == b.second && a.first < b.first);
+    };
+    if (r.size() > k) {
+      std::partial_sort(r.begin(), r.begin() + k, r.end(), cmp);
+      r.resize(k);
+    } else {
+      std::sort(r.begin(), r.end(), cmp);
+    }
+    return r;
+  }
+
+ private:
+  bool less(size_t a, size_t b) const { return entries[heap[a]].count < entries[heap[b]].count; }
+
+  void swapHeap(size_t a, size_t b) {
+    std::swap(heap[a], heap[b]);
+    heap_pos[heap[a]] = a;
+    heap_pos[heap[b]] = b;
+  }
+
+  void siftUp(size_t i) {
+    while (i > 0 && less(i, (i - 1) / 2)) {
+      swapHeap(i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+  }
+
+  void siftDown(size_t i) {
+    while (1) {
+      size_t l = 2 * i + 1, r = l + 1, m = i;
+      if (l < heap.size() && less(l, m)) m = l;
+      if (r < heap.size() && less(r, m)) m = r;
+      if (m == i) break;
+      swapHeap(i, m);
+      i = m;
+    }
+  }
+
+  void buildHeap() {
+    heap.resize(entries.size());
+    heap_pos.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) heap[i] = heap_pos[i] = i;
+    for (size_t i = heap.size() / 2; i-- > 0; ) siftDown(i);
+  }
+
+  // drops the key with the smallest count, moving the last entry into its slot
+  void removeMinimum() {
+    size_t i = heap[0], last = entries.size() - 1;
+    index.erase(entries[i].key);
+    swapHeap(0, heap.size() - 1);
+    heap.pop_back();
+    if (!heap.empty()) siftDown(0);
+    if (i != last) {
+      entries[i] = entries[last];
+      index[entries[i].key] = i;
+      heap_pos[i] = heap_pos[last];
+      heap[heap_pos[i]] = i;
+    }
+    entries.pop_back();
+    heap_pos.pop_back();
+  }
+
+  // descending count, ties by key
+  struct top_compare_s {
+    bool operator() (const std::pair<int, K> & a, const std::pair<int, K> & b) const {
+      return a.first > b.first || (a.first == b.first && a.second < b.second);
+    }
+  };
+
+  // Counts only grow, so a key outside the top can only enter it when its
+  // own count changes. While the top is not full it holds every key.
+  void updateTop(const K & key, int old_count, int new_count) {
+    if (!top_size) return;
+    auto it = top.find(std::make_pair(old_count, key));
+    if (it != top.end()) {
+      top.erase(it);
+      top.insert(std::make_pair(new_count, key));
+    } else if (top.size() < top_size) {
+      top.insert(std::make_pair(new_count, key));
+    } else {
+      auto p = std::make_pair(new_count, key);
+      auto last = std::prev(top.end());
+      if (top_compare_s()(p, *last)) {
+	top.erase(last);
+	top.insert(p);
+      }
+    }
+  }
+
+  void rebuildTop() {
+    top.clear();
+    if (!top_size) return;
+    for (auto & e : entries) {
+      top.insert(std::make_pair(e.count, e.key));
+      if (top.size() > top_size) top.erase(std::prev(top.end()));
+    }
+  }
+
+  size_t capacity = 0, top_size = 0;
+  std::vector<entry_s> entries;
+  std::unordered_map<K, size_t> index;
+  std::vector<size_t> heap, heap_pos; // heap of entry indices and the heap position of each entry
+  std::set<std::pair<int, K>, top_compare_s> top;
+};
+
+#endif
@@ -2,23 +2,46 @@
 #define _GRAPHLIB_INFLATE_H_
 
 #include <string>
+#include <vector>
+#include <utility>
 
 struct z_stream_s;
 
+// Inflates a zlib stream that is read directly from caller memory. The
+// stream state and scratch buffer are kept between calls, so an instance
+// can be reused for many blocks. An instance must not be shared between
+// threads: getThreadInstance() returns one per thread.
 class Inflate {
  public:
-  Inflate(const std::basic_string<unsigned char> * _input_buffer);
+  Inflate() { }
+  Inflate(const std::basic_string<unsigned char> * _input_buffer) { setInput(_input_buffer); }
   Inflate(const Inflate & other) = delete;
   Inflate & operator=(const Inflate & other) = delete;
   ~Inflate();
 
-  std::string decompressString(unsigned int data_offset, unsigned short data_length);  
+  void setInput(const unsigned char * data, size_t len) {
+    input_data = data;
+    input_size = len;
+  }
+  void setInput(const std::basic_string<unsigned char> * buffer) {
+    setInput(buffer->data(), buffer->size());
+  }
+
+  std::string decompressString(unsigned int data_offset, unsigned int data_length);
+  bool decompress(std::string & output);
+  // extracts many (offset, length) ranges with a single pass over the input
+  bool decompressRanges(const std::pair<unsigned int, unsigned int> * ranges, size_t n, std::vector<std::string> & output);
+
+  static Inflate & getThreadInstance();
   
  private:
   bool init();
+  bool run(std::string & output, size_t limit);
 
   struct z_stream_s * inf_stream = 0;
-  const std::basic_string<unsigned char> * input_buffer;
+  const unsigned char * input_data = 0;
+  size_t input_size = 0;
+  std::string scratch;
 };
 
 #endif
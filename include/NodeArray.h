@@ -2,6 +2,7 @@
 #define _NODEARRAY_H_
 
 #include <skey.h>
+#include <vkey.h>
 
 #include "ReadWriteObject.h"
 #include "NodeType.h"
@@ -73,16 +74,30 @@ class NodeArray : public ReadWriteObject {
   void setNodeSizeMethod(const SizeMethod & m) { size_method = m; }
   const SizeMethod & getNodeSizeMethod() const { return size_method; }
 
-  void setLabelMethod(const LabelMethod & m) { label_method = m; }
+  void setLabelMethod(const LabelMethod & m) {
+    label_method = m;
+    label_method_column.setName(m.getColumn());
+    face_label_method_column.setName(m.getColumn());
+  }
   const LabelMethod & getLabelMethod() const { return label_method; }
+  // the column of LABEL_FROM_COLUMN for face tables
+  const table::ColumnRef & getFaceLabelMethodColumn() const { return face_label_method_column; }
 
   std::string getNodeLabel(int node_id) const;
+  // the (source, id) key of the node as used in the node cache
+  skey getNodeKey(int node_id) const;
 
   std::unordered_map<skey, int> & getNodeCache() { return node_cache; } 
   const std::unordered_map<skey, int> & getNodeCache() const { return node_cache; } 
 
-  std::unordered_map<std::string, int> & getNodePositionCache() { return node_position_cache; }
-  const std::unordered_map<std::string, int> & getNodePositionCache() const { return node_position_cache; }
+  std::unordered_map<vkey, int> & getNodePositionCache() { return node_position_cache; }
+  const std::unordered_map<vkey, int> & getNodePositionCache() const { return node_position_cache; }
+
+  // coordinates are snapped to a grid of this size and points in the same cell share
+  // a node (0 = exact match). Close points on either side of a cell boundary stay
+  // apart, so this is not a distance threshold. Set before creating nodes.
+  void setCoordinateTolerance(double t) { coordinate_tolerance = t; }
+  double getCoordinateTolerance() const { return coordinate_tolerance; }
 
   // add() doesn't change version, since new node is invisible without edges
   int add(NodeType type = NODE_ANY) {
@@ -97,17 +112,21 @@ class NodeArray : public ReadWriteObject {
     return node_id;
   }
 
-  void remove(int node_id) {
-    if (node_id >= 0 && node_id < size()) {
-      node_geometry[node_id] = node_geometry.back();
-      node_geometry.pop_back();
-      nodes.removeRow(node_id);
-    }
-  }
+  // Marks the node removed, node ids stay unchanged until compact(). Removed
+  // nodes and their edges are skipped by the graphs. The key, position,
+  // community, language, application and gender lookups treat them as
+  // missing, so the create functions make a new node in their place.
+  void remove(int node_id);
+  bool isRemoved(int node_id) const { return nodes.isRemoved(node_id); }
+  const std::vector<bool> & getRemovedNodes() const { return nodes.getRemovedRows(); }
+  size_t getRemovedCount() const { return nodes.getRemovedCount(); }
+  // drops the removed nodes and renumbers the rest in order. Returns the new id
+  // of each old node or -1, which must be applied to the graphs using the nodes.
+  std::vector<int> compact();
 
   int getNodeId(short source_id, long long source_object_id) const {
     auto it = getNodeCache().find(skey(source_id, source_object_id));
-    if (it != getNodeCache().end()) {
+    if (it != getNodeCache().end() && !isRemoved(it->second)) {
       return it->second;
     }
     return -1;
@@ -145,6 +164,7 @@ class NodeArray : public ReadWriteObject {
   void clear() {
     node_geometry.clear();
     node_cache.clear();
+    node_position_cache.clear();
     nodes.clear();
   }
 
@@ -158,6 +178,12 @@ class NodeArray : public ReadWriteObject {
     }
     return v;
   }
+  // Adds n nodes at once and returns the id of the first. Initial positions
+  // of dynamic graphs are derived from the node ids instead of rand(), so
+  // they are reproducible and filled in parallel.
+  int createNodes(size_t n, NodeType type = NODE_ANY);
+  // sets the positions of the nodes starting from first_node
+  void setPositions(int first_node, const std::vector<glm::vec3> & v);
   
   std::vector<node_data_s> & getGeometry() { return node_geometry; }
   const std::vector<node_data_s> & getGeometry() const { return node_geometry; }
@@ -195,6 +221,11 @@ class NodeArray : public ReadWriteObject {
     arc_geometry.push_back(data);
     return arc_id;
   }
+  int addArcGeometry(ArcData2D && data) {
+    int arc_id = 1 + int(arc_geometry.size());
+    arc_geometry.push_back(std::move(data));
+    return arc_id;
+  }
   const std::vector<ArcData2D> & getArcGeometry() const { return arc_geometry; }
 
   void randomizeGeometry(bool use_2d = false);
@@ -223,7 +254,7 @@ class NodeArray : public ReadWriteObject {
 
   int getCommunityById(int id) const {
     auto it = communities.find(id);
-    if (it != communities.end()) return it->second;
+    if (it != communities.end() && !isRemoved(it->second)) return it->second;
     return -1;
   }
 
@@ -236,7 +267,7 @@ class NodeArray : public ReadWriteObject {
 
   int getLanguageById(short id) const {
     auto it = languages.find(id);
-    if (it != languages.end()) return it->second;
+    if (it != languages.end() && !isRemoved(it->second)) return it->second;
     return -1;
   }
 
@@ -250,7 +281,7 @@ class NodeArray : public ReadWriteObject {
 
   int getApplicationById(short id) const {
     auto it = applications.find(id);
-    if (it != applications.end()) return it->second;
+    if (it != applications.end() && !isRemoved(it->second)) return it->second;
     return -1;
   }
 
@@ -261,11 +292,11 @@ class NodeArray : public ReadWriteObject {
     return community_id;
   }
 
-  int getMaleNode() const { return male_node_id; }
-  int getFemaleNode() const { return female_node_id; }
+  int getMaleNode() const { return isRemoved(male_node_id) ? -1 : male_node_id; }
+  int getFemaleNode() const { return isRemoved(female_node_id) ? -1 : female_node_id; }
 
   int createMaleNode() {
-    if (male_node_id == -1) {
+    if (getMaleNode() == -1) {
       male_node_id = add(NODE_ATTRIBUTE);
       setNodeTexture(male_node_id, MALE_NODE);
     }
@@ -273,7 +304,7 @@ class NodeArray : public ReadWriteObject {
   }
 
   int createFemaleNode() {
-    if (female_node_id == -1) {
+    if (getFemaleNode() == -1) {
       female_node_id = add(NODE_ATTRIBUTE);
       setNodeTexture(female_node_id, FEMALE_NODE);
     }
@@ -293,11 +324,17 @@ class NodeArray : public ReadWriteObject {
     
  private:
   std::unordered_map<skey, int> node_cache;
-  std::unordered_map<std::string, int> node_position_cache;
+  std::unordered_map<vkey, int> node_position_cache;
+  double coordinate_tolerance = 0.0;
 
   table::Table nodes;
   SizeMethod size_method;
   LabelMethod label_method;
+  // the label method column is looked up separately in the node and face tables
+  table::ColumnRef label_method_column, face_label_method_column;
+  table::ColumnRef label_column{"label", true}, uname_column{"uname", true}, name_column{"name", true}, id_column{"id", true}, source_column{"source"};
+  // the node cache is keyed by the exact "id" column
+  table::ColumnRef key_column{"id"};
   LabelStyle label_style = LABEL_PLAIN;
   int srid = 0, version = 1;
   int male_node_id = -1, female_node_id = -1;
@@ -0,0 +1,53 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+inline unsigned int getThreadCount() {
+  unsigned int n = std::thread::hardware_concurrency();
+  return n ? n : 1;
+}
+
+// Calls f(thread_index, begin, end) for consecutive chunks of [begin, end).
+// Chunks are handed out dynamically to at most max_threads threads and
+// thread_index is below that. Small ranges run on the calling thread.
+template<class F>
+void parallelForRanges(size_t begin, size_t end, size_t grain, F f, unsigned int max_threads = 0) {
+  if (begin >= end) return;
+  if (!grain) grain = 1;
+  size_t num_chunks = (end - begin + grain - 1) / grain;
+  unsigned int num_threads = max_threads ? max_threads : getThreadCount();
+  if (num_threads > num_chunks) num_threads = (unsigned int)num_chunks;
+  if (num_threads <= 1) {
+    f(0, begin, end);
+    return;
+  }
+  std::atomic<size_t> next_chunk(0);
+  auto worker = [&](unsigned int thread_index) {
+    while ( 1 ) {
+      size_t chunk = next_chunk++;
+      if (chunk >= num_chunks) break;
+      size_t b = begin + chunk * grain;
+      f(thread_index, b, std::min(end, b + grain));
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < num_threads; i++) {
+    threads.emplace_back(worker, i);
+  }
+  worker(0);
+  for (auto & t : threads) t.join();
+}
+
+// Calls f(i) for every i in [begin, end) using parallelForRanges()
+template<class F>
+void parallelFor(size_t begin, size_t end, F f, size_t grain = 1024) {
+  parallelForRanges(begin, end, grain, [&](unsigned int thread_index, size_t b, size_t e) {
+      for (size_t i = b; i < e; i++) f(i);
+    });
+}
+
+#endif
@@ -8,6 +8,7 @@
 #include <cstring>
 
 #include <skey.h>
+#include <HeavyHitters.h>
 
 #include <UserType.h>
 #include <FilterType.h>
@@ -22,9 +23,47 @@ struct InsensitiveCompare {
   }
 };
 
+#define STATISTICS_TOP_TAGS	100
+#define STATISTICS_TOP_USERS	25
+
+// Counts text case-insensitively and remembers the most frequent spelling
+// of each folded key, so that the folded top list can be read at any time
+class FoldedCounter {
+ public:
+  FoldedCounter() { }
+
+  void setCapacity(size_t capacity) {
+    counts.setCapacity(capacity);
+    prune();
+  }
+  size_t getCapacity() const { return counts.getCapacity(); }
+  void setTopSize(size_t k) { counts.setTopSize(k); }
+
+  // text_count is the count of this exact spelling after the addition
+  void add(const std::string & text, int text_count, int weight = 1);
+  void clear() {
+    counts.clear();
+    spellings.clear();
+  }
+
+  // the k most frequent keys as (most frequent spelling, folded count) in descending order
+  std::vector<std::pair<std::string, int> > getTop(size_t k) const;
+
+ private:
+  // drops spellings of keys no longer tracked by a bounded counter
+  void prune();
+
+  HeavyHitters<std::string> counts;
+  std::unordered_map<std::string, std::pair<std::string, int> > spellings;
+};
+
 class RawStatistics {
  public:
   RawStatistics() {
+    folded_links.setTopSize(STATISTICS_TOP_TAGS);
+    folded_hashtags.setTopSize(STATISTICS_TOP_TAGS);
+    user_activity.setTopSize(STATISTICS_TOP_USERS);
+    user_popularity.setTopSize(STATISTICS_TOP_USERS);
     initialize();
   }
   
@@ -48,23 +87,54 @@ class RawStatistics {
   void setNumRawEdges(size_t n) { num_raw_edges = n; }
   void setNumPosts(size_t n) { num_posts = n; }
   void setNumActiveUsers(size_t n) { num_active_users = n; }
+
+  // Bounds the number of hashtags and links, and of users, that are counted.
+  // Only the most frequent ones are kept, and counts may exceed the true
+  // count by total / capacity. 0 (the default) counts everything exactly.
+  void setSketchCapacity(size_t tag_capacity, size_t user_capacity) {
+    links.setCapacity(tag_capacity);
+    hashtags.setCapacity(tag_capacity);
+    folded_links.setCapacity(tag_capacity);
+    folded_hashtags.setCapacity(tag_capacity);
+    user_activity.setCapacity(user_capacity);
+    user_popularity.setCapacity(user_capacity);
+    tag_version++;
+    user_version++;
+    version++;
+  }
+  size_t getTagCapacity() const { return hashtags.getCapacity(); }
+  size_t getUserCapacity() const { return user_activity.getCapacity(); }
   
   void addActivity(time_t t, short source_id, long long source_object_id, short lang, long long app_id, long long filter_id, PoliticalParty party);
   void addReceivedActivity(time_t t, short source_id, long long source_object_id, long long app_id, long long filter_id);
 
+  // Adds the counts of a partial accumulated for example by another thread.
+  // Counters are summed, time ranges combined and sizes take the larger value.
+  void merge(const RawStatistics & other);
+
   void clear() {
     links.clear();
     hashtags.clear();
+    folded_links.clear();
+    folded_hashtags.clear();
     headlines.clear();
     user_types.clear();
     political_parties.clear();
     hours.clear();
     weekdays.clear();
-    application_usage.clear();
+    user_apps.clear();
+    app_changes.clear();
     filter_usage.clear();
     language_usage.clear();
     user_activity.clear();
     user_popularity.clear();
+    cached_time_block = -1;
+    // the section versions keep increasing so that old output is rebuilt
+    tag_version++;
+    user_version++;
+    app_version++;
+    app_clear_version = app_version;
+    version++;
 
     num_raw_nodes = num_raw_edges = 0;
     num_posts = 0;
@@ -82,9 +152,14 @@ class RawStatistics {
   size_t getNumPosts() const { return num_posts; }
   size_t getNumActiveUsers() const { return num_active_users; }
 
+  // Updates data to the current state. Only the sections whose counters have
+  // changed since data was last finalized from these statistics are rebuilt.
   void finalize(const Graph & graph, StatisticsData & data) const;
 
  protected:
+  void finalizeApplications(StatisticsData & data, bool rebuild_all) const;
+  void addApplicationUsage(const skey & user, long long app_id, int count);
+
   void initialize() {
     for (unsigned int i = 0; i < 24; i++) hours.push_back(0);
     for (unsigned int i = 0; i < 7; i++) weekdays.push_back(0);
@@ -95,20 +170,37 @@ class RawStatistics {
   float start_sentiment = -1, end_sentiment = 1;
   size_t num_raw_nodes = 0, num_raw_edges = 0;
   size_t num_posts = 0, num_active_users = 0;
-  std::unordered_map<std::string, int> links;
-  std::unordered_map<std::string, int> hashtags;
+  HeavyHitters<std::string> links;
+  HeavyHitters<std::string> hashtags;
+  FoldedCounter folded_links, folded_hashtags;
   std::unordered_map<std::string, int> headlines;
   std::map<UserType, int> user_types;
   std::map<PoliticalParty, int> political_parties;
   std::vector<unsigned int> hours, weekdays;
 
-  std::map<skey, std::map<long long, int> > application_usage;
-  std::map<skey, int> user_activity, user_popularity;
+  struct user_apps_s {
+    std::vector<std::pair<long long, int> > apps; // app id and count
+    unsigned int version; // app_version of the last change
+  };
+
+  std::unordered_map<skey, user_apps_s> user_apps;
+  // (app_version, user) for each change in order, the entries older than
+  // the last change of their user are dropped now and then
+  std::vector<std::pair<unsigned int, skey> > app_changes;
+  HeavyHitters<skey> user_activity, user_popularity;
 
   std::map<FilterType, int> filter_usage;
   std::unordered_map<short, int> language_usage;
   
   unsigned int version = 1;
+  // versions of the sections that are expensive to finalize
+  unsigned int tag_version = 1, user_version = 1, app_version = 1;
+  // app_version at the last clear(), older app sections are rebuilt
+  unsigned int app_clear_version = 1;
+
+  // hour and weekday of the last 15 minute block seen in addActivity()
+  time_t cached_time_block = -1;
+  int cached_hour = 0, cached_weekday = 0;
 };
 
 #endif
@@ -0,0 +1,68 @@
+#ifndef _SHAPERECORDREADER_H_
+#define _SHAPERECORDREADER_H_
+
+#include "ArcData2D.h"
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+
+// a decoded shape: polylines are split into arcs, other types keep their
+// parts and points
+struct shape_record_s {
+  int type = 0;
+  bool valid = false;
+  std::vector<int> part_starts;
+  std::vector<glm::dvec2> points;
+  std::vector<ArcData2D> arcs;
+};
+
+// Reads the records of a .shp file using its .shx index. A reader thread
+// loads batches of raw records and each batch is decoded in parallel, while
+// readBatch() returns the batches in file order.
+class ShapeRecordReader {
+ public:
+  ShapeRecordReader(size_t _batch_size = 4096) : batch_size(_batch_size) { }
+  ~ShapeRecordReader();
+
+  bool open(const std::string & filename);
+  void close();
+
+  size_t getRecordCount() const { return index.size(); }
+  // the shape type of the file from its header
+  int getShapeType() const { return shape_type; }
+  size_t getBatchSize() const { return batch_size; }
+
+  bool readBatch(std::vector<shape_record_s> & records);
+
+ private:
+  struct raw_batch_s {
+    size_t first_record, num_records;
+    unsigned long long base_offset;
+    std::vector<unsigned char> data;
+    bool ok;
+  };
+
+  void readerLoop();
+  static void decodeRecord(const unsigned char * p, size_t len, shape_record_s & r);
+
+  size_t batch_size;
+  FILE * shp = 0;
+  int shape_type = 0;
+  // byte offset and content length of each record
+  std::vector<std::pair<unsigned long long, unsigned int> > index;
+
+  std::thread reader;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::deque<raw_batch_s> queue;
+  size_t batches_read = 0, batches_returned = 0, num_batches = 0;
+  bool stop = false;
+};
+
+#endif
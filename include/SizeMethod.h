@@ -4,7 +4,7 @@
 #include <string>
 
 class Graph;
-struct node_tertiary_data_s;
+struct node_degree_data_s;
 
 class SizeMethod {
  public:
@@ -24,12 +24,19 @@ class SizeMethod {
   bool definedForSource() const { return method == SIZE_FROM_DEGREE; }
   bool definedForTarget() const { return method == SIZE_FROM_DEGREE || method == SIZE_FROM_INDEGREE; }
   
-  float calculateSize(const node_tertiary_data_s & data, unsigned int total_indegree, unsigned int total_outdegree, size_t node_count) const;
+  // column_value is the value of the size column for SIZE_FROM_COLUMN
+  float calculateSize(const node_degree_data_s & data, unsigned int child_count, unsigned int total_indegree, unsigned int total_outdegree, size_t node_count, double column_value = 0.0) const;
+
+  void setColumnRange(double min_value, double max_value) {
+    column_min = min_value;
+    column_max = max_value;
+  }
   
  private:
   Method method;
   std::string column;
   float constant;
+  double column_min = 0.0, column_max = 0.0;
 };
 
 #endif
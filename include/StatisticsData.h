@@ -5,6 +5,9 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
+
+#include <skey.h>
 
 #include <UserType.h>
 #include <FilterType.h>
@@ -32,6 +35,9 @@ class StatisticsData {
     top_languages.clear();
     user_types.clear();
     top_political_parties.clear();
+    user_apps.clear();
+    apps.clear();
+    source = 0;
   }
 
   const std::vector<statistics_row_s> & getLinks() const { return sorted_links; }
@@ -74,7 +80,15 @@ class StatisticsData {
   std::map<PoliticalParty, int> political_parties;
 
   std::vector<unsigned int> number_of_hashtags, number_of_links;
-  
+
+  // the statistics and their section versions the data was built from
+  const void * source = 0;
+  unsigned int tag_version = 0, user_version = 0, app_version = 0;
+  // the device and platform each user is counted under, and the registry
+  // lookups, so that only changed users need to be recounted
+  std::unordered_map<skey, std::pair<AppInfo::Device, AppPlatform> > user_apps;
+  std::unordered_map<long long, std::pair<AppInfo::Device, AppPlatform> > apps;
+
  private:
   time_t start_time = 0, end_time = 0;
   float start_sentiment = -1, end_sentiment = 1;
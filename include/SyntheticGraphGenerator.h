@@ -0,0 +1,80 @@
+#ifndef _SYNTHETICGRAPHGENERATOR_H_
+#define _SYNTHETICGRAPHGENERATOR_H_
+
+#include "Graph.h"
+#include "PlanarGraph.h"
+
+#include <vector>
+#include <memory>
+#include <ctime>
+
+// shape of a generated social media post stream
+struct social_media_params_s {
+  size_t num_users = 100000;
+  size_t num_posts = 1000000;
+  // 0 = num_users / 20 hashtags and num_users / 50 links
+  size_t num_hashtags = 0, num_links = 0;
+  // a post mentions a user, has up to max_hashtags hashtags and a link with
+  // these probabilities. Posts with none of them mention a user.
+  float mention_probability = 0.6f, link_probability = 0.2f;
+  unsigned int max_hashtags = 2;
+  time_t start_time = 1500000000, duration = 30 * 86400;
+  short source_id = 1;
+};
+
+// Generates graphs shaped like real input for benchmarks and capacity
+// planning. Every edge, post and vertex draws its random numbers from a
+// hash of the seed and its own index, so the work is split over threads
+// and the output depends only on the seed and the parameters.
+class SyntheticGraphGenerator {
+ public:
+  enum Model {
+    RMAT = 1,
+    BARABASI_ALBERT
+  };
+
+  SyntheticGraphGenerator(unsigned long long _seed = 1) : seed(_seed) { }
+
+  void setSeed(unsigned long long _seed) { seed = _seed; }
+  unsigned long long getSeed() const { return seed; }
+
+  // quadrant probabilities of R-MAT, the fourth one is 1 - a - b - c
+  void setRMATProbabilities(float a, float b, float c) {
+    rmat_a = a;
+    rmat_b = b;
+    rmat_c = c;
+  }
+
+  // R-MAT edges between 2^scale nodes. Node ids are scrambled so that the
+  // high degree nodes are spread over the id range.
+  void generateRMATEdges(unsigned int scale, size_t num_edges, std::vector<int> & tails, std::vector<int> & heads) const;
+  // Barabási–Albert edges: each node after the first links to
+  // edges_per_node earlier nodes, picked uniformly or, with equal
+  // probability, by copying an endpoint of an earlier edge
+  void generateBarabasiAlbertEdges(size_t num_nodes, unsigned int edges_per_node, std::vector<int> & tails, std::vector<int> & heads) const;
+
+  // the graphs are built on new nodes added to nodes
+  std::shared_ptr<Graph> createRMAT(unsigned int scale, size_t num_edges, const std::shared_ptr<NodeArray> & nodes) const;
+  std::shared_ptr<Graph> createBarabasiAlbert(size_t num_nodes, unsigned int edges_per_node, const std::shared_ptr<NodeArray> & nodes) const;
+
+  // A temporal social media graph. Users get the node columns source, id,
+  // name, uname, type (UserType) and party, hashtags are NODE_HASHTAG and
+  // links NODE_URL nodes. Each post is a face with a timestamp, sentiment,
+  // language and application, and edges from its author to the mentioned
+  // user, hashtags and link. The author and the mentioned user are an edge
+  // of the model, so both are skewed towards popular users.
+  std::shared_ptr<Graph> createSocialMedia(Model model, const social_media_params_s & params, const std::shared_ptr<NodeArray> & nodes) const;
+
+  // A rows x cols lattice with a square face per cell, the edges of the
+  // faces paired as in loaded maps
+  std::shared_ptr<PlanarGraph> createGrid(size_t rows, size_t cols, const std::shared_ptr<NodeArray> & nodes) const;
+  // A jittered rows x cols lattice split into triangles, choosing the
+  // diagonal of each cell by the Delaunay condition
+  std::shared_ptr<PlanarGraph> createDelaunay(size_t rows, size_t cols, const std::shared_ptr<NodeArray> & nodes) const;
+
+ private:
+  unsigned long long seed;
+  float rmat_a = 0.57f, rmat_b = 0.19f, rmat_c = 0.19f;
+};
+
+#endif
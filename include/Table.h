@@ -2,16 +2,23 @@
 #define _TABLE_H_
 
 #include "Column.h"
+#include "TextCodec.h"
+#include "TableIndex.h"
+
+#include <skey.h>
 
 #include <vector>
 #include <string>
 #include <memory>
 #include <unordered_map>
+#include <functional>
+#include <atomic>
+#include <cctype>
 
 namespace table {    
   class Table {
   public:
-  Table() : num_rows(0) { }
+  Table() : num_rows(0), version(nextVersion()) { }
     
     bool hasColumn(const char * name) const {
       auto it = columns.find(name);
@@ -23,8 +30,9 @@ namespace table {
       return it != columns.end() ? it->second.get() : 0;
     }
     
-    ColumnBase & addTextColumn(const char * name);
-    ColumnBase & addCompressedTextColumn(const char * name);  
+    ColumnBase & addTextColumn(const char * name, bool intern = false);
+    ColumnBase & addCompressedTextColumn(const char * name, TextCodecType codec = CODEC_ZLIB);
+    ColumnBase & addDictionaryTextColumn(const char * name);
     ColumnBase & addDoubleColumn(const char * name);
     ColumnBase & addIntColumn(const char * name);
     ColumnBase & addUShortColumn(const char * name);  
@@ -34,13 +42,47 @@ namespace table {
     ColumnBase & addColumn(const std::string & name, const std::shared_ptr<ColumnBase> & col) {
       col->reserve(num_rows);
       columns[name] = col;
-      columns_in_order.push_back(col);
+      auto it = column_ids.find(name);
+      if (it != column_ids.end()) {
+	columns_in_order[it->second] = col;
+      } else {
+	int id = int(columns_in_order.size());
+	columns_in_order.push_back(col);
+	column_names.push_back(name);
+	column_ids[name] = id;
+	lowercase_ids.emplace(toLower(name), id);
+      }
+      version = nextVersion();
       return *col;
     }
 
+    // column ids are positions in insertion order and stay valid until a column is dropped
+    int getColumnId(const char * name) const {
+      auto it = column_ids.find(name);
+      return it != column_ids.end() ? it->second : -1;
+    }
+    int findColumnIgnoreCase(const char * name) const {
+      auto it = lowercase_ids.find(toLower(name));
+      return it != lowercase_ids.end() ? it->second : -1;
+    }
+    // changes whenever columns are added or dropped, and is unique across tables
+    unsigned long long getVersion() const { return version; }
+
     void dropColumn(const char * name) {
       auto it = columns.find(name);
-      if (it != columns.end()) columns.erase(it);
+      if (it != columns.end()) {
+	columns.erase(it);
+	int id = column_ids[name];
+	columns_in_order.erase(columns_in_order.begin() + id);
+	column_names.erase(column_names.begin() + id);
+	column_ids.clear();
+	lowercase_ids.clear();
+	for (int i = 0; i < int(column_names.size()); i++) {
+	  column_ids[column_names[i]] = i;
+	  lowercase_ids.emplace(toLower(column_names[i]), i);
+	}
+	version = nextVersion();
+      }
     }
     void dropColumn(const std::string & name) { dropColumn(name.c_str()); }
 
@@ -49,6 +91,8 @@ namespace table {
 	col.second->clear();
       }
       num_rows = 0;
+      removed_rows.clear();
+      num_removed_rows = 0;
     }
     
     ColumnBase & operator[] (int i) {
@@ -63,10 +107,7 @@ namespace table {
     }
 
     const char * getColumnName(int i) const {
-      for (auto it = columns.begin(); it != columns.end(); it++, i--) {
-	if (!i) return it->first.c_str();
-      }
-      return "";
+      return i >= 0 && i < column_names.size() ? column_names[i].c_str() : "";
     }
     
     const ColumnBase & operator[] (int i) const {
@@ -107,7 +148,9 @@ namespace table {
     }
     
     void addRow() { num_rows++; }
+    void addRows(size_t n) { num_rows += n; }
 
+    // removes a row immediately by moving the last row in its place
     void removeRow(int node_id) {
       for (auto & c : columns_in_order) {
 	c->remove(node_id);
@@ -115,20 +158,130 @@ namespace table {
       num_rows--;
     }
 
-    void loadCSV(const char * filename, char delimiter = ';');
+    // marks a row removed, the row keeps its values and id until compact()
+    void markRemoved(int row) {
+      if (row < 0 || row >= int(num_rows)) return;
+      if (removed_rows.size() < num_rows) removed_rows.resize(num_rows, false);
+      if (!removed_rows[row]) {
+	removed_rows[row] = true;
+	num_removed_rows++;
+      }
+    }
+    bool isRemoved(int row) const { return row >= 0 && row < int(removed_rows.size()) && removed_rows[row]; }
+    // removal flags by row, rows beyond the end are not removed
+    const std::vector<bool> & getRemovedRows() const { return removed_rows; }
+    size_t getRemovedCount() const { return num_removed_rows; }
+    // drops the removed rows from all columns keeping the order of the rest, and
+    // returns the new id of each old row or -1 for removed rows. Text columns
+    // whose arena is mostly garbage are compacted too.
+    std::vector<int> compact();
+
+    // loads a delimited file without header: line n is stored to row n and field i to column first_column + i
+    size_t loadCSV(const char * filename, char delimiter = ';', unsigned int first_column = 0);
+    // joins a delimited file with a header into existing rows by matching key_column against the column of the same name
+    size_t loadCSV(const char * filename, const char * key_column, char delimiter = ';');
+    // joins a delimited file with a header into existing rows by looking up numeric key_column values from a skey cache
+    size_t loadCSV(const char * filename, const char * key_column, short source_id, const std::unordered_map<skey, int> & key_cache, char delimiter = ';');
     
     size_t size() const { return num_rows; }
     bool empty() const { return num_rows == 0; }
-    size_t getColumnCount() const { return columns.size(); }
+    // summary statistics of a column that maintains them on update
+    bool getColumnStatistics(const char * name, column_statistics_s & stats) const {
+      auto col = getColumnSafe(name);
+      return col && col->getStatistics(stats);
+    }
+
+    size_t getColumnCount() const { return columns_in_order.size(); }
+
+    // builds an index on a column, which then keeps it up to date until the column is replaced
+    const ColumnIndex * createIndex(const char * name, IndexType type = INDEX_HASH);
+    void dropIndex(const char * name) {
+      auto it = columns.find(name);
+      if (it != columns.end()) it->second->setIndex(std::shared_ptr<ColumnIndex>());
+    }
+    // returns the rows where the column has the value key in ascending order, an unindexed column is scanned
+    std::vector<int> findRows(const char * name, const std::string & key) const;
+    // returns the first row where the column has the value key or -1
+    int findRow(const char * name, const std::string & key) const {
+      auto rows = findRows(name, key);
+      return rows.empty() ? -1 : rows.front();
+    }
 
     std::unordered_map<std::string, std::shared_ptr<ColumnBase> > & getColumns() { return columns; }
     const std::unordered_map<std::string, std::shared_ptr<ColumnBase> > & getColumns() const { return columns; }
 
   private:
+    size_t joinCSV(const char * filename, const char * key_column, char delimiter, const std::function<int(const char *, size_t)> & lookup_row);
+
+    static std::string toLower(const std::string & s) {
+      std::string r = s;
+      for (auto & c : r) c = (char)tolower((unsigned char)c);
+      return r;
+    }
+    static unsigned long long nextVersion() {
+      static std::atomic<unsigned long long> counter(0);
+      return ++counter;
+    }
+
     std::unordered_map<std::string, std::shared_ptr<ColumnBase> > columns;
     std::vector<std::shared_ptr<ColumnBase> > columns_in_order;
+    std::vector<std::string> column_names;
+    std::unordered_map<std::string, int> column_ids, lowercase_ids;
     NullColumn null_column;
     size_t num_rows;
+    unsigned long long version;
+    std::vector<bool> removed_rows;
+    size_t num_removed_rows = 0;
+  };
+
+  // A column name that is resolved once per table version, so that per-row
+  // code does not look up names. Missing columns resolve to a null column.
+  // The id is cached together with the table version in a single atomic
+  // word. Versions are unique across tables, so concurrent readers either
+  // find a matching entry or resolve the name again. setName() is a write.
+  class ColumnRef {
+  public:
+  ColumnRef(const std::string & _name = "", bool _ignore_case = false)
+    : name(_name), ignore_case(_ignore_case), resolved(0) { }
+  ColumnRef(const ColumnRef & other)
+    : name(other.name), ignore_case(other.ignore_case), resolved(0) { }
+
+    ColumnRef & operator= (const ColumnRef & other) {
+      name = other.name;
+      ignore_case = other.ignore_case;
+      resolved.store(0, std::memory_order_relaxed);
+      return *this;
+    }
+
+    const std::string & getName() const { return name; }
+    void setName(const std::string & _name) {
+      if (_name != name) {
+	name = _name;
+	resolved.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    int getId(const Table & _table) const {
+      unsigned long long version = _table.getVersion() & VERSION_MASK;
+      unsigned long long r = resolved.load(std::memory_order_relaxed);
+      if ((r >> ID_BITS) == version) return int(r & ID_MASK) - 1;
+      int id = ignore_case ? _table.findColumnIgnoreCase(name.c_str()) : _table.getColumnId(name.c_str());
+      assert(id + 1 <= int(ID_MASK));
+      resolved.store((version << ID_BITS) | (unsigned long long)(id + 1), std::memory_order_relaxed);
+      return id;
+    }
+    const ColumnBase & get(const Table & _table) const { return _table[getId(_table)]; }
+    ColumnBase & get(Table & _table) const { return _table[getId(_table)]; }
+
+  private:
+    static constexpr unsigned int ID_BITS = 24;
+    static constexpr unsigned long long ID_MASK = (1ULL << ID_BITS) - 1;
+    static constexpr unsigned long long VERSION_MASK = (1ULL << (64 - ID_BITS)) - 1;
+
+    std::string name;
+    bool ignore_case;
+    // table version << ID_BITS | (column id + 1), 0 when unresolved
+    mutable std::atomic<unsigned long long> resolved;
   };
 };
 
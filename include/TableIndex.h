@@ -0,0 +1,140 @@
+#ifndef _TABLE_TABLEINDEX_H_
+#define _TABLE_TABLEINDEX_H_
+
+#include "Column.h"
+
+#include <unordered_map>
+#include <map>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cerrno>
+
+// Secondary indexes on table columns. An index maps column values to rows
+// and is updated by the column on every modification. Text columns are
+// indexed by their text, integer columns by 64-bit values and floating
+// point columns by doubles. NaNs are not indexed.
+
+namespace table {
+  enum IndexType {
+    INDEX_HASH = 1,
+    INDEX_SORTED
+  };
+
+  // Reads keys from columns and parses them from text. A text key that does
+  // not parse completely matches nothing, as it cannot equal any value.
+  template<class K> struct ColumnKey { };
+
+  template<> struct ColumnKey<std::string> {
+    static std::string read(const ColumnBase & col, int row) { return col.getText(row); }
+    static bool parse(const std::string & s, std::string & key) {
+      key = s;
+      return true;
+    }
+    static bool isNull(const std::string & key) { return false; }
+  };
+
+  template<> struct ColumnKey<long long> {
+    static long long read(const ColumnBase & col, int row) { return col.getInt64(row); }
+    static bool parse(const std::string & s, long long & key) {
+      if (s.empty()) return false;
+      char * end = 0;
+      errno = 0;
+      key = strtoll(s.c_str(), &end, 10);
+      return *end == 0 && errno == 0;
+    }
+    static bool isNull(const long long & key) { return false; }
+  };
+
+  template<> struct ColumnKey<double> {
+    static double read(const ColumnBase & col, int row) { return col.getDouble(row); }
+    static bool parse(const std::string & s, double & key) {
+      if (s.empty()) return false;
+      char * end = 0;
+      key = strtod(s.c_str(), &end);
+      return *end == 0;
+    }
+    static bool isNull(const double & key) { return key != key; }
+  };
+
+  // An index that only stores the key of each row in the map. The key of a
+  // row is read back from the column when the row is erased.
+  template<class K, class Map>
+  class MapColumnIndex : public ColumnIndex {
+  public:
+    void insert(const ColumnBase & col, int row) override {
+      K key = ColumnKey<K>::read(col, row);
+      if (!ColumnKey<K>::isNull(key)) map.emplace(key, row);
+    }
+
+    void erase(const ColumnBase & col, int row) override {
+      K key = ColumnKey<K>::read(col, row);
+      if (ColumnKey<K>::isNull(key)) return;
+      auto range = map.equal_range(key);
+      for (auto it = range.first; it != range.second; it++) {
+	if (it->second == row) {
+	  map.erase(it);
+	  break;
+	}
+      }
+    }
+
+    void clear() override {
+      map.clear();
+    }
+
+    void findRows(const std::string & key, std::vector<int> & rows) const override {
+      K k;
+      if (ColumnKey<K>::parse(key, k)) find(k, rows);
+    }
+
+    // appends the rows that have the key in no particular order
+    void find(const K & key, std::vector<int> & rows) const {
+      auto range = map.equal_range(key);
+      for (auto it = range.first; it != range.second; it++) rows.push_back(it->second);
+    }
+    // returns the lowest row that has the key or -1
+    int findFirst(const K & key) const {
+      int row = -1;
+      auto range = map.equal_range(key);
+      for (auto it = range.first; it != range.second; it++) {
+	if (row == -1 || it->second < row) row = it->second;
+      }
+      return row;
+    }
+    size_t count(const K & key) const { return map.count(key); }
+
+  protected:
+    Map map;
+  };
+
+  template<class K>
+  class HashColumnIndex : public MapColumnIndex<K, std::unordered_multimap<K, int> > { };
+
+  template<class K>
+  class SortedColumnIndex : public MapColumnIndex<K, std::multimap<K, int> > {
+  public:
+    // appends the rows with min_key <= key <= max_key in key order
+    void findRange(const K & min_key, const K & max_key, std::vector<int> & rows) const {
+      auto end = this->map.upper_bound(max_key);
+      for (auto it = this->map.lower_bound(min_key); it != end; it++) rows.push_back(it->second);
+    }
+  };
+
+  // returns the index of the column if it has one of the given kind and key type, or null
+  template<class K>
+  const HashColumnIndex<K> * getHashIndex(const ColumnBase & col) {
+    return dynamic_cast<const HashColumnIndex<K> *>(col.getIndex());
+  }
+  template<class K>
+  const SortedColumnIndex<K> * getSortedIndex(const ColumnBase & col) {
+    return dynamic_cast<const SortedColumnIndex<K> *>(col.getIndex());
+  }
+
+  // creates an index with the key type that suits the column
+  std::shared_ptr<ColumnIndex> createColumnIndex(const ColumnBase & col, IndexType type);
+  // appends the rows of an unindexed column that match key in the same way as an index would
+  void scanColumn(const ColumnBase & col, const std::string & key, std::vector<int> & rows);
+};
+
+#endif
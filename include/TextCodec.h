@@ -0,0 +1,58 @@
+#ifndef _TEXTCODEC_H_
+#define _TEXTCODEC_H_
+
+#include <Deflate.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+
+enum TextCodecType {
+  CODEC_ZLIB = 1,
+  CODEC_LZ
+};
+
+// block codec for compressed columns. Each call to compress() produces an
+// independent block that decompress() appends to the output.
+class TextCodec {
+ public:
+  virtual ~TextCodec() = default;
+
+  virtual const char * getName() const = 0;
+  virtual void compress(const char * input, size_t input_len, std::basic_string<unsigned char> & output) = 0;
+  virtual bool decompress(const std::basic_string<unsigned char> & input, std::string & output) = 0;
+  // extracts n (offset, length) ranges of the decompressed block into output
+  virtual bool decompressRanges(const std::basic_string<unsigned char> & input, const std::pair<unsigned int, unsigned int> * ranges, size_t n, std::vector<std::string> & output);
+};
+
+class ZlibCodec : public TextCodec {
+ public:
+  ZlibCodec(int compression_level = 6) : deflate(compression_level) { }
+
+  const char * getName() const override { return "zlib"; }
+  void compress(const char * input, size_t input_len, std::basic_string<unsigned char> & output) override;
+  bool decompress(const std::basic_string<unsigned char> & input, std::string & output) override;
+  bool decompressRanges(const std::basic_string<unsigned char> & input, const std::pair<unsigned int, unsigned int> * ranges, size_t n, std::vector<std::string> & output) override;
+
+ private:
+  Deflate deflate;
+};
+
+// byte oriented LZ77 codec in the style of LZ4: much faster to decompress
+// than zlib at the cost of a lower compression ratio
+class LZCodec : public TextCodec {
+ public:
+  LZCodec() { }
+
+  const char * getName() const override { return "lz"; }
+  void compress(const char * input, size_t input_len, std::basic_string<unsigned char> & output) override;
+  bool decompress(const std::basic_string<unsigned char> & input, std::string & output) override;
+
+ private:
+  std::vector<int> hash_table;
+};
+
+std::unique_ptr<TextCodec> createTextCodec(TextCodecType type);
+
+#endif
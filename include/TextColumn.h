@@ -4,50 +4,71 @@
 #include "Column.h"
 
 #include <cstring>
+#include <unordered_map>
+
+// bytes per arena chunk, longer values get a chunk of their own
+#define TEXT_CHUNK_SIZE		65536
 
 namespace table {
+  // Text column that stores the values NUL-separated in fixed-size arena
+  // chunks instead of separate allocations. Chunks are never reallocated, so
+  // appending does not move the stored values. With interning enabled equal
+  // values are stored once. Replaced values leave garbage that is only
+  // reclaimed by compact(). Table::compact() calls it when more than half
+  // of the arena is garbage.
   class TextColumn : public ColumnBase {
   public:
-  TextColumn() { }
-  TextColumn(const TextColumn & other) : ColumnBase(other) {
-      auto & other_data = other.data;
-      for (int i = 0; i < other_data.size(); i++) {
-	pushValue(other_data[i]);
-      }      
-    }
-    ~TextColumn() {
-      for (int i = 0; i < data.size(); i++) {
-	delete[] data[i];
-      }
-    }
-    
+  TextColumn(bool _intern = false) : intern(_intern) { }
+
     size_t size() const override { return data.size(); }
     void reserve(size_t n) override { data.reserve(n); }
-    
+    void reserveBytes(size_t n) { chunks.reserve(chunks.size() + n / TEXT_CHUNK_SIZE + 1); }
+
     double getDouble(int i) const override { return 0; }
     int getInt(int i) const override { return 0; }
-    long long getInt64(int i) const override { return data[i] ? stoll(std::string(data[i])) : 0; }
+    long long getInt64(int i) const override { return i >= 0 && i < data.size() ? strtoll(getCString(i), 0, 10) : 0; }
     std::string getText(int i) const override {
       if (i >= 0 && i < data.size()) {
-	return data[i] ? data[i] : "";
+	return std::string(getCString(i), data[i].length);
       } else {
 	return "";
       }
     }
-    
+    // returns a NUL-terminated value that stays valid until the column is modified
+    const char * getCString(int i) const {
+      return i >= 0 && i < data.size() && data[i].length ? chunks[data[i].chunk].data() + data[i].offset : "";
+    }
+    size_t getLength(int i) const { return i >= 0 && i < data.size() ? data[i].length : 0; }
+    TextView getTextView(int i, std::string & buffer) const override {
+      return TextView(getCString(i), getLength(i));
+    }
+
     void setValue(int i, double v) override { setValue(i, std::to_string(v)); }
     void setValue(int i, int v) override { setValue(i, std::to_string(v)); }
     void setValue(int i, long long v) override { setValue(i, std::to_string(v)); }
     void setValue(int i, const std::string & v) override { setValue(i, v.c_str(), v.size()); }
     void setValue(int i, const char * v, const size_t len) {
-      while (i >= data.size()) data.push_back(0);
-      delete[] data[i];
-      if (v) {
-	data[i] = new char[len + 1];
-	memcpy(data[i], v, len + 1);
+      while (i >= data.size()) {
+	data.push_back({ 0, 0, 0 });
+	indexRow(int(data.size()) - 1);
+      }
+      unindexRow(i);
+      auto & ref = data[i];
+      if (!v || !len) {
+	garbage_size += ref.length;
+	ref = { 0, 0, 0 };
+      } else if (!intern && len <= ref.length) {
+	// overwrite in place
+	char * p = &chunks[ref.chunk][ref.offset];
+	memcpy(p, v, len);
+	p[len] = 0;
+	garbage_size += ref.length - len;
+	ref.length = (unsigned int)len;
       } else {
-	data[i] = 0;
+	garbage_size += ref.length;
+	ref = store(v, len);
       }
+      indexRow(i);
     }
 
     void pushValue(double v) override { pushValue(std::to_string(v)); }
@@ -55,32 +76,107 @@ namespace table {
     void pushValue(long long v) override { pushValue(std::to_string(v)); }
     void pushValue(const std::string & v) override { pushValue(v.c_str(), v.size()); }
     void pushValue(const char * v, const size_t len) {
-      if (v) {
-	data.push_back(new char[len + 1]);
-	memcpy(data.back(), v, len + 1);
+      if (v && len) {
+	data.push_back(store(v, len));
       } else {
-	data.push_back(0);
+	data.push_back({ 0, 0, 0 });
       }
+      indexRow(int(data.size()) - 1);
+    }
+    // appends n values with a single reservation
+    void pushValues(const std::string * values, size_t n) {
+      size_t total = 0;
+      for (size_t i = 0; i < n; i++) total += values[i].size() + 1;
+      data.reserve(data.size() + n);
+      reserveBytes(total);
+      for (size_t i = 0; i < n; i++) pushValue(values[i].c_str(), values[i].size());
     }
-        
-    bool compare(int a, int b) const override { return strcmp(data[a] ? data[a] : "", data[b] ? data[b] : "") < 0; }
+
+    bool compare(int a, int b) const override { return strcmp(getCString(a), getCString(b)) < 0; }
     void clear() override {
-      for (int i = 0; i < data.size(); i++) {
-	delete[] data[i];
-      }
       data.clear();
+      chunks.clear();
+      interned.clear();
+      arena_size = garbage_size = 0;
+      clearIndex();
     }
 
     void remove(int row) override {
       if (row >= 0 && row < data.size()) {
-	delete[] data[row];
+	unindexRemovedRow(row);
+	garbage_size += data[row].length;
 	data[row] = data.back();
 	data.pop_back();
+	if (row < data.size()) indexRow(row);
       }
     }
 
+    void retainRows(const std::vector<int> & rows) override {
+      size_t old_size = data.size();
+      retainValues(data, rows);
+      if (data.size() < old_size) compact();
+      rebuildIndex();
+    }
+
+    // rewrites the arena in row order without unreferenced bytes
+    void compact() {
+      std::vector<std::vector<char> > old_chunks;
+      old_chunks.swap(chunks);
+      interned.clear();
+      arena_size = garbage_size = 0;
+      for (auto & ref : data) {
+	if (ref.length) ref = store(old_chunks[ref.chunk].data() + ref.offset, ref.length);
+      }
+    }
+
+    size_t getArenaSize() const { return arena_size; }
+    // replaced bytes, an upper bound when values are interned
+    size_t getGarbageSize() const { return garbage_size; }
+
   private:
-    std::vector<char *> data;
+    struct text_ref_s {
+      unsigned int chunk, offset, length;
+    };
+
+    static size_t hashValue(const char * v, size_t len) {
+      size_t h = 14695981039346656037ULL;
+      for (size_t i = 0; i < len; i++) {
+	h = (h ^ (unsigned char)v[i]) * 1099511628211ULL;
+      }
+      return h;
+    }
+
+    text_ref_s store(const char * v, size_t len) {
+      size_t h = 0;
+      if (intern) {
+	h = hashValue(v, len);
+	auto range = interned.equal_range(h);
+	for (auto it = range.first; it != range.second; it++) {
+	  if (it->second.length == len && memcmp(chunks[it->second.chunk].data() + it->second.offset, v, len) == 0) {
+	    return it->second;
+	  }
+	}
+      }
+      // the chunks are filled up to their reserved capacity only
+      if (chunks.empty() || chunks.back().capacity() - chunks.back().size() < len + 1) {
+	chunks.emplace_back();
+	chunks.back().reserve(std::max(len + 1, size_t(TEXT_CHUNK_SIZE)));
+      }
+      auto & chunk = chunks.back();
+      text_ref_s ref = { (unsigned int)(chunks.size() - 1), (unsigned int)chunk.size(), (unsigned int)len };
+      chunk.resize(ref.offset + len + 1);
+      memcpy(&chunk[ref.offset], v, len);
+      chunk[ref.offset + len] = 0;
+      arena_size += len + 1;
+      if (intern) interned.emplace(h, ref);
+      return ref;
+    }
+
+    bool intern;
+    std::vector<text_ref_s> data;
+    std::vector<std::vector<char> > chunks;
+    std::unordered_multimap<size_t, text_ref_s> interned;
+    size_t arena_size = 0, garbage_size = 0;
   };
 };
 
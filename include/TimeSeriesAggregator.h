@@ -0,0 +1,74 @@
+#ifndef _TABLE_TIMESERIESAGGREGATOR_H_
+#define _TABLE_TIMESERIESAGGREGATOR_H_
+
+#include "TimeSeriesColumn.h"
+
+#include <vector>
+#include <utility>
+#include <ctime>
+
+namespace table {
+  // Windowed aggregates over a TimeSeriesColumn. build() flattens every
+  // series into sorted timestamps with prefix sums, after which a sum or a
+  // count over [start_time, end_time) takes two binary searches per row.
+  // update() extends the sums of the rows that only had samples appended,
+  // and rebuilds after any other change to the column.
+  class TimeSeriesAggregator {
+  public:
+    TimeSeriesAggregator() { }
+
+    void build(const TimeSeriesColumn & col);
+    void update(const TimeSeriesColumn & col);
+    // true if built from the current state of col
+    bool isValid(const TimeSeriesColumn & col) const { return column == &col && version == col.getVersion(); }
+
+    size_t size() const { return rows.size(); }
+
+    double getSum(int row, time_t start_time, time_t end_time) const {
+      auto r = getRange(row, start_time, end_time);
+      return r.first < r.second ? getPrefixSum(row, r.second) - getPrefixSum(row, r.first) : 0.0;
+    }
+    size_t getCount(int row, time_t start_time, time_t end_time) const {
+      auto r = getRange(row, start_time, end_time);
+      return r.first < r.second ? r.second - r.first : 0;
+    }
+    // sum per second over the window
+    double getRate(int row, time_t start_time, time_t end_time) const {
+      return end_time > start_time ? getSum(row, start_time, end_time) / double(end_time - start_time) : 0.0;
+    }
+    // sums per bucket of bucket_width seconds starting at start_time
+    std::vector<double> getHistogram(int row, time_t start_time, time_t end_time, time_t bucket_width) const;
+
+    // window sums of all rows, computed in parallel
+    std::vector<double> getSums(time_t start_time, time_t end_time) const;
+    // the k rows with the largest window sums as (row, sum) in descending order,
+    // rows with a zero sum are left out
+    std::vector<std::pair<int, double> > getTopK(time_t start_time, time_t end_time, size_t k) const;
+    // bucket sums over all rows
+    std::vector<double> getTotalHistogram(time_t start_time, time_t end_time, time_t bucket_width) const;
+
+  private:
+    // the samples of a row are at [offset, offset + count) in times and
+    // prefix, with room for capacity samples before the row is moved to the end
+    struct row_s {
+      size_t offset, count, capacity;
+    };
+
+    // positions of the window within the samples of the row
+    std::pair<size_t, size_t> getRange(int row, time_t start_time, time_t end_time) const;
+    // the sum of the first j samples of the row
+    double getPrefixSum(int row, size_t j) const { return j ? prefix[rows[row].offset + j - 1] : 0.0; }
+    bool append(const TimeSeriesColumn & col, int row, size_t count);
+
+    const TimeSeriesColumn * column = 0;
+    unsigned int version = 0, rewrite_version = 0;
+    std::vector<row_s> rows;
+    std::vector<time_t> times;
+    // prefix[offset + j] is the sum of the first j + 1 samples of the row
+    std::vector<double> prefix;
+    // capacity left behind by moved rows
+    size_t garbage = 0;
+  };
+};
+
+#endif
@@ -6,59 +6,226 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <ctime>
+#include <cstdint>
+
+// samples per sealed segment
+#define TIME_SERIES_SEGMENT_SIZE	128
 
 namespace table {
+  // reads the samples of a sealed segment: timestamps are stored as zigzag
+  // varint delta-of-deltas and values as the XOR with the previous value
+  // with leading and trailing zero bytes dropped
+  class TimeSeriesDecoder {
+  public:
+  TimeSeriesDecoder(const unsigned char * _ptr, unsigned int _count)
+    : ptr(_ptr), remaining(_count) { }
+
+    bool next(time_t & t, double & v) {
+      if (!remaining) return false;
+      long long d = readSigned();
+      if (first) {
+	time = d;
+	first = false;
+      } else {
+	delta += d;
+	time += delta;
+      }
+      unsigned char header = *ptr++;
+      if (header) {
+	int lead = (header >> 3) & 7, trail = header & 7;
+	uint64_t x = 0;
+	for (int i = 8 - lead - 1; i >= trail; i--) x |= uint64_t(*ptr++) << (i * 8);
+	bits ^= x;
+      }
+      memcpy(&v, &bits, sizeof(v));
+      t = (time_t)time;
+      remaining--;
+      return true;
+    }
+
+  private:
+    long long readSigned() {
+      uint64_t u = 0;
+      int shift = 0;
+      while (*ptr & 0x80) {
+	u |= uint64_t(*ptr++ & 0x7f) << shift;
+	shift += 7;
+      }
+      u |= uint64_t(*ptr++) << shift;
+      return (long long)(u >> 1) ^ -(long long)(u & 1);
+    }
+
+    const unsigned char * ptr;
+    unsigned int remaining;
+    bool first = true;
+    long long time = 0, delta = 0;
+    uint64_t bits = 0;
+  };
+
+  struct time_bucket_s {
+    double sum;
+    unsigned int count;
+
+    double getAverage() const { return count ? sum / count : 0.0; }
+  };
+
+  // Time series per row. Samples are kept in a sorted append buffer per row
+  // until it is full, and then sealed into a compressed segment in an arena
+  // shared by all rows. Reads decode the segments on the fly.
   class TimeSeriesColumn : public ColumnBase {
   public:
     TimeSeriesColumn() { }
-    
+
     // ColumnType getType() const override { return TIME_SERIES; }
 
     size_t size() const override { return data.size(); }
     void reserve(size_t n) override { data.reserve(n); }
 
-    double getDouble(int i) const override { return (double)data[i].size(); }
-    int getInt(int i) const override { return (int)data[i].size(); }
-    long long getInt64(int i) const override { return (long long)data[i].size(); }
-    std::string getText(int i) const override { return std::to_string(data[i].size()); }
+    // scalar access returns the number of samples
+    double getDouble(int i) const override { return (double)getSampleCount(i); }
+    int getInt(int i) const override { return (int)getSampleCount(i); }
+    long long getInt64(int i) const override { return (long long)getSampleCount(i); }
+    std::string getText(int i) const override { return std::to_string(getSampleCount(i)); }
 
     void setValue(int i, double v) override { }
     void setValue(int i, int v) override { }
     void setValue(int i, long long v) override { }
     void setValue(int i, const std::string & v) override { }
-    void addValue(int i, time_t t, double val) {
-      while (i >= data.size()) data.push_back(std::map<time_t, double>());
-      data[i][t] = val;
-    }
 
-    void setValues(int i, const std::map<time_t, double> & values) { data[i] = values; }
-    const std::map<time_t, double> & getValues(int i) const { return data[i]; }
+    // sets the value at time t, replacing an existing sample at the same time
+    void addValue(int i, time_t t, double val);
 
-    bool compare(int a, int b) const override { return false; }
-    void clear() override { data.clear(); }
+    void setValues(int i, const std::map<time_t, double> & values);
+    // materialises the series of a row, forEach() avoids the copy
+    std::map<time_t, double> getValues(int i) const {
+      std::map<time_t, double> r;
+      forEach(i, [&](time_t t, double v) { r[t] = v; });
+      return r;
+    }
 
-    void pushValue(double v) override {
-      data.push_back(std::map<time_t, double>());
+    size_t getSampleCount(int i) const {
+      if (i < 0 || i >= data.size()) return 0;
+      auto & s = data[i];
+      size_t n = s.tail_times.size();
+      for (auto & seg : s.segments) n += seg.count;
+      return n;
     }
-    void pushValue(int v) override {
-      data.push_back(std::map<time_t, double>());
+
+    // calls f(t, v) for the samples with start <= t < end in time order
+    template<class F>
+    void forEach(int i, time_t start, time_t end, F f) const {
+      if (i < 0 || i >= data.size()) return;
+      auto & s = data[i];
+      for (auto & seg : s.segments) {
+	if (seg.max_time < start) continue;
+	if (seg.min_time >= end) return;
+	TimeSeriesDecoder dec(arena.data() + seg.offset, seg.count);
+	time_t t;
+	double v;
+	while (dec.next(t, v)) {
+	  if (t >= end) return;
+	  if (t >= start) f(t, v);
+	}
+      }
+      auto it = std::lower_bound(s.tail_times.begin(), s.tail_times.end(), start);
+      for (; it != s.tail_times.end() && *it < end; it++) {
+	f(*it, s.tail_values[it - s.tail_times.begin()]);
+      }
     }
-    void pushValue(long long v) override {
-      data.push_back(std::map<time_t, double>());
+    template<class F>
+    void forEach(int i, F f) const {
+      forEach(i, std::numeric_limits<time_t>::min(), std::numeric_limits<time_t>::max(), f);
     }
-    void pushValue(const std::string & v) override {
-      data.push_back(std::map<time_t, double>());
+
+    // appends the samples with start <= t < end
+    void getRange(int i, time_t start, time_t end, std::vector<time_t> & times, std::vector<double> & values) const {
+      forEach(i, start, end, [&](time_t t, double v) {
+	  times.push_back(t);
+	  values.push_back(v);
+	});
+    }
+
+    // sums and counts the samples in buckets of bucket_width seconds starting at start
+    std::vector<time_bucket_s> downsample(int i, time_t start, time_t end, time_t bucket_width) const {
+      std::vector<time_bucket_s> buckets;
+      if (bucket_width <= 0 || end <= start) return buckets;
+      buckets.resize((end - start + bucket_width - 1) / bucket_width, { 0.0, 0 });
+      forEach(i, start, end, [&](time_t t, double v) {
+	  auto & b = buckets[(t - start) / bucket_width];
+	  b.sum += v;
+	  b.count++;
+	});
+      return buckets;
+    }
+
+    bool compare(int a, int b) const override { return getSampleCount(a) < getSampleCount(b); }
+    void clear() override {
+      data.clear();
+      arena.clear();
+      garbage_size = 0;
+      version++;
+      rewrite_version++;
     }
 
+    void pushValue(double v) override { pushSeries(); }
+    void pushValue(int v) override { pushSeries(); }
+    void pushValue(long long v) override { pushSeries(); }
+    void pushValue(const std::string & v) override { pushSeries(); }
+
     void remove(int row) override {
       if (row >= 0 && row < data.size()) {
-	data[row] = data.back();
+	for (auto & seg : data[row].segments) garbage_size += seg.size;
+	data[row] = std::move(data.back());
 	data.pop_back();
+	version++;
+	rewrite_version++;
       }
     }
+    void retainRows(const std::vector<int> & rows) override {
+      retainValues(data, rows);
+      compact();
+      version++;
+      rewrite_version++;
+    }
+
+    // changes whenever samples or rows change
+    unsigned int getVersion() const { return version; }
+    // changes when samples or rows are replaced or removed, but not when rows
+    // are added or samples are added after the last one of their row
+    unsigned int getRewriteVersion() const { return rewrite_version; }
+
+    // rewrites the arena without the segments of removed or rewritten series
+    void compact();
+
+    size_t getArenaSize() const { return arena.size(); }
+    // approximate memory used by the column
+    size_t getMemoryUsage() const;
 
   private:
-    std::vector<std::map<time_t, double> > data;
+    struct segment_s {
+      size_t offset;
+      unsigned int size, count;
+      time_t min_time, max_time;
+    };
+
+    struct series_s {
+      std::vector<segment_s> segments;
+      std::vector<time_t> tail_times;
+      std::vector<double> tail_values;
+    };
+
+    void pushSeries() {
+      data.push_back(series_s());
+      version++;
+    }
+    void seal(series_s & s);
+    void unseal(series_s & s, time_t t);
+
+    std::vector<series_s> data;
+    std::vector<unsigned char> arena;
+    size_t garbage_size = 0;
+    unsigned int version = 1, rewrite_version = 1;
   };
 };
 
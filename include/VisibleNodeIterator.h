@@ -8,17 +8,19 @@ class ConstVisibleNodeIterator {
  public:
   ConstVisibleNodeIterator(const edge_data_s * _edge_ptr,
 			   const edge_data_s * _edge_end,
-			   const node_tertiary_data_s * _node_ptr,
-			   const node_tertiary_data_s * _node_end,
+			   const node_hierarchy_data_s * _node_ptr,
+			   const node_hierarchy_data_s * _node_end,
 			   size_t _num_nodes,
-			   int _active_node_id)
+			   int _active_node_id,
+			   const std::vector<bool> * _removed_nodes = 0)
     : stage(_edge_ptr < _edge_end ? EDGE_TAIL : END),
     edge_ptr(_edge_ptr),
     edge_end(_edge_end),
     node_ptr(_node_ptr),
     node_end(_node_end),
     num_nodes(_num_nodes),
-    active_node_id(_active_node_id)
+    active_node_id(_active_node_id),
+    removed_nodes(_removed_nodes)
   {
     open_nodes.insert(-1);
     for (int p = active_node_id; p != -1; p = node_ptr[p].parent_node) {
@@ -35,7 +37,8 @@ class ConstVisibleNodeIterator {
     node_ptr(0),
     node_end(0),
     num_nodes(0),
-    active_node_id(-1) {
+    active_node_id(-1),
+    removed_nodes(0) {
   }
 
   const int & operator*() const { return current_node; }
@@ -54,13 +57,19 @@ class ConstVisibleNodeIterator {
     current_node = -1;
     while (current_node == -1 && stage != END) {
       if (stage == EDGE_TAIL) {
+	if (isRemoved(edge_ptr->tail) || isRemoved(edge_ptr->head)) {
+	  // edges of removed nodes do not make their other end visible
+	  edge_ptr++;
+	  if (edge_ptr == edge_end) stage = PARENT_NODES;
+	  continue;
+	}
 	int n = edge_ptr->tail;
 	if (!processed_nodes[n]) {
 	  processed_nodes[n] = true;
 	  bool visible = true;
 	  if (node_ptr + n < node_end) {
 	    int p = node_ptr[n].parent_node;
-	    if (p != -1) {
+	    if (p != -1 && !isRemoved(p)) {
 	      if (!open_nodes.count(p)) {
 		visible = false;
 	      }
@@ -68,7 +77,7 @@ class ConstVisibleNodeIterator {
 	    }
 	    if (visible) {
 	      int l = node_ptr[n].group_leader;
-	      if (l != -1) {
+	      if (l != -1 && !isRemoved(l)) {
 		processed_nodes[l] = false;
 		leader_nodes.push_back(l);
 	      }
@@ -84,7 +93,7 @@ class ConstVisibleNodeIterator {
 	  bool visible = true;
 	  if (node_ptr + n < node_end) {
 	    int p = node_ptr[n].parent_node;
-	    if (p != -1) {
+	    if (p != -1 && !isRemoved(p)) {
 	      if (!open_nodes.count(p)) {
 		visible = false;
 	      }
@@ -92,7 +101,7 @@ class ConstVisibleNodeIterator {
 	    }
 	    if (visible) {
 	      int l = node_ptr[n].group_leader;
-	      if (l != -1) {
+	      if (l != -1 && !isRemoved(l)) {
 		processed_nodes[l] = false;
 		leader_nodes.push_back(l);
 	      }
@@ -117,7 +126,7 @@ class ConstVisibleNodeIterator {
 	    bool visible = true;
 	    if (node_ptr + n < node_end) {
 	      int p = node_ptr[n].parent_node;
-	      if (p != -1) {
+	      if (p != -1 && !isRemoved(p)) {
 		if (!open_nodes.count(p)) {
 		  visible = false;
 		}
@@ -125,7 +134,7 @@ class ConstVisibleNodeIterator {
 	      }
 	      if (visible) {
 		int l = node_ptr[n].group_leader;
-		if (l != -1) {
+		if (l != -1 && !isRemoved(l)) {
 		  processed_nodes[l] = false;
 		  leader_nodes.push_back(l);
 		}
@@ -149,17 +158,22 @@ class ConstVisibleNodeIterator {
     }
   }
   
+  bool isRemoved(int n) const {
+    return removed_nodes && n >= 0 && n < int(removed_nodes->size()) && (*removed_nodes)[n];
+  }
+
   enum Stage { EDGE_TAIL = 1, EDGE_HEAD, PARENT_NODES, LEADER_NODES, END };
 
   Stage stage;
   const edge_data_s * edge_ptr, * edge_end;
-  const node_tertiary_data_s * node_ptr, * node_end;
+  const node_hierarchy_data_s * node_ptr, * node_end;
   std::vector<bool> processed_nodes;
   std::vector<int> parent_nodes;
   std::vector<int> leader_nodes;
   size_t num_nodes;
   int current_node;
   int active_node_id;
+  const std::vector<bool> * removed_nodes;
   std::unordered_set<int> open_nodes;
 };
 
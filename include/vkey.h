@@ -0,0 +1,51 @@
+#ifndef _VKEY_H_
+#define _VKEY_H_
+
+#include <functional>
+#include <cstring>
+#include <cmath>
+
+// vkey identifies a vertex by the bit patterns of its coordinates, or by its
+// cell in a snap grid when grid size is positive. Points in the same cell
+// are equal, but points closer than the grid size on either side of a cell
+// boundary are not
+
+class vkey {
+ public:
+ vkey() : x(0), y(0), z(0) { }
+ vkey(double _x, double _y, double _z = 0.0, double grid = 0.0) : x(encode(_x, grid)), y(encode(_y, grid)), z(encode(_z, grid)) { }
+
+  bool operator== (const vkey & other) const {
+    return x == other.x && y == other.y && z == other.z;
+  }
+  bool operator!= (const vkey & other) const {
+    return x != other.x || y != other.y || z != other.z;
+  }
+  
+  unsigned long long x, y, z;
+
+ private:
+  static unsigned long long encode(double v, double grid) {
+    if (grid > 0.0) {
+      return (unsigned long long)(long long)floor(v / grid + 0.5);
+    }
+    if (v == 0.0) v = 0.0; // -0.0 and 0.0 are the same point
+    unsigned long long r;
+    memcpy(&r, &v, sizeof(r));
+    return r;
+  }
+};
+
+namespace std {
+  template <>
+  struct hash<vkey> {
+    std::size_t operator()(const vkey & a) const {
+      unsigned long long h = a.x * 0x9e3779b97f4a7c15ULL;
+      h = (h ^ (h >> 32) ^ a.y) * 0xbf58476d1ce4e5b9ULL;
+      h = (h ^ (h >> 29) ^ a.z) * 0x94d049bb133111ebULL;
+      return std::size_t(h ^ (h >> 31));
+    }
+  };
+};
+
+#endif
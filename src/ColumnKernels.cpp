@@ -0,0 +1,248 @@
+#include "ColumnKernels.h"
+
+#include <Parallel.h>
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+#define KERNEL_GRAIN	65536
+
+using namespace std;
+using namespace table;
+
+// calls f with a typed view of the column, or with a copy of its values as doubles
+template<class F>
+static void
+dispatch(const ColumnBase & col, F & f) {
+  if (auto c = getTypedColumn<double>(col)) f(c->view());
+  else if (auto c = getTypedColumn<float>(col)) f(c->view());
+  else if (auto c = getTypedColumn<int>(col)) f(c->view());
+  else if (auto c = getTypedColumn<long long>(col)) f(c->view());
+  else if (auto c = getTypedColumn<short>(col)) f(c->view());
+  else if (auto c = getTypedColumn<unsigned short>(col)) f(c->view());
+  else {
+    vector<double> tmp(col.size());
+    for (size_t i = 0; i < tmp.size(); i++) tmp[i] = col.getDouble(int(i));
+    f(ColumnView<double>(tmp.data(), tmp.size()));
+  }
+}
+
+size_t
+SelectionBitmap::count() const {
+  size_t n = 0;
+  for (auto w : words) n += __builtin_popcountll(w);
+  return n;
+}
+
+std::vector<int>
+SelectionBitmap::getRows() const {
+  vector<int> rows;
+  rows.reserve(count());
+  for (size_t i = 0; i < words.size(); i++) {
+    for (uint64_t w = words[i]; w; w &= w - 1) {
+      rows.push_back(int(i * 64 + __builtin_ctzll(w)));
+    }
+  }
+  return rows;
+}
+
+struct filter_range_s {
+  double min_value, max_value;
+  SelectionBitmap & selection;
+  const vector<column_zone_s> * zones;
+
+  template<class T>
+  void operator()(ColumnView<T> v) {
+    selection.resize(v.size());
+    uint64_t * words = selection.getWords().data();
+    size_t num_words = selection.getWords().size();
+    // threads write whole words so no synchronisation is needed
+    parallelForRanges(0, num_words, KERNEL_GRAIN / 64, [&](unsigned int thread_index, size_t b, size_t e) {
+	for (size_t w = b; w < e; w++) {
+	  size_t first = w * 64, n = min(size_t(64), v.size() - first);
+	  if (zones) {
+	    // whole zones outside or inside the range are not scanned
+	    auto & zone = (*zones)[first / COLUMN_ZONE_SIZE];
+	    if (zone.min_value > max_value || zone.max_value < min_value) {
+	      words[w] = 0;
+	      continue;
+	    } else if (zone.min_value >= min_value && zone.max_value <= max_value && !zone.null_count) {
+	      words[w] = n == 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+	      continue;
+	    }
+	  }
+	  const T * d = v.data() + first;
+	  uint64_t word = 0;
+	  for (size_t j = 0; j < n; j++) {
+	    double x = double(d[j]);
+	    word |= uint64_t(x >= min_value && x <= max_value) << j;
+	  }
+	  words[w] = word;
+	}
+      });
+  }
+};
+
+void
+table::filterRange(const ColumnBase & col, double min_value, double max_value, SelectionBitmap & selection) {
+  filter_range_s f = { min_value, max_value, selection, col.getZones() };
+  dispatch(col, f);
+}
+
+struct summarize_s {
+  column_summary_s result;
+
+  template<class T>
+  void operator()(ColumnView<T> v) {
+    unsigned int num_threads = getThreadCount();
+    vector<column_summary_s> partial(num_threads, { numeric_limits<double>::infinity(), -numeric_limits<double>::infinity(), 0.0, 0 });
+    parallelForRanges(0, v.size(), KERNEL_GRAIN, [&](unsigned int thread_index, size_t b, size_t e) {
+	auto & p = partial[thread_index];
+	double mn = p.min_value, mx = p.max_value, sum = 0.0;
+	size_t count = 0;
+	for (size_t i = b; i < e; i++) {
+	  double x = double(v[i]);
+	  if (x != x) continue; // NaN
+	  mn = x < mn ? x : mn;
+	  mx = x > mx ? x : mx;
+	  sum += x;
+	  count++;
+	}
+	p.min_value = mn;
+	p.max_value = mx;
+	p.sum += sum;
+	p.count += count;
+      }, num_threads);
+    result = { 0.0, 0.0, 0.0, 0 };
+    bool first = true;
+    for (auto & p : partial) {
+      if (!p.count) continue;
+      if (first || p.min_value < result.min_value) result.min_value = p.min_value;
+      if (first || p.max_value > result.max_value) result.max_value = p.max_value;
+      result.sum += p.sum;
+      result.count += p.count;
+      first = false;
+    }
+  }
+};
+
+column_summary_s
+table::summarize(const ColumnBase & col) {
+  column_statistics_s stats;
+  if (col.getStatistics(stats)) {
+    return { stats.min_value, stats.max_value, stats.sum, stats.count };
+  }
+  summarize_s f;
+  dispatch(col, f);
+  return f.result;
+}
+
+struct copy_values_s {
+  vector<double> & values;
+
+  template<class T>
+  void operator()(ColumnView<T> v) {
+    values.reserve(v.size());
+    for (auto x : v) {
+      double d = double(x);
+      if (d == d) values.push_back(d);
+    }
+  }
+};
+
+std::vector<double>
+table::getQuantiles(const ColumnBase & col, unsigned int num_buckets) {
+  vector<double> values;
+  copy_values_s f = { values };
+  dispatch(col, f);
+
+  vector<double> boundaries;
+  if (values.empty() || !num_buckets) return boundaries;
+
+  // each selection only partitions the part above the previous one
+  auto begin = values.begin();
+  for (unsigned int i = 0; i <= num_buckets; i++) {
+    size_t k = min(values.size() - 1, size_t((double(i) / num_buckets) * (values.size() - 1) + 0.5));
+    auto nth = values.begin() + k;
+    if (nth >= begin) {
+      nth_element(begin, nth, values.end());
+      begin = nth;
+    }
+    boundaries.push_back(*nth);
+  }
+  return boundaries;
+}
+
+struct histogram_s {
+  const vector<double> & boundaries;
+  vector<size_t> counts;
+
+  template<class T>
+  void operator()(ColumnView<T> v) {
+    size_t num_buckets = boundaries.size() - 1;
+    unsigned int num_threads = getThreadCount();
+    vector<vector<size_t> > partial(num_threads, vector<size_t>(num_buckets, 0));
+    parallelForRanges(0, v.size(), KERNEL_GRAIN, [&](unsigned int thread_index, size_t b, size_t e) {
+	auto & c = partial[thread_index];
+	for (size_t i = b; i < e; i++) {
+	  double x = double(v[i]);
+	  if (!(x >= boundaries.front() && x <= boundaries.back())) continue;
+	  size_t bucket = upper_bound(boundaries.begin(), boundaries.end(), x) - boundaries.begin();
+	  c[bucket > num_buckets ? num_buckets - 1 : bucket - 1]++;
+	}
+      }, num_threads);
+    counts.assign(num_buckets, 0);
+    for (auto & c : partial) {
+      for (size_t i = 0; i < num_buckets; i++) counts[i] += c[i];
+    }
+  }
+};
+
+std::vector<size_t>
+table::getHistogram(const ColumnBase & col, const std::vector<double> & boundaries) {
+  if (boundaries.size() < 2) return vector<size_t>();
+  histogram_s f = { boundaries, vector<size_t>() };
+  dispatch(col, f);
+  return f.counts;
+}
+
+struct argsort_s {
+  bool descending;
+  vector<int> rows;
+
+  template<class T>
+  void operator()(ColumnView<T> v) {
+    rows.resize(v.size());
+    for (size_t i = 0; i < rows.size(); i++) rows[i] = int(i);
+    // NaNs go last in both orders, so that the order stays strict weak
+    auto cmp = [&](int a, int b) {
+      T x = v[a], y = v[b];
+      if (y != y) return x == x;
+      if (x != x) return false;
+      return descending ? y < x : x < y;
+    };
+
+    // sort chunks in parallel and merge them pairwise
+    size_t chunk = max(size_t(KERNEL_GRAIN), (rows.size() + getThreadCount() - 1) / getThreadCount());
+    size_t num_chunks = (rows.size() + chunk - 1) / chunk;
+    parallelFor(0, num_chunks, [&](size_t c) {
+	auto b = rows.begin() + c * chunk, e = rows.begin() + min(rows.size(), (c + 1) * chunk);
+	stable_sort(b, e, cmp);
+      }, 1);
+    for (size_t width = chunk; width < rows.size(); width *= 2) {
+      size_t num_pairs = (rows.size() + 2 * width - 1) / (2 * width);
+      parallelFor(0, num_pairs, [&](size_t p) {
+	  size_t b = p * 2 * width, m = min(rows.size(), b + width), e = min(rows.size(), b + 2 * width);
+	  if (m < e) inplace_merge(rows.begin() + b, rows.begin() + m, rows.begin() + e, cmp);
+	}, 1);
+    }
+  }
+};
+
+std::vector<int>
+table::argsort(const ColumnBase & col, bool descending) {
+  argsort_s f = { descending, vector<int>() };
+  dispatch(col, f);
+  return f.rows;
+}
@@ -1,11 +1,16 @@
 #include "DBase3File.h"
+#include "TextColumn.h"
+#include "Parallel.h"
 
 #include "utf8.h"
 
 #include <cstring>
+#include <cstdlib>
+#include <cstdio>
 #include <cassert>
 #include <shapefil.h>
 #include <iostream>
+#include <fstream>
 
 using namespace std;
 using namespace table;
@@ -28,11 +33,16 @@ public:
   
   int readIntegerAttribute(int rec, int field) { return DBFReadIntegerAttribute(h, rec, field); }
   double readDoubleAttribute(int rec, int field) { return DBFReadDoubleAttribute(h, rec, field); }
+  // parses the cell directly, since values over 2^53 don't fit in a double
+  long long readInt64Attribute(int rec, int field) {
+    const char * tmp = DBFReadStringAttribute(h, rec, field);
+    return tmp ? strtoll(tmp, 0, 10) : 0;
+  }
   std::string readStringAttribute(int rec, int field) {
     const char * tmp = DBFReadStringAttribute(h, rec, field);
     if (tmp) {
       string output;
-      while (!tmp) {
+      while (*tmp) {
 	utf8::append((unsigned char)*tmp, back_inserter(output));
 	tmp++;
       }
@@ -44,6 +54,15 @@ public:
   bool isNull(int rec, int field) { return DBFIsAttributeNULL(h, rec, field); }
   unsigned int getRecordCount() { return h ? DBFGetRecordCount(h) : 0; }
   unsigned int getFieldCount() { return h ? DBFGetFieldCount(h) : 0; }
+  bool isNumeric(int field) {
+    DBFFieldType type = DBFGetFieldInfo(h, field, 0, 0, 0);
+    return type == FTInteger || type == FTDouble;
+  }
+  bool isIntegral(int field) {
+    int decimals = 0;
+    DBFFieldType type = DBFGetFieldInfo(h, field, 0, 0, &decimals);
+    return type == FTInteger || (type == FTDouble && decimals == 0);
+  }
   string getFieldName(int field) {
     char fieldname[255];
     DBFFieldType type = DBFGetFieldInfo(h, field, fieldname, 0, 0);
@@ -54,9 +73,222 @@ private:
   DBFHandle h = 0;
 };
 
-DBase3File::DBase3File(const string & filename) {
+struct dbf_field_s {
+  char type;
+  unsigned int offset, width, decimals;
+};
+
+// converts a Latin-1 cell into UTF-8 without the padding
+static string decodeText(const char * p, unsigned int width) {
+  while (width && p[width - 1] == ' ') width--;
+  while (width && *p == ' ') { p++; width--; }
+  string output;
+  output.reserve(width);
+  for (unsigned int i = 0; i < width && p[i]; i++) {
+    utf8::append((unsigned char)p[i], back_inserter(output));
+  }
+  return output;
+}
+
+// parses a numeric cell in place; blank and overflowed ('*') cells read as
+// 0 like in shapelib
+static double decodeNumber(const char * p, unsigned int width) {
+  char tmp[256];
+  if (width >= sizeof(tmp)) width = sizeof(tmp) - 1;
+  memcpy(tmp, p, width);
+  tmp[width] = 0;
+  return strtod(tmp, 0);
+}
+
+// parses an integral cell in place, without a round trip through double
+static long long decodeInteger(const char * p, unsigned int width) {
+  char tmp[256];
+  if (width >= sizeof(tmp)) width = sizeof(tmp) - 1;
+  memcpy(tmp, p, width);
+  tmp[width] = 0;
+  return strtoll(tmp, 0, 10);
+}
+
+// true if a numeric cell has no digits, i.e. it is blank or overflowed ('*')
+static bool isBlankNumber(const char * p, unsigned int width) {
+  for (unsigned int i = 0; i < width && p[i]; i++) {
+    if (p[i] >= '0' && p[i] <= '9') return false;
+  }
+  return true;
+}
+
+// A numeric field decoded into memory. Cells read as the same text as
+// through shapelib: values are formatted with the decimals of the field,
+// and blank cells, whose value is 0, read as empty text.
+template<class T>
+class DBase3NumberColumn : public Column<T> {
+public:
+  DBase3NumberColumn(unsigned int _decimals) : decimals(_decimals) { }
+
+  std::string getText(int i) const override {
+    if (isBlank(i)) return "";
+    if (!decimals) return Column<T>::getText(i);
+    char buffer[400];
+    snprintf(buffer, sizeof(buffer), "%.*f", int(decimals), this->getDouble(i));
+    return buffer;
+  }
+
+  void setValue(int i, double v) override { unsetBlank(i); Column<T>::setValue(i, v); }
+  void setValue(int i, int v) override { unsetBlank(i); Column<T>::setValue(i, v); }
+  void setValue(int i, long long v) override { unsetBlank(i); Column<T>::setValue(i, v); }
+  void setValue(int i, const std::string & v) override { unsetBlank(i); Column<T>::setValue(i, v); }
+  void scatter(const int * rows, size_t n, const double * values) override {
+    for (size_t i = 0; i < n; i++) unsetBlank(rows[i]);
+    Column<T>::scatter(rows, n, values);
+  }
+  void scatter(const int * rows, size_t n, const long long * values) override {
+    for (size_t i = 0; i < n; i++) unsetBlank(rows[i]);
+    Column<T>::scatter(rows, n, values);
+  }
+
+  void remove(int row) override {
+    if (!blank.empty() && row >= 0 && size_t(row) < this->size()) {
+      blank.resize(this->size(), false);
+      blank[row] = blank.back();
+      blank.pop_back();
+    }
+    Column<T>::remove(row);
+  }
+  void retainRows(const std::vector<int> & rows) override {
+    if (!blank.empty()) {
+      blank.resize(this->size(), false);
+      retainValues(blank, rows);
+    }
+    Column<T>::retainRows(rows);
+  }
+  void clear() override {
+    blank.clear();
+    Column<T>::clear();
+  }
+
+  void setBlank(int i) {
+    if (blank.size() <= size_t(i)) blank.resize(i + 1, false);
+    blank[i] = true;
+  }
+
+private:
+  bool isBlank(int i) const { return i >= 0 && size_t(i) < blank.size() && blank[i]; }
+  void unsetBlank(int i) {
+    if (i >= 0 && size_t(i) < blank.size()) blank[i] = false;
+  }
+
+  unsigned int decimals;
+  std::vector<bool> blank;
+};
+
+template<class T>
+static std::shared_ptr<ColumnBase>
+decodeNumberField(const char * records, unsigned int num_records, unsigned int record_length, const dbf_field_s & field) {
+  auto col = std::make_shared<DBase3NumberColumn<T> >(field.decimals);
+  col->reserve(num_records);
+  for (unsigned int i = 0; i < num_records; i++) {
+    const char * p = records + (size_t)i * record_length + field.offset;
+    if (isBlankNumber(p, field.width)) {
+      col->setBlank(i);
+      col->pushValue(0);
+    } else if (field.decimals == 0) {
+      col->pushValue(decodeInteger(p, field.width));
+    } else {
+      col->pushValue(decodeNumber(p, field.width));
+    }
+  }
+  return col;
+}
+
+DBase3File::DBase3File(const string & filename, bool materialize) {
   record_count = 0;
-  openDBF(filename);
+  if (!materialize || !loadDBF(filename)) {
+    openDBF(filename);
+  }
+}
+
+bool
+DBase3File::loadDBF(const string & filename) {
+  // like DBFOpen, accept the name of any file in the shapefile set
+  string dbf_filename = filename;
+  auto dot = dbf_filename.find_last_of('.');
+  if (dot != string::npos && dbf_filename.find('/', dot) == string::npos) {
+    dbf_filename.erase(dot);
+  }
+  string data;
+  {
+    ifstream in(dbf_filename + ".dbf", ios::in | ios::binary);
+    if (!in) in.open(dbf_filename + ".DBF", ios::in | ios::binary);
+    if (!in) return false;
+    in.seekg(0, ios::end);
+    auto len = in.tellg();
+    in.seekg(0, ios::beg);
+    if (len < 32) return false;
+    data.resize(size_t(len));
+    in.read(&data[0], len);
+    data.resize(size_t(in.gcount()));
+  }
+  if (data.size() < 32) return false;
+
+  const unsigned char * header = (const unsigned char *)data.data();
+  unsigned int num_records = header[4] | (header[5] << 8) | (header[6] << 16) | ((unsigned int)header[7] << 24);
+  unsigned int header_length = header[8] | (header[9] << 8);
+  unsigned int record_length = header[10] | (header[11] << 8);
+  if (header_length < 33 || header_length > data.size() || !record_length) {
+    cerr << "invalid DBF header in " << filename << endl;
+    return false;
+  }
+  if (num_records > (data.size() - header_length) / record_length) {
+    num_records = (unsigned int)((data.size() - header_length) / record_length);
+  }
+
+  vector<string> names;
+  vector<dbf_field_s> fields;
+  unsigned int offset = 1; // deletion flag
+  for (unsigned int pos = 32; pos + 32 <= header_length && header[pos] != 0x0d; pos += 32) {
+    const char * fd = (const char *)header + pos;
+    names.push_back(string(fd, strnlen(fd, 11)));
+    dbf_field_s field = { fd[11], offset, header[pos + 16], header[pos + 17] };
+    if (field.type == 'C') { // long character fields
+      field.width |= header[pos + 17] << 8;
+      field.decimals = 0;
+    }
+    offset += field.width;
+    fields.push_back(field);
+  }
+  if (offset > record_length) {
+    cerr << "invalid DBF fields in " << filename << endl;
+    return false;
+  }
+
+  vector<std::shared_ptr<ColumnBase> > decoded(fields.size());
+  const char * records = data.data() + header_length;
+
+  // every field is decoded sequentially from the same buffer. Logical,
+  // date and character fields keep the text of the cell like shapelib.
+  parallelFor(0, fields.size(), [&](size_t j) {
+      auto & field = fields[j];
+      if ((field.type == 'N' || field.type == 'F') && field.decimals == 0 && field.width < 10) {
+	decoded[j] = decodeNumberField<int>(records, num_records, record_length, field);
+      } else if ((field.type == 'N' || field.type == 'F') && field.decimals == 0) {
+	decoded[j] = decodeNumberField<long long>(records, num_records, record_length, field);
+      } else if (field.type == 'N' || field.type == 'F') {
+	decoded[j] = decodeNumberField<double>(records, num_records, record_length, field);
+      } else {
+	auto col = std::make_shared<TextColumn>();
+	col->reserve(num_records);
+	for (unsigned int i = 0; i < num_records; i++) {
+	  col->pushValue(decodeText(records + (size_t)i * record_length + field.offset, field.width));
+	}
+	decoded[j] = col;
+      }
+    }, 1);
+
+  record_count = num_records;
+  for (size_t j = 0; j < fields.size(); j++) {
+    columns[names[j]] = decoded[j];
+  }
+  return true;
 }
 
 bool
@@ -79,13 +311,17 @@ DBase3Column::DBase3Column(const std::shared_ptr<DBase3Handle> _dbf,
   column_index(_column_index),
   num_rows(_num_rows)
 {
-
+  is_numeric = dbf->isNumeric(column_index);
+  is_integral = is_numeric && dbf->isIntegral(column_index);
 }
 
 long long
 DBase3Column::getInt64(int i) const {
   if (i >= 0 && i < num_rows) {
-    return dbf->readIntegerAttribute(i, column_index);
+    if (is_integral) {
+      return dbf->readInt64Attribute(i, column_index);
+    }
+    return (long long)dbf->readDoubleAttribute(i, column_index);
   } else {
     return 0;
   }
@@ -103,7 +339,7 @@ DBase3Column::getText(int i) const {
 double
 DBase3Column::getDouble(int i) const {
   if (i >= 0 && i < num_rows) {
-    return dbf->readIntegerAttribute(i, column_index);
+    return dbf->readDoubleAttribute(i, column_index);
   } else {
     return 0;
   }
@@ -117,3 +353,14 @@ DBase3Column::getInt(int i) const {
     return 0;
   }
 }
+
+bool
+DBase3Column::compare(int a, int b) const {
+  if (is_integral) {
+    return getInt64(a) < getInt64(b);
+  } else if (is_numeric) {
+    return getDouble(a) < getDouble(b);
+  } else {
+    return getText(a) < getText(b);
+  }
+}
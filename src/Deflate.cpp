@@ -8,8 +8,10 @@ extern "C" {
 #include <cassert>
 #include <cstring>
 #include <cstdlib>
+#include <algorithm>
 
 #define CHUNK 65536
+#define CHUNK_MAX (1U << 30)
 
 using namespace std;
 
@@ -39,7 +41,6 @@ Deflate::~Deflate() {
 bool
 Deflate::init() {
   if (!def_stream) {
-    cerr << "init stream\n";
     def_stream = (z_stream *)malloc(sizeof(z_stream));
     
     // allocate deflate state
@@ -76,65 +77,53 @@ Deflate::compress(const void * input, size_t input_len, bool do_flush) {
     return 0;
   }
 
-  unsigned char * in_buffer = new unsigned char[CHUNK];
-  unsigned char * out_buffer = new unsigned char[CHUNK];
-
   unsigned int uncompressed_pos = current_uncompressed_pos;
   current_uncompressed_pos += input_len;
   
-  int ret;
-  unsigned int pos = 0;
+  int ret = Z_OK;
+  size_t pos = 0;
   bool finished = false;
   
   do {
-    assert(pos <= input_len);
-    
-    int flush_v;
-    unsigned int len = input_len - pos;
-    if (len <= CHUNK) {
-      flush_v = do_flush ? Z_SYNC_FLUSH : Z_NO_FLUSH;
-      finished = true;
-    } else {
+    // input is read in place, in pieces that fit the 32-bit counters
+    size_t len = input_len - pos;
+    int flush_v = do_flush ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+    if (len > CHUNK_MAX) {
+      len = CHUNK_MAX;
       flush_v = Z_NO_FLUSH;
-      len = CHUNK;
-    }
-
-    if (len) {
-      assert(input);
-      memcpy(in_buffer, (const unsigned char*)input + pos, len);
-      pos += len;
+    } else {
+      finished = true;
     }
 
-    def_stream->avail_in = len;
-    def_stream->next_in = in_buffer;
+    def_stream->avail_in = (uInt)len;
+    def_stream->next_in = len ? (Bytef *)((const unsigned char*)input + pos) : 0;
+    pos += len;
        
-    // run deflate() on input until output buffer not full, finish
-    // compression if all of source has been read in
-    
+    // run deflate() directly into the output buffer until it has room left
+    size_t avail = max(size_t(CHUNK), size_t(deflateBound(def_stream, (uLong)len)));
     do {
-      def_stream->avail_out = CHUNK;
-      def_stream->next_out = out_buffer;
+      size_t out_pos = output_buffer.size();
+      output_buffer.resize(out_pos + avail);
+      def_stream->avail_out = (uInt)avail;
+      def_stream->next_out = &output_buffer[out_pos];
 
       ret = deflate(def_stream, flush_v);    // no bad return value
       assert(ret != Z_STREAM_ERROR);  // state not clobbered
 
-      unsigned int have = CHUNK - def_stream->avail_out;
-
-      assert(have >= 0 && have <= CHUNK);
-      output_buffer.append(out_buffer, have);      
+      output_buffer.resize(out_pos + avail - def_stream->avail_out);
     } while (def_stream->avail_out == 0);
 
-    // cerr << "avail_in = " << def_stream->avail_in << ", len = " << len << endl;
-    
     assert(def_stream->avail_in == 0);       // all input will be used
 
   } while (!finished);
 
-  // cerr << "ret = " << ret << endl;
-  assert(ret == Z_OK || ret == Z_STREAM_END); // stream will be complete (or not)
+  assert(ret == Z_OK || ret == Z_STREAM_END || ret == Z_BUF_ERROR); // stream will be complete (or not)
 
-  delete[] in_buffer;
-  delete[] out_buffer;
-  
   return uncompressed_pos;
 }
+
+void
+Deflate::swapData(std::basic_string<unsigned char> & other) {
+  output_buffer.swap(other);
+  output_buffer.clear();
+}
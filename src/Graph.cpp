@@ -4,6 +4,8 @@
 #include "RenderMode.h"
 #include "Label.h"
 #include <GraphFilter.h>
+#include <ColumnKernels.h>
+#include <Parallel.h>
 
 #include <algorithm>
 #include <iostream>
@@ -14,10 +16,96 @@
 #include <sys/time.h>
 
 #define EPSILON 0.0000000001
+#define BULK_EDGE_GRAIN		65536
 #define INITIAL_ALPHA		0.1f
 
 using namespace std;
 
+// The node size method for one pass over the nodes. For SIZE_FROM_COLUMN
+// the range is taken from the column statistics when the pass starts and
+// the values are viewed in place, or copied once if the column does not
+// store doubles. Other methods do not read the column.
+class NodeSizes {
+public:
+  NodeSizes(const NodeArray & nodes, unsigned int _total_indegree, unsigned int _total_outdegree)
+    : method(nodes.getNodeSizeMethod()), total_indegree(_total_indegree), total_outdegree(_total_outdegree), node_count(nodes.size()) {
+    if (method.getValue() == SizeMethod::SIZE_FROM_COLUMN) {
+      auto & col = nodes.getTable()[method.getColumn()];
+      auto summary = table::summarize(col);
+      method.setColumnRange(summary.min_value, summary.max_value);
+      if (auto c = table::getTypedColumn<double>(col)) {
+	values = c->view();
+      } else {
+	copy.resize(col.size());
+	for (size_t i = 0; i < copy.size(); i++) copy[i] = col.getDouble(int(i));
+	values = table::ColumnView<double>(copy.data(), copy.size());
+      }
+    }
+  }
+
+  float get(int node_id, const node_degree_data_s & dd, unsigned int child_count) const {
+    double v = node_id >= 0 && size_t(node_id) < values.size() ? values[node_id] : 0.0;
+    return method.calculateSize(dd, child_count, total_indegree, total_outdegree, node_count, v);
+  }
+
+private:
+  SizeMethod method;
+  unsigned int total_indegree, total_outdegree;
+  size_t node_count;
+  table::ColumnView<double> values;
+  std::vector<double> copy;
+};
+
+// Calls f(i) for each i with keys[i] in [0, num_keys), so that the keys are split into
+// num_threads ranges, each range is visited by a single thread and the
+// indices of a range are visited in order. The indices are first bucketed
+// by range with a counting pass and a scatter, so each index is read a
+// fixed number of times whatever the thread count.
+template<class F>
+static void
+forEachByKeyRange(const vector<int> & keys, size_t num_keys, unsigned int num_threads, F f) {
+  size_t n = keys.size();
+  if (num_threads <= 1 || num_keys < 2) {
+    for (size_t i = 0; i < n; i++) if (keys[i] >= 0 && size_t(keys[i]) < num_keys) f(i);
+    return;
+  }
+  size_t range = (num_keys + num_threads - 1) / num_threads;
+  size_t num_ranges = (num_keys + range - 1) / range;
+  size_t grain = (n + num_threads - 1) / num_threads;
+  size_t num_chunks = (n + grain - 1) / grain;
+
+  // the count of each range in each chunk, then its position in order
+  vector<size_t> pos(num_chunks * num_ranges, 0);
+  parallelForRanges(0, n, grain, [&](unsigned int thread_index, size_t b, size_t e) {
+      size_t * count = &pos[b / grain * num_ranges];
+      for (size_t i = b; i < e; i++) if (keys[i] >= 0 && size_t(keys[i]) < num_keys) count[keys[i] / range]++;
+    }, num_threads);
+
+  vector<size_t> range_begin(num_ranges + 1);
+  size_t total = 0;
+  for (size_t r = 0; r < num_ranges; r++) {
+    range_begin[r] = total;
+    for (size_t c = 0; c < num_chunks; c++) {
+      size_t count = pos[c * num_ranges + r];
+      pos[c * num_ranges + r] = total;
+      total += count;
+    }
+  }
+  range_begin[num_ranges] = total;
+
+  vector<int> order(total);
+  parallelForRanges(0, n, grain, [&](unsigned int thread_index, size_t b, size_t e) {
+      size_t * p = &pos[b / grain * num_ranges];
+      for (size_t i = b; i < e; i++) if (keys[i] >= 0 && size_t(keys[i]) < num_keys) order[p[keys[i] / range]++] = int(i);
+    }, num_threads);
+
+  parallelForRanges(0, num_ranges, 1, [&](unsigned int thread_index, size_t b, size_t e) {
+      for (size_t r = b; r < e; r++) {
+	for (size_t j = range_begin[r]; j < range_begin[r + 1]; j++) f(order[j]);
+      }
+    }, num_threads);
+}
+
 int Graph::next_id = 1;
  
 bool
@@ -74,12 +162,10 @@ void
 Graph::randomizeChildGeometry(int node_id, bool use_2d) {
   assert(!nodes->hasSpatialData());
   assert(node_id >= 0);
-  if (node_id < node_geometry3.size()) {
-    auto & td = node_geometry3[node_id];
-    for (int c = td.first_child; c != -1; ) {
+  if (node_id < node_degrees.size()) {
+    for (int c = node_hierarchy[node_id].first_child; c != -1; ) {
       getNodeArray().setInitialPosition(c, use_2d);
-      auto & td2 = node_geometry3[c];
-      c = td2.next_child;
+      c = node_hierarchy[c].next_child;
     }
   }
 }
@@ -87,7 +173,7 @@ Graph::randomizeChildGeometry(int node_id, bool use_2d) {
 void
 Graph::getVisibleLabels(vector<Label> & labels) const {  
   auto & user_type = getNodeArray().getTable()["type"];
-  auto & size_method = nodes->getNodeSizeMethod();
+  NodeSizes node_sizes(*nodes, total_indegree, total_outdegree);
   
   glm::vec4 black(0.0, 0.0, 0.0, 1.0), white(1.0, 1.0, 1.0, 1.0);
   
@@ -105,7 +191,7 @@ Graph::getVisibleLabels(vector<Label> & labels) const {
 
   std::unordered_set<int> open_nodes;
   open_nodes.insert(-1);
-  for (int p = getActiveChildNode(); p != -1; p = getNodeTertiaryData(p).parent_node) {
+  for (int p = getActiveChildNode(); p != -1; p = getParentNode(p)) {
     open_nodes.insert(p);
   }
 
@@ -114,12 +200,12 @@ Graph::getVisibleLabels(vector<Label> & labels) const {
   auto nodes_end = end_visible_nodes();
   for (auto it = begin_visible_nodes(); it != nodes_end; ++it) {
     auto & pd = getNodeArray().getNodeData(*it);
-    auto & td = getNodeTertiaryData(*it);
-    if (!(td.isLabelVisible() && pd.label_texture)) continue;
+    auto & hd = getNodeHierarchyData(*it);
+    if (!(getNodeRenderData(*it).isLabelVisible() && pd.label_texture)) continue;
 
     float scale = 1.0f;
     auto pos = pd.position;
-    for (int p = td.parent_node; p != -1; p = getNodeTertiaryData(p).parent_node, scale *= 0.125f) {
+    for (int p = hd.parent_node; p != -1; p = getParentNode(p), scale *= 0.125f) {
       if (!open_nodes.count(p)) {
 	scale = 1.0f;
 	pos = glm::vec3();
@@ -132,8 +218,8 @@ Graph::getVisibleLabels(vector<Label> & labels) const {
     unsigned short flags = 0;
 
     glm::vec4 color1 = black, color2 = white;
-    if (td.hasChildren()) {
-      float size = size_method.calculateSize(td, total_indegree, total_outdegree, nodes->size());
+    if (hd.hasChildren()) {
+      float size = node_sizes.get(*it, getNodeDegreeData(*it), hd.child_count);
       color1 = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
       // offset += glm::vec2(0, 0.5 * size);
       pos += glm::vec3(0.0, size * scale, 0.0);
@@ -147,7 +233,7 @@ Graph::getVisibleLabels(vector<Label> & labels) const {
       flags |= LABEL_FLAG_CENTER;
       labels.push_back({ pos, offset, pd.label_texture, flags, color1, color2 });
     } else if (getNodeArray().getLabelStyle() == LABEL_DARK_BOX) {
-      float size = size_method.calculateSize(td, total_indegree, total_outdegree, nodes->size());
+      float size = node_sizes.get(*it, getNodeDegreeData(*it), hd.child_count);
       offset += glm::vec2(0.0f, -3.2f * size);
       flags |= LABEL_FLAG_MIDDLE;
       flags |= LABEL_FLAG_CENTER;
@@ -165,7 +251,7 @@ Graph::relaxLinks(std::vector<node_position_data_s> & v) const {
   // unsigned int visible_nodes = calcVisibleNodeCount();
   // double avg_edge_weight = total_edge_weight / getEdgeCount();
   float alpha = getAlpha();
-  auto & size_method = nodes->getNodeSizeMethod();
+  NodeSizes node_sizes(*nodes, total_indegree, total_outdegree);
   bool flatten = nodes->doFlattenHierarchy();
   unsigned int num_nodes = nodes->size();
   // float max_idf = log(visible_nodes / 1.0f);
@@ -173,31 +259,31 @@ Graph::relaxLinks(std::vector<node_position_data_s> & v) const {
   processed_edges.resize(num_nodes * num_nodes);			
   auto end = end_edges();
   for (auto it = begin_edges(); it != end; ++it) {
-    if (it->weight < 0.2f) continue;
+    if (it->weight < 0.2f || isEdgeRemoved(*it)) continue;
     int tail = it->tail, head = it->head;
     int level = 0;
     assert(tail >= 0 && head >= 0);
     if (flatten) {
       int l1 = 0, l2 = 0;
-      if (tail < node_geometry3.size()) {
-        for (int p = node_geometry3[tail].parent_node; p != -1; p = node_geometry3[p].parent_node) l1++;
+      if (tail < node_degrees.size()) {
+        for (int p = node_hierarchy[tail].parent_node; p != -1; p = node_hierarchy[p].parent_node) l1++;
       }
-      if (head < node_geometry3.size()) {
-        for (int p = node_geometry3[head].parent_node; p != -1; p = node_geometry3[p].parent_node) l2++;
+      if (head < node_degrees.size()) {
+        for (int p = node_hierarchy[head].parent_node; p != -1; p = node_hierarchy[p].parent_node) l2++;
       }
       while ( 1 ) {
 	if (l1 > l2) {
-	  tail = node_geometry3[tail].parent_node;
+	  tail = node_hierarchy[tail].parent_node;
 	  l1--;
 	} else if (l2 > l1) {
-	  head = node_geometry3[head].parent_node;
+	  head = node_hierarchy[head].parent_node;
 	  l2--;
-	} else if (l1 == 0 || l2 == 0 || node_geometry3[tail].parent_node == node_geometry3[head].parent_node) {
+	} else if (l1 == 0 || l2 == 0 || node_hierarchy[tail].parent_node == node_hierarchy[head].parent_node) {
 	  break;
 	} else {
 	  l1--; l2--;
-	  tail = node_geometry3[tail].parent_node;
-	  head = node_geometry3[head].parent_node;
+	  tail = node_hierarchy[tail].parent_node;
+	  head = node_hierarchy[head].parent_node;
 	}
       }
       unsigned int key1 = tail * num_nodes + head;
@@ -209,14 +295,15 @@ Graph::relaxLinks(std::vector<node_position_data_s> & v) const {
     }
     if (tail == head || (it->weight > -EPSILON && it->weight < EPSILON)) continue;
     
-    auto & td1 = getNodeTertiaryData(tail), & td2 = getNodeTertiaryData(head);
+    auto & hd1 = getNodeHierarchyData(tail), & hd2 = getNodeHierarchyData(head);
 
-    if (getNodeTertiaryData(tail).parent_node != active_child_node) {
+    if (hd1.parent_node != active_child_node) {
       continue;
     }
-    if (getNodeTertiaryData(head).parent_node != active_child_node) {
+    if (hd2.parent_node != active_child_node) {
       continue;
     }
+    auto & dd1 = getNodeDegreeData(tail), & dd2 = getNodeDegreeData(head);
     
     auto & pd1 = v[tail], & pd2 = v[head];
     glm::vec3 & pos1 = pd1.position, & pos2 = pd2.position;
@@ -227,17 +314,17 @@ Graph::relaxLinks(std::vector<node_position_data_s> & v) const {
 
     d *= 1 / l;
       
-    float w1 = size_method.calculateSize(td1, total_indegree, total_outdegree, nodes->size());
-    float w2 = size_method.calculateSize(td2, total_indegree, total_outdegree, nodes->size());
+    float w1 = node_sizes.get(tail, dd1, hd1.child_count);
+    float w2 = node_sizes.get(head, dd2, hd2.child_count);
 
-    if (td1.hasChildren()) l -= w1;
-    if (td2.hasChildren()) l -= w2;
+    if (hd1.hasChildren()) l -= w1;
+    if (hd2.hasChildren()) l -= w2;
 
     if (l < EPSILON) continue;
 
-    assert(td1.parent_node == td2.parent_node);
+    assert(hd1.parent_node == hd2.parent_node);
 
-    float degree1 = td1.outdegree, degree2 = td2.indegree;
+    float degree1 = dd1.outdegree, degree2 = dd2.indegree;
     float degree = degree1 > degree2 ? degree1 : degree2;
     if (degree == 0) degree = 1;
     float idf = 1.0f; // log(visible_nodes / degree) / max_idf;
@@ -268,24 +355,24 @@ Graph::pickNode(const DisplayInfo & display, int x, int y, float node_scale) con
   int best_i = -1;
   float best_d = 0;
   glm::vec2 ppos(x, y);  
-  auto & size_method = nodes->getNodeSizeMethod();
+  NodeSizes node_sizes(*nodes, total_indegree, total_outdegree);
   
   std::unordered_set<int> open_nodes;
   open_nodes.insert(-1);
-  for (int p = getActiveChildNode(); p != -1; p = getNodeTertiaryData(p).parent_node) {
+  for (int p = getActiveChildNode(); p != -1; p = getParentNode(p)) {
     open_nodes.insert(p);
   }
 
   auto end = end_visible_nodes();
   for (auto it = begin_visible_nodes(); it != end; ++it) {
     auto & pd = nodes->getNodeData(*it);
-    auto & td = getNodeTertiaryData(*it);
+    auto & hd = getNodeHierarchyData(*it);
 
     if (pd.type == NODE_HASHTAG || pd.type == NODE_COMMUNITY) continue;
 	
     float scale = 1.0f;
     auto pos = pd.position;
-    for (int p = td.parent_node; p != -1; p = getNodeTertiaryData(p).parent_node, scale *= 0.125f) {
+    for (int p = hd.parent_node; p != -1; p = getParentNode(p), scale *= 0.125f) {
       if (!open_nodes.count(p)) {
 	scale = 1.0f;
 	pos = glm::vec3();
@@ -294,7 +381,7 @@ Graph::pickNode(const DisplayInfo & display, int x, int y, float node_scale) con
       pos += getNodeArray().getNodeData(p).position;
     }
 
-    float size = size_method.calculateSize(td, total_indegree, total_outdegree, nodes->size()) * scale;
+    float size = node_sizes.get(*it, getNodeDegreeData(*it), hd.child_count) * scale;
     
     glm::vec3 tmp1 = display.project(pos);
     glm::vec3 tmp2 = display.project(pos + glm::vec3(size / 2.0f / node_scale, 0.0f, 0.0f));
@@ -457,11 +544,11 @@ Graph::setActiveChildNode(int id) {
   if (id != active_child_node) {
     active_child_node = id;
     if (id != -1) {
-      auto & td = node_geometry3[id];
-      if (!td.isInitialized()) {
+      auto & rd = node_render[id];
+      if (!rd.isInitialized()) {
 	randomizeChildGeometry(id, true);
 	resume();
-	td.setIsInitialized(true);
+	rd.setIsInitialized(true);
       }
     }
     incVersion();
@@ -474,7 +561,7 @@ Graph::setActiveChildNode(int id) {
 bool
 Graph::updateVisibilities(const DisplayInfo & display, bool reset) {
   vector<label_data_s> all_labels;
-  auto & size_method = nodes->getNodeSizeMethod();
+  NodeSizes node_sizes(*nodes, total_indegree, total_outdegree);
   auto & label_method = nodes->getLabelMethod();
   bool labels_changed = false;
 
@@ -485,24 +572,25 @@ Graph::updateVisibilities(const DisplayInfo & display, bool reset) {
   int best_child = -1;
   float best_score = 0.0f;
 
-  if (node_geometry3.size() < getNodeArray().size()) node_geometry3.resize(getNodeArray().size());
+  if (node_degrees.size() < getNodeArray().size()) resizeNodeData(getNodeArray().size());
 
   std::unordered_set<int> open_nodes;
   open_nodes.insert(-1);
-  for (int p = getActiveChildNode(); p != -1; p = getNodeTertiaryData(p).parent_node) {
+  for (int p = getActiveChildNode(); p != -1; p = getParentNode(p)) {
     open_nodes.insert(p);
   }
 
   auto end = end_visible_nodes();
   for (auto it = begin_visible_nodes(); it != end; ++it) {
     auto & pd = getNodeArray().getNodeData(*it);
-    auto & td = node_geometry3[*it];
-    if (!td.hasChildren()) {
+    auto & hd = node_hierarchy[*it];
+    auto & rd = node_render[*it];
+    if (!hd.hasChildren()) {
       continue;
     }
     float scale = 1.0f;
     auto pos = pd.position;
-    for (int p = td.parent_node; p != -1; p = getNodeTertiaryData(p).parent_node) {
+    for (int p = hd.parent_node; p != -1; p = getParentNode(p)) {
       if (!open_nodes.count(p)) {
 	scale = 1.0f;
 	pos = glm::vec3();
@@ -511,7 +599,7 @@ Graph::updateVisibilities(const DisplayInfo & display, bool reset) {
       scale *= 0.125f;
       pos += getNodeArray().getNodeData(p).position;    
     }
-    float size = size_method.calculateSize(td, total_indegree, total_outdegree, nodes->size()) * scale;
+    float size = node_sizes.get(*it, getNodeDegreeData(*it), hd.child_count) * scale;
 
     auto ppos = display.project(pos);
     auto d = ppos - display.project(pos + glm::vec3(size, 0.0f, 0.0f));
@@ -520,9 +608,9 @@ Graph::updateVisibilities(const DisplayInfo & display, bool reset) {
     bool is_open = l >= 100.0f;
     float score = glm::length(d2);
     if (l >= 10.0f) {
-      labels_changed |= td.setLabelVisibility(true);	    
+      labels_changed |= rd.setLabelVisibility(true);	    
     } else {
-      labels_changed |= td.setLabelVisibility(false);
+      labels_changed |= rd.setLabelVisibility(false);
     }
     if (is_open && (best_child == -1 || score < best_score)) {
       best_child = *it;
@@ -536,15 +624,16 @@ Graph::updateVisibilities(const DisplayInfo & display, bool reset) {
   
   for (auto it = begin_visible_nodes(); it != end; ++it) {
     auto & pd = getNodeArray().getNodeData(*it);
-    auto & td = node_geometry3[*it];
+    auto & hd = node_hierarchy[*it];
+    auto & rd = node_render[*it];
     if (pd.type == NODE_LANG_ATTRIBUTE || pd.type == NODE_ATTRIBUTE || pd.type == NODE_IMAGE) {
       continue;
-    } else if (td.hasChildren()) {
+    } else if (hd.hasChildren()) {
       continue;
     }
     float scale = 1.0f;
     auto pos = pd.position;
-    for (int p = td.parent_node; p != -1; p = getNodeTertiaryData(p).parent_node) {
+    for (int p = hd.parent_node; p != -1; p = getParentNode(p)) {
       if (!open_nodes.count(p)) {
 	scale = 1.0f;
 	pos = glm::vec3();
@@ -554,10 +643,10 @@ Graph::updateVisibilities(const DisplayInfo & display, bool reset) {
     }
 
     if (!display.isPointVisible(pos)) {
-      labels_changed |= td.setLabelVisibility(false);
+      labels_changed |= rd.setLabelVisibility(false);
       continue;
     }
-    float size = size_method.calculateSize(td, total_indegree, total_outdegree, nodes->size());
+    float size = node_sizes.get(*it, getNodeDegreeData(*it), hd.child_count);
     float priority = 1000.0f;
     if (pd.type == NODE_HASHTAG) {
       priority = 1.0f;
@@ -661,13 +750,12 @@ glm::vec3
 Graph::getNodePosition(int node_id) const {
   std::unordered_set<int> open_nodes;
   open_nodes.insert(-1);
-  for (int p = getActiveChildNode(); p != -1; p = getNodeTertiaryData(p).parent_node) {
+  for (int p = getActiveChildNode(); p != -1; p = getParentNode(p)) {
     open_nodes.insert(p);
   }
 
-  auto & td = getNodeTertiaryData(node_id);
   glm::vec3 pos = nodes->getNodeData(node_id).position;
-  for (int p = td.parent_node; p != -1; p = getNodeTertiaryData(p).parent_node) {
+  for (int p = getParentNode(node_id); p != -1; p = getParentNode(p)) {
     if (!open_nodes.count(p)) {
       pos = glm::vec3();
     }
@@ -679,20 +767,7 @@ Graph::getNodePosition(int node_id) const {
   
 skey
 Graph::getNodeKey(int node_id) const {
-  auto & source_id_column = getNodeArray().getTable()["source"];
-  auto & id_column = getNodeArray().getTable()["id"];
-  
-  short source_id = source_id_column.getInt(node_id);
-  long long source_object_id = 0;
-
-  if (source_id) {
-    source_object_id = id_column.getInt64(node_id);
-  } else {
-    source_object_id = node_id;
-  }
-  
-  skey key(source_id, source_object_id);
-  return key;
+  return nodes->getNodeKey(node_id);
 }
 
 void
@@ -715,21 +790,14 @@ std::string
 Graph::getFaceLabel(int face_id) const {
   string label, name, text, id;
   auto & label_method = nodes->getLabelMethod();
+  auto & table = getFaceData();
   if (label_method.getValue() == LabelMethod::LABEL_FROM_COLUMN) {
-    label = getFaceData()[label_method.getColumn()].getText(face_id);
+    label = nodes->getFaceLabelMethodColumn().get(table).getText(face_id);
   } else {
-    for (auto & cd : getFaceData().getColumns()) {
-      auto & n = cd.first;
-      if (strcasecmp(n.c_str(), "label") == 0) {
-	label = cd.second->getText(face_id);
-      } else if (strcasecmp(n.c_str(), "name") == 0) {
-	name = cd.second->getText(face_id);
-      } else if (strcasecmp(n.c_str(), "text") == 0) {
-	text = cd.second->getText(face_id);
-      } else if (strcasecmp(n.c_str(), "id") == 0) {
-	id = cd.second->getText(face_id);
-      }
-    }
+    label = face_label_column.get(table).getText(face_id);
+    name = face_name_column.get(table).getText(face_id);
+    text = face_text_column.get(table).getText(face_id);
+    id = face_id_column.get(table).getText(face_id);
     if (label_method.getValue() == LabelMethod::AUTOMATIC_LABEL && !label.empty()) {
       if (!name.empty()) {
 	label = name;
@@ -760,11 +828,11 @@ Graph::reset() {
 
 bool
 Graph::isNodeVisible(int node) const {
-  if (node >= node_geometry3.size()) {
+  if (node >= node_degrees.size()) {
     return false;
   } else {
     // PROBLEM: node might not be visible even with children, since the children might be invisible
-    return node_geometry3[node].first_edge != -1 || node_geometry3[node].hasChildren() || node_geometry3[node].indegree > 0;
+    return node_degrees[node].first_edge != -1 || node_hierarchy[node].hasChildren() || node_degrees[node].indegree > 0;
   }
 }
 
@@ -781,10 +849,12 @@ Graph::addEdge(int n1, int n2, int face, float weight, int arc) {
   updateIndegree(n2, weight);
   
   if (n1 == n2) {
-    node_geometry3[n1].weighted_selfdegree += weight;
+    node_degrees[n1].weighted_selfdegree += weight;
   }
   
-  edge_attributes.push_back(edge_data_s( weight, n1, n2, next_node_edge, -1, -1, arc ));
+  edge_attributes.push_back(edge_data_s( weight, n1, n2, next_node_edge ));
+  edge_faces.push_back(-1);
+  if (arc) getEdgeSecondaryAttributes(edge).arc = arc;
   if (weight > max_edge_weight) max_edge_weight = weight;
 
   if (face != -1) {
@@ -795,55 +865,136 @@ Graph::addEdge(int n1, int n2, int face, float weight, int arc) {
   return edge;
 }
 
+int
+Graph::addEdges(const std::vector<int> & tails, const std::vector<int> & heads, const std::vector<float> & weights, const std::vector<int> & faces, bool parallel) {
+  assert(heads.size() == tails.size());
+  assert(weights.empty() || weights.size() == tails.size());
+  assert(faces.empty() || faces.size() == tails.size());
+  int first_edge = (int)edge_attributes.size();
+  size_t num_new = tails.size();
+  if (!num_new) return first_edge;
+
+  unsigned int num_threads = parallel ? getThreadCount() : 1;
+  size_t num_edges = first_edge + num_new;
+  edge_attributes.resize(num_edges);
+  edge_faces.resize(num_edges, -1);
+
+  // the edge records, with the largest node id and the weight sums per fixed
+  // chunk so that the totals do not depend on the number of threads
+  size_t num_chunks = (num_new + BULK_EDGE_GRAIN - 1) / BULK_EDGE_GRAIN;
+  vector<int> chunk_max_node(num_chunks, -1);
+  vector<double> chunk_weight(num_chunks, 0.0);
+  vector<float> chunk_max_weight(num_chunks, 0.0f);
+  parallelForRanges(0, num_new, BULK_EDGE_GRAIN, [&](unsigned int thread_index, size_t b, size_t e) {
+      for (size_t i = b; i < e; i++) {
+	size_t chunk = i / BULK_EDGE_GRAIN;
+	float w = weights.empty() ? 1.0f : weights[i];
+	assert(tails[i] >= 0 && heads[i] >= 0);
+	assert(w >= 0);
+	edge_attributes[first_edge + i] = edge_data_s(w, tails[i], heads[i], -1);
+	if (!faces.empty()) edge_faces[first_edge + i] = faces[i];
+	chunk_max_node[chunk] = max(chunk_max_node[chunk], max(tails[i], heads[i]));
+	chunk_weight[chunk] += w;
+	if (w > chunk_max_weight[chunk]) chunk_max_weight[chunk] = w;
+      }
+    }, num_threads);
+
+  int max_node = -1;
+  double total_weight = 0.0;
+  for (size_t c = 0; c < num_chunks; c++) {
+    max_node = max(max_node, chunk_max_node[c]);
+    total_weight += chunk_weight[c];
+    if (chunk_max_weight[c] > max_edge_weight) max_edge_weight = chunk_max_weight[c];
+  }
+  assert(max_node < int(nodes->size()));
+  growNodeData(max_node);
+
+  // each thread owns a range of nodes and links the edges of those nodes in
+  // edge order, so the lists and float sums match adding the edges one by one
+  size_t num_nodes = node_degrees.size();
+  forEachByKeyRange(tails, num_nodes, num_threads, [&](size_t i) {
+      int tail = tails[i];
+      float w = weights.empty() ? 1.0f : weights[i];
+      auto & td = node_degrees[tail];
+      edge_attributes[first_edge + i].next_node_edge = td.first_edge;
+      td.first_edge = first_edge + int(i);
+      td.outdegree++;
+      td.weighted_outdegree += w;
+      if (tail == heads[i]) td.weighted_selfdegree += w;
+    });
+  forEachByKeyRange(heads, num_nodes, num_threads, [&](size_t i) {
+      auto & hd = node_degrees[heads[i]];
+      hd.indegree++;
+      hd.weighted_indegree += weights.empty() ? 1.0f : weights[i];
+    });
+
+  if (!faces.empty()) {
+    edge_secondary_attributes.resize(num_edges);
+    forEachByKeyRange(faces, face_attributes.size(), num_threads, [&](size_t i) {
+	int face = faces[i];
+	edge_secondary_attributes[first_edge + i].next_face_edge = face_attributes[face].first_edge;
+	face_attributes[face].first_edge = first_edge + int(i);
+      });
+  }
+
+  total_outdegree += num_new;
+  total_indegree += num_new;
+  total_weighted_outdegree += total_weight;
+  total_weighted_indegree += total_weight;
+
+  incVersion();
+  return first_edge;
+}
+
 void
 Graph::addChild(int parent, int child) {
   assert(parent >= 0 && parent < nodes->size());
   assert(child >= 0 && child < nodes->size());
   assert(parent != child);
   
-  if (node_geometry3.size() <= parent) node_geometry3.resize(parent + 1);
-  if (node_geometry3.size() <= child) node_geometry3.resize(child + 1);
+  growNodeData(parent);
+  growNodeData(child);
   
-  assert(node_geometry3[child].parent_node == -1);
-  assert(node_geometry3[child].next_child == -1);
+  assert(node_hierarchy[child].parent_node == -1);
+  assert(node_hierarchy[child].next_child == -1);
   
-  node_geometry3[child].next_child = node_geometry3[parent].first_child;  
-  node_geometry3[parent].first_child = child;
-  node_geometry3[child].parent_node = parent;
-  node_geometry3[parent].child_count++;
-  node_geometry3[parent].descendant_count += 1 + node_geometry3[child].descendant_count;
+  node_hierarchy[child].next_child = node_hierarchy[parent].first_child;  
+  node_hierarchy[parent].first_child = child;
+  node_hierarchy[child].parent_node = parent;
+  node_hierarchy[parent].child_count++;
+  node_hierarchy[parent].descendant_count += 1 + node_hierarchy[child].descendant_count;
   nodes->getNodeData(parent).label_texture = 0;
   nodes->getNodeData(child).position = nodes->getNodeData(child).position / 0.125f - nodes->getNodeData(parent).position;
 
   assert(nodes->isDynamic());
   incVersion();
   
-  assert(node_geometry3[child].parent_node == parent);
+  assert(node_hierarchy[child].parent_node == parent);
 }
 
 int
 Graph::removeChild(int child) {
-  if (node_geometry3.size() <= child) node_geometry3.resize(child + 1);
-  int parent = node_geometry3[child].parent_node;
+  growNodeData(child);
+  int parent = node_hierarchy[child].parent_node;
   assert(parent != -1);
   if (parent != -1) {
-    if (node_geometry3[parent].first_child == child) {
-      node_geometry3[parent].first_child = node_geometry3[child].next_child;
+    if (node_hierarchy[parent].first_child == child) {
+      node_hierarchy[parent].first_child = node_hierarchy[child].next_child;
     } else {
-      int n = node_geometry3[parent].first_child;
+      int n = node_hierarchy[parent].first_child;
       while (n != -1) {
-	int next_child = node_geometry3[n].next_child;
+	int next_child = node_hierarchy[n].next_child;
 	if (next_child == child) {
-	  node_geometry3[n].next_child = node_geometry3[child].next_child;
+	  node_hierarchy[n].next_child = node_hierarchy[child].next_child;
 	  break;
 	}
 	n = next_child;
 	assert(n != -1);
       }
     }
-    node_geometry3[child].parent_node = node_geometry3[child].next_child = -1;
-    node_geometry3[parent].child_count--;
-    node_geometry3[parent].descendant_count -= 1 + node_geometry3[child].descendant_count;
+    node_hierarchy[child].parent_node = node_hierarchy[child].next_child = -1;
+    node_hierarchy[parent].child_count--;
+    node_hierarchy[parent].descendant_count -= 1 + node_hierarchy[child].descendant_count;
     nodes->getNodeData(parent).label_texture = 0;
     nodes->getNodeData(child).position = nodes->getNodeData(parent).position + nodes->getNodeData(child).position * 0.125f;
 
@@ -858,17 +1009,17 @@ void
 Graph::addChild(int parent, int child, float dnodecomm) {
   addChild(parent, child);
   
-  if (node_geometry3.size() <= parent) node_geometry3.resize(parent + 1);
+  growNodeData(parent);
 
   assert(parent >= 0 && parent < nodes->size());
   
-  auto & td = node_geometry3[parent];
+  auto & td = node_degrees[parent];
 
-  td.weighted_indegree += node_geometry3[child].weighted_indegree;
-  td.weighted_outdegree += node_geometry3[child].weighted_outdegree;
-  td.weighted_selfdegree += dnodecomm + node_geometry3[child].weighted_selfdegree;
-  td.indegree += node_geometry3[child].indegree;
-  td.outdegree += node_geometry3[child].outdegree;  
+  td.weighted_indegree += node_degrees[child].weighted_indegree;
+  td.weighted_outdegree += node_degrees[child].weighted_outdegree;
+  td.weighted_selfdegree += dnodecomm + node_degrees[child].weighted_selfdegree;
+  td.indegree += node_degrees[child].indegree;
+  td.outdegree += node_degrees[child].outdegree;  
 }
 
 // remove the node from its current community with which it has dnodecomm links
@@ -876,13 +1027,13 @@ int
 Graph::removeChild(int child, float dnodecomm) {
   int parent = removeChild(child);
 
-  if (node_geometry3.size() <= parent) node_geometry3.resize(parent + 1);
-  auto & td = node_geometry3[parent];
-  td.weighted_indegree -= node_geometry3[child].weighted_indegree;
-  td.weighted_outdegree -= node_geometry3[child].weighted_outdegree;
-  td.weighted_selfdegree -= dnodecomm + node_geometry3[child].weighted_selfdegree;
-  td.indegree -= node_geometry3[child].indegree;
-  td.outdegree -= node_geometry3[child].outdegree;  
+  growNodeData(parent);
+  auto & td = node_degrees[parent];
+  td.weighted_indegree -= node_degrees[child].weighted_indegree;
+  td.weighted_outdegree -= node_degrees[child].weighted_outdegree;
+  td.weighted_selfdegree -= dnodecomm + node_degrees[child].weighted_selfdegree;
+  td.indegree -= node_degrees[child].indegree;
+  td.outdegree -= node_degrees[child].outdegree;  
   return parent;
 }
 
@@ -890,10 +1041,10 @@ void
 Graph::flattenChildren(int new_parent, int old_parent) {
   if (old_parent == -1) old_parent = new_parent;
   
-  if (node_geometry3.size() <= old_parent) node_geometry3.resize(old_parent + 1);
-  for (int n = node_geometry3[old_parent].first_child; n != -1; n = node_geometry3[n].next_child) {
+  growNodeData(old_parent);
+  for (int n = node_hierarchy[old_parent].first_child; n != -1; n = node_hierarchy[n].next_child) {
     flattenChildren(new_parent, n);
-    if (node_geometry3[n].parent_node != new_parent) {
+    if (node_hierarchy[n].parent_node != new_parent) {
       removeChild(n);
       addChild(new_parent, n);
     }
@@ -904,32 +1055,33 @@ void
 Graph::removeAllChildren() {
   assert(nodes->isDynamic());
   for (int i = 0; i < nodes->size(); i++) {
-    if (i < node_geometry3.size()) {
+    if (i < node_degrees.size()) {
       auto & nd = nodes->getNodeData(i);
-      auto & td = node_geometry3[i];
-      if (td.parent_node != -1) {
+      auto & hd = node_hierarchy[i];
+      if (hd.parent_node != -1) {
 	// nd.position = getNodePosition(i);
-	td.parent_node = -1;
+	hd.parent_node = -1;
       }
-      td.setLabelVisibility(false);
+      node_render[i].setLabelVisibility(false);
     }
   }
   for (int i = 0; i < nodes->size(); i++) {
-    if (i < node_geometry3.size()) {
+    if (i < node_degrees.size()) {
       auto & nd = nodes->getNodeData(i);
-      auto & td = node_geometry3[i];
-      if (td.hasChildren() || nd.type == NODE_COMMUNITY) {
-	td.child_count = 0;
-      	td.first_child = -1;
+      auto & hd = node_hierarchy[i];
+      if (hd.hasChildren() || nd.type == NODE_COMMUNITY) {
+	auto & td = node_degrees[i];
+	hd.child_count = 0;
+      	hd.first_child = -1;
 	td.indegree = td.outdegree = 0;
 	td.weighted_indegree = 0.0f;
 	td.weighted_outdegree = 0.0f;
 	td.weighted_selfdegree = 0.0f;
       }
-      td.descendant_count = 0;
-      td.next_child = -1;
-      td.group_leader = -1;
-      td.setIsInitialized(false);
+      hd.descendant_count = 0;
+      hd.next_child = -1;
+      hd.group_leader = -1;
+      node_render[i].setIsInitialized(false);
     }
   }
   active_child_node = -1;
@@ -941,9 +1093,10 @@ Graph::getAllNeighbors(int node) const {
 
   auto end = end_edges();
   for (auto it = begin_edges(); it != end; ++it) {
+    if (isEdgeRemoved(*it)) continue;
     int head = it->head, tail = it->tail;
-    assert(tail < node_geometry3.size());
-    assert(head < node_geometry3.size());
+    assert(tail < node_degrees.size());
+    assert(head < node_degrees.size());
     while (head != -1 && tail != -1) {
       if (tail == node && head != node) {
 	r[head] += it->weight;
@@ -952,8 +1105,8 @@ Graph::getAllNeighbors(int node) const {
 	r[tail] += it->weight;
 	break;
       }
-      tail = node_geometry3[tail].parent_node;
-      head = node_geometry3[head].parent_node;
+      tail = node_hierarchy[tail].parent_node;
+      head = node_hierarchy[head].parent_node;
     }
   }
 
@@ -968,8 +1121,8 @@ Graph::modularity() const {
 
   auto end = end_visible_nodes();
   for (auto it = begin_visible_nodes(); it != end; ++it) {
-    auto & td = getNodeTertiaryData(*it);
-    if (td.parent_node == -1) {
+    if (getParentNode(*it) == -1) {
+      auto & td = getNodeDegreeData(*it);
       if (getNodeArray().getNodeData(*it).type != NODE_COMMUNITY) {
 	cerr << "got invalid node " << *it << ": type = " << int(getNodeArray().getNodeData(*it).type) << ", label = " << getNodeArray().getNodeLabel(*it) << endl;
       }
@@ -986,7 +1139,7 @@ Graph::modularity() const {
 double
 Graph::modularityGain(int node, int comm, double dnodecomm, double w_degree) const {
   assert(node >= 0 && node < getNodeArray().size());
-  auto & td_comm = getNodeTertiaryData(comm);
+  auto & td_comm = getNodeDegreeData(comm);
   
   double totc = td_comm.weighted_indegree + td_comm.weighted_outdegree;
   double degc = w_degree;
@@ -1004,8 +1157,8 @@ Graph::directedModularity() const {
 
   auto end = end_visible_nodes();
   for (auto it = begin_visible_nodes(); it != end; ++it) {
-    auto & td = getNodeTertiaryData(*it);
-    if (td.parent_node == -1 && (td.weighted_indegree > 0 || td.weighted_outdegree > 0)) {
+    auto & td = getNodeDegreeData(*it);
+    if (getParentNode(*it) == -1 && (td.weighted_indegree > 0 || td.weighted_outdegree > 0)) {
       double tot_out_var = (double)td.weighted_outdegree / m;
       double tot_in_var = (double)td.weighted_indegree / m;
       q += td.weighted_selfdegree / m - (tot_out_var * tot_in_var);
@@ -1018,7 +1171,7 @@ Graph::directedModularity() const {
 double
 Graph::modularityGain(int node, int comm, double dnodecomm, double w_degree_out, double w_degree_in) const {
   assert(node >= 0 && node < getNodeArray().size());
-  auto & td_comm = getNodeTertiaryData(comm);
+  auto & td_comm = getNodeDegreeData(comm);
   
   double totc_out = td_comm.weighted_outdegree;
   double totc_in = td_comm.weighted_indegree;
@@ -1058,9 +1211,9 @@ Graph::selectNode(int node_id) {
       manually_selected_active_child = true;
       setActiveChildNode(node_id);
     } else {
-      auto & td = getNodeTertiaryData(node_id);
-      if (td.parent_node != -1) {
-	selectNode(td.parent_node);
+      int parent = getParentNode(node_id);
+      if (parent != -1) {
+	selectNode(parent);
       }
     }
   }
@@ -1079,12 +1232,142 @@ Graph::createSimilar() const {
   return graph;
 }
 
+std::vector<int>
+Graph::compactNodes() {
+  // detach removed nodes from the hierarchy so that the counts and positions stay valid
+  for (int n = 0; n < int(node_degrees.size()); n++) {
+    if (!nodes->isRemoved(n)) continue;
+    while (node_hierarchy[n].first_child != -1) removeChild(node_hierarchy[n].first_child);
+    if (node_hierarchy[n].parent_node != -1) removeChild(n);
+  }
+  auto remap = nodes->compact();
+  remapNodes(remap);
+  return remap;
+}
+
+void
+Graph::remapNodes(const std::vector<int> & remap) {
+  auto mapNode = [&](int n) { return n >= 0 && n < int(remap.size()) ? remap[n] : -1; };
+
+  // edges with a removed endpoint are dropped and their degrees subtracted
+  vector<int> edge_remap(edge_attributes.size());
+  int num_edges = 0;
+  for (size_t e = 0; e < edge_attributes.size(); e++) {
+    auto & ed = edge_attributes[e];
+    int tail = mapNode(ed.tail), head = mapNode(ed.head);
+    if (tail != -1 && head != -1) {
+      edge_remap[e] = num_edges++;
+      continue;
+    }
+    edge_remap[e] = -1;
+    if (tail != -1 && ed.tail < node_degrees.size()) {
+      node_degrees[ed.tail].outdegree--;
+      node_degrees[ed.tail].weighted_outdegree -= ed.weight;
+    }
+    if (head != -1 && ed.head < node_degrees.size()) {
+      node_degrees[ed.head].indegree--;
+      node_degrees[ed.head].weighted_indegree -= ed.weight;
+    }
+    total_outdegree--;
+    total_indegree--;
+    total_weighted_outdegree -= ed.weight;
+    total_weighted_indegree -= ed.weight;
+  }
+
+  for (size_t n = 0; n < node_degrees.size(); n++) {
+    int parent = node_hierarchy[n].parent_node;
+    if (mapNode(int(n)) == -1 && mapNode(parent) != -1) {
+      node_hierarchy[parent].child_count--;
+      node_hierarchy[parent].descendant_count -= 1 + node_hierarchy[n].descendant_count;
+    }
+  }
+
+  // follows a chain in the old numbering to the next remaining edge
+  auto nextNodeEdge = [&](int e) {
+    while (e != -1 && edge_remap[e] == -1) e = edge_attributes[e].next_node_edge;
+    return e == -1 ? -1 : edge_remap[e];
+  };
+  auto nextFaceEdge = [&](int e) {
+    while (e != -1 && edge_remap[e] == -1) e = edge_secondary_attributes[e].next_face_edge;
+    return e == -1 ? -1 : edge_remap[e];
+  };
+  auto nextChild = [&](int n) {
+    while (n != -1 && mapNode(n) == -1) n = n < node_degrees.size() ? node_hierarchy[n].next_child : -1;
+    return mapNode(n);
+  };
+
+  bool has_secondary = !edge_secondary_attributes.empty();
+  if (has_secondary) edge_secondary_attributes.resize(edge_attributes.size());
+  vector<edge_data_s> new_edges(num_edges);
+  vector<int> new_faces(num_edges);
+  vector<edge_secondary_data_s> new_secondary(has_secondary ? num_edges : 0);
+  parallelFor(0, edge_attributes.size(), [&](size_t e) {
+      int new_e = edge_remap[e];
+      if (new_e == -1) return;
+      auto ed = edge_attributes[e];
+      ed.tail = remap[ed.tail];
+      ed.head = remap[ed.head];
+      ed.next_node_edge = nextNodeEdge(ed.next_node_edge);
+      new_edges[new_e] = ed;
+      new_faces[new_e] = edge_faces[e];
+      if (has_secondary) {
+	auto sd = edge_secondary_attributes[e];
+	sd.next_face_edge = nextFaceEdge(sd.next_face_edge);
+	if (sd.pair_edge != -1) sd.pair_edge = edge_remap[sd.pair_edge];
+	if (sd.parent_edge != -1) sd.parent_edge = edge_remap[sd.parent_edge];
+	new_secondary[new_e] = sd;
+      }
+    });
+  for (auto & fd : face_attributes) {
+    fd.first_edge = nextFaceEdge(fd.first_edge);
+  }
+
+  // node data is moved to the new ids and children of removed parents become roots
+  int num_nodes = 0;
+  for (size_t n = 0; n < node_degrees.size(); n++) {
+    if (mapNode(int(n)) != -1) num_nodes = mapNode(int(n)) + 1;
+  }
+  vector<node_hierarchy_data_s> new_hierarchy(num_nodes);
+  vector<node_degree_data_s> new_degrees(num_nodes);
+  vector<node_render_data_s> new_render(num_nodes);
+  parallelFor(0, node_degrees.size(), [&](size_t n) {
+      int new_id = mapNode(int(n));
+      if (new_id == -1) return;
+      auto td = node_degrees[n];
+      td.first_edge = nextNodeEdge(td.first_edge);
+      new_degrees[new_id] = td;
+      auto hd = node_hierarchy[n];
+      hd.first_child = nextChild(hd.first_child);
+      if (mapNode(hd.parent_node) == -1) {
+	hd.parent_node = hd.next_child = -1;
+      } else {
+	hd.parent_node = mapNode(hd.parent_node);
+	hd.next_child = nextChild(hd.next_child);
+      }
+      hd.group_leader = mapNode(hd.group_leader);
+      new_hierarchy[new_id] = hd;
+      new_render[new_id] = node_render[n];
+    });
+
+  edge_attributes.swap(new_edges);
+  edge_faces.swap(new_faces);
+  edge_secondary_attributes.swap(new_secondary);
+  node_hierarchy.swap(new_hierarchy);
+  node_degrees.swap(new_degrees);
+  node_render.swap(new_render);
+  if (active_child_node != -1) active_child_node = mapNode(active_child_node);
+  if (final_graph.get() && final_graph.get() != this && &(final_graph->getNodeArray()) == nodes.get()) {
+    final_graph->remapNodes(remap);
+  }
+  incVersion();
+}
+
 void
 Graph::convertParentToEdge(int node_id) {
-  auto & td = getNodeTertiaryData(node_id);
-  assert(td.parent_node != -1);
-  if (td.parent_node != -1) {
-    addEdge(node_id, td.parent_node, -1, 0.001f);
+  int parent = getParentNode(node_id);
+  assert(parent != -1);
+  if (parent != -1) {
+    addEdge(node_id, parent, -1, 0.001f);
     float dnodecomm = 0.0f; // ??????
     removeChild(node_id, dnodecomm);    
   }  
@@ -1,6 +1,7 @@
 #include <GraphFilter.h>
 
 #include <Graph.h>
+#include <Parallel.h>
 
 #include <iostream>
 
@@ -11,16 +12,113 @@
 #define HASHTAG_WEIGHT		0.26f
 #define URL_WEIGHT		0.24f
 
+#define STATISTICS_GRAIN	4096
+
 using namespace std;
 
-bool
-GraphFilter::processTemporalData(Graph & target_graph, time_t start_time, time_t end_time, float start_sentiment, float end_sentiment, Graph & source_graph, RawStatistics & stats) {  
+enum statistics_event_type_e { EVENT_ACTIVITY, EVENT_RECEIVED_ACTIVITY, EVENT_HASHTAG, EVENT_LINK };
+
+struct statistics_event_s {
+  statistics_event_type_e type;
+  time_t t;
+  short lang;
+  long long app_id, filter_id;
+};
+
+// Accumulates the statistics that do not depend on the target graph for
+// the edges [begin, end) of the source graph. Chunks are counted into
+// per-thread partials that are merged at the end.
+static void
+accumulateStatistics(const Graph & source_graph, const NodeArray & nodes, size_t begin, size_t end, time_t start_time, time_t end_time, float start_sentiment, float end_sentiment, RawStatistics & stats) {
   auto & sid = source_graph.getNodeArray().getTable()["source"];
   auto & soid = source_graph.getNodeArray().getTable()["id"];
-  auto & user_type = source_graph.getNodeArray().getTable()["type"];
   auto & political_party = source_graph.getNodeArray().getTable()["party"];
   auto & name_column = source_graph.getNodeArray().getTable()["name"];
   auto & uname_column = source_graph.getNodeArray().getTable()["uname"];
+  auto filter_column = source_graph.getFaceData().getColumnSafe("filterId");
+
+  unsigned int num_threads = getThreadCount();
+  vector<RawStatistics> partial(num_threads);
+  for (auto & ps : partial) ps.setSketchCapacity(stats.getTagCapacity(), stats.getUserCapacity());
+  parallelForRanges(begin, end, STATISTICS_GRAIN, [&](unsigned int thread_index, size_t b, size_t e) {
+      // the events of the chunk and their nodes in edge order, so that the
+      // node columns are read with one gather per column
+      vector<statistics_event_s> events;
+      vector<int> event_nodes;
+      for (size_t edge = b; edge < e; edge++) {
+	auto & ed = source_graph.getEdgeAttributes(int(edge));
+	int face = source_graph.getEdgeFace(int(edge));
+	time_t t = 0;
+	float se = 0;
+	short lang = 0;
+	long long app_id = -1, filter_id = -1;
+	bool is_first = false;
+
+	if (face != -1) {
+	  auto & fd = source_graph.getFaceAttributes(face);
+	  t = fd.timestamp;
+	  se = fd.sentiment;
+	  lang = fd.lang;
+	  app_id = fd.app_id;
+	  is_first = fd.first_edge == int(edge);
+	  if (filter_column) filter_id = filter_column->getInt64(face);
+	}
+
+	if (ed.tail < 0 || ed.head < 0 || ed.tail >= nodes.size() || ed.head >= nodes.size()) continue;
+	if (source_graph.isEdgeRemoved(ed)) continue;
+	if ((start_time && t < start_time) || (end_time && t >= end_time) ||
+	    se < start_sentiment || se > end_sentiment) continue;
+
+	if (is_first) {
+	  events.push_back({ EVENT_ACTIVITY, t, lang, app_id, filter_id });
+	  event_nodes.push_back(ed.tail);
+	}
+	NodeType target_type = nodes.getNodeData(ed.head).type;
+	if (target_type == NODE_ANY) {
+	  events.push_back({ EVENT_RECEIVED_ACTIVITY, t, lang, app_id, filter_id });
+	  event_nodes.push_back(ed.head);
+	} else if (target_type == NODE_HASHTAG) {
+	  events.push_back({ EVENT_HASHTAG, t, lang, app_id, filter_id });
+	  event_nodes.push_back(ed.head);
+	} else if (target_type == NODE_URL || target_type == NODE_IMAGE) {
+	  events.push_back({ EVENT_LINK, t, lang, app_id, filter_id });
+	  event_nodes.push_back(ed.head);
+	}
+      }
+
+      size_t n = events.size();
+      vector<int> source_ids(n), parties(n);
+      vector<long long> object_ids(n);
+      sid.gather(event_nodes.data(), n, source_ids.data());
+      soid.gather(event_nodes.data(), n, object_ids.data());
+      political_party.gather(event_nodes.data(), n, parties.data());
+
+      auto & ps = partial[thread_index];
+      for (size_t i = 0; i < n; i++) {
+	auto & ev = events[i];
+	int node = event_nodes[i];
+	switch (ev.type) {
+	case EVENT_ACTIVITY:
+	  ps.addActivity(ev.t, short(source_ids[i]), object_ids[i], ev.lang, ev.app_id, ev.filter_id, PoliticalParty(parties[i]));
+	  break;
+	case EVENT_RECEIVED_ACTIVITY:
+	  ps.addReceivedActivity(ev.t, short(source_ids[i]), object_ids[i], ev.app_id, ev.filter_id);
+	  break;
+	case EVENT_HASHTAG:
+	  ps.addHashtag(name_column.getText(node));
+	  break;
+	case EVENT_LINK:
+	  ps.addLink(name_column.getText(node), uname_column.getText(node));
+	  break;
+	}
+      }
+    }, num_threads);
+  for (auto & ps : partial) stats.merge(ps);
+}
+
+bool
+GraphFilter::processTemporalData(Graph & target_graph, time_t start_time, time_t end_time, float start_sentiment, float end_sentiment, Graph & source_graph, RawStatistics & stats) {  
+  auto & user_type = source_graph.getNodeArray().getTable()["type"];
 
   auto begin = source_graph.begin_edges();
   auto end = source_graph.end_edges();
@@ -40,6 +138,8 @@ GraphFilter::processTemporalData(Graph & target_graph, time_t start_time, time_t
 
   auto & nodes = target_graph.getNodeArray();
 
+  accumulateStatistics(source_graph, nodes, current_pos, source_graph.getEdgeCount(), start_time, end_time, start_sentiment, end_sentiment, stats);
+
   unsigned int skipped_count = 0;
   bool is_changed = false;
   unsigned int num_edges_processed = 0;
@@ -49,27 +149,26 @@ GraphFilter::processTemporalData(Graph & target_graph, time_t start_time, time_t
     time_t t = 0;
     float se = 0;
     short lang = 0;
-    long long app_id = -1, filter_id = -1;
+    long long app_id = -1;
     bool is_first = false;
 
-    assert(it->face != -1);
-    if (it->face != -1) {
-      assert(it->face >= 0 && it->face < source_graph.getFaceCount());
-      auto & fd = source_graph.getFaceAttributes(it->face);
+    int face = source_graph.getEdgeFace(current_pos);
+    assert(face != -1);
+    if (face != -1) {
+      assert(face >= 0 && face < source_graph.getFaceCount());
+      auto & fd = source_graph.getFaceAttributes(face);
       t = fd.timestamp;
       se = fd.sentiment;
       lang = fd.lang;
       app_id = fd.app_id;
       is_first = fd.first_edge == current_pos;
-
-      auto filter_column = source_graph.getFaceData().getColumnSafe("filterId");
-      if (filter_column) filter_id = filter_column->getInt64(it->face);
     }
 
     if (it->tail < 0 || it->head < 0 || it->tail >= nodes.size() || it->head >= nodes.size()) {
       cerr << "GraphFilter: invalid values: tail = " << it->tail << ", head = " << it->head << ", t = " << t << ", count = " << nodes.size() << ", n = " << num_edges_processed << endl;
       assert(0);
     }
+    if (source_graph.isEdgeRemoved(*it)) continue;
 
     if ((!start_time || t >= start_time) && (!end_time || t < end_time) &&
 	se >= start_sentiment && se <= end_sentiment) {
@@ -77,23 +176,17 @@ GraphFilter::processTemporalData(Graph & target_graph, time_t start_time, time_t
       if (t > max_time) max_time = t;
 
       pair<int, int> np(it->tail, it->head);
-      short first_user_sid = sid.getInt(np.first);
-      short target_user_sid = sid.getInt(np.second);
-      long long first_user_soid = soid.getInt64(np.first);
-      long long target_user_soid = soid.getInt64(np.second);
       
       is_changed = true;
 
       auto & target_nd_old = nodes.getNodeData(np.second);
       NodeType target_type = target_nd_old.type;
 
-      bool is_newly_active1 = target_graph.getNodeTertiaryData(np.first).outdegree == 0;
+      bool is_newly_active1 = target_graph.getNodeDegreeData(np.first).outdegree == 0;
       bool is_new_node1 = !target_graph.isNodeVisible(np.first);
       bool is_new_node2 = !target_graph.isNodeVisible(np.second);
       
       if (is_first) {
-	stats.addActivity(t, first_user_sid, first_user_soid, lang, app_id, filter_id, PoliticalParty(political_party.getInt(np.first)));
-
 	if (lang && keep_lang) {
 	  int lang_node = nodes.createLanguage(lang);
 	  if (!target_graph.hasEdge(np.first, lang_node)) {
@@ -137,14 +230,10 @@ GraphFilter::processTemporalData(Graph & target_graph, time_t start_time, time_t
       }
 
       float weight = 1.0f;
-      if (target_type == NODE_ANY) {
-	stats.addReceivedActivity(t, target_user_sid, target_user_soid, app_id, filter_id);
-      } else if (target_type == NODE_HASHTAG) {
-	stats.addHashtag(name_column.getText(np.second));
+      if (target_type == NODE_HASHTAG) {
 	num_hashtags++;
 	weight = HASHTAG_WEIGHT;
       } else if (target_type == NODE_URL || target_type == NODE_IMAGE) {
-	stats.addLink(name_column.getText(np.second), uname_column.getText(np.second));
 	num_links++;
 	weight = URL_WEIGHT;
       }
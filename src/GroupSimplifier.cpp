@@ -59,7 +59,7 @@ GroupSimplifier::breakZeroDegreeNode(Graph & target_graph, int node_id) {
 }
 
 bool
-GroupSimplifier::canPair(int n1, int n2, const node_tertiary_data_s & td1, const node_tertiary_data_s & td2) const {
+GroupSimplifier::canPair(int n1, int n2, const node_degree_data_s & td1, const node_degree_data_s & td2) const {
   if (td1.indegree == 0 && td1.outdegree == 0 && td2.indegree == 0 && td2.outdegree == 0) {
     return true;
   } else {
@@ -112,9 +112,10 @@ GroupSimplifier::apply(Graph & target_graph, time_t start_time, time_t end_time,
     long long app_id = -1, filter_id = -1;
     bool is_first = false;
 
-    assert(it->face != -1);
-    if (it->face != -1) {
-      auto & fd = source_graph.getFaceAttributes(it->face);
+    int face = source_graph.getEdgeFace(current_pos);
+    assert(face != -1);
+    if (face != -1) {
+      auto & fd = source_graph.getFaceAttributes(face);
       t = fd.timestamp;
       se = fd.sentiment;
       lang = fd.lang;
@@ -127,6 +128,7 @@ GroupSimplifier::apply(Graph & target_graph, time_t start_time, time_t end_time,
       cerr << "invalid values: tail = " << it->tail << ", head = " << it->head << ", t = " << t << ", count = " << nodes.size() << ", n = " << num_edges_processed << endl;
       assert(0);
     }
+    if (source_graph.isEdgeRemoved(*it)) continue;
 
     if ((!start_time || t >= start_time) && (!end_time || t < end_time) &&
 	se >= start_sentiment && se <= end_sentiment) {
@@ -139,8 +141,8 @@ GroupSimplifier::apply(Graph & target_graph, time_t start_time, time_t end_time,
       long long first_user_soid = soid.getInt64(np.first);
       long long target_user_soid = soid.getInt64(np.second);
 
-      auto td1 = target_graph.getNodeTertiaryData(np.first); // data is copied, since the backing array might change
-      auto td2 = target_graph.getNodeTertiaryData(np.second);
+      auto td1 = target_graph.getNodeDegreeData(np.first); // data is copied, since the backing array might change
+      auto td2 = target_graph.getNodeDegreeData(np.second);
  
       is_changed = true;
 
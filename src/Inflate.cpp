@@ -8,17 +8,12 @@ extern "C" {
 #include <cstring>
 #include <cstdlib>
 #include <iostream>
+#include <algorithm>
 
 #define CHUNK 65536
 
 using namespace std;
 
-Inflate::Inflate(const std::basic_string<unsigned char> * _input_buffer)
-  : input_buffer(_input_buffer)
-{
-
-}
-
 Inflate::~Inflate() {   
   if (inf_stream) {
     inflateEnd(inf_stream);
@@ -26,6 +21,12 @@ Inflate::~Inflate() {
   }
 }
 
+Inflate &
+Inflate::getThreadInstance() {
+  static thread_local Inflate inflate;
+  return inflate;
+}
+
 bool
 Inflate::init() {
   if (!inf_stream) {
@@ -42,81 +43,88 @@ Inflate::init() {
       free(inf_stream);
       inf_stream = 0;
     }    
+  } else {
+    inflateReset(inf_stream);
   }
   return inf_stream != 0;
 }
 
-string
-Inflate::decompressString(unsigned int data_offset, unsigned short data_length) {
-  assert(input_buffer);
+// inflates the input from the start and appends at least limit bytes (or
+// the whole stream) to output
+bool
+Inflate::run(std::string & output, size_t limit) {
+  assert(input_data || !input_size);
   
   if (!init()) {
-    return "";
+    return false;
   }
 
-  unsigned char * in_buffer = new unsigned char[CHUNK];
-  unsigned char * out_buffer = new unsigned char[CHUNK];
-
-  int ret;
-  unsigned int pos = 0, output_pos = 0;
-  string output_string;
-
-  // decompress until inflate stream ends or end of file
-  do {
-    assert(pos <= input_buffer->size());
-    
-    auto len = input_buffer->size() - pos;
-    int flush = Z_SYNC_FLUSH;
-    if (len > CHUNK) {
-      len = CHUNK;
-      flush = Z_NO_FLUSH;
+  inf_stream->avail_in = 0;
+  size_t start = output.size(), in_pos = 0;
+  int ret = Z_OK;
+  while (ret != Z_STREAM_END && output.size() - start < limit) {
+    if (!inf_stream->avail_in && in_pos < input_size) {
+      size_t len = min(input_size - in_pos, size_t(1) << 30);
+      inf_stream->next_in = const_cast<unsigned char *>(input_data + in_pos);
+      inf_stream->avail_in = (uInt)len;
+      in_pos += len;
     }
     
-    memcpy(in_buffer, input_buffer->data() + pos, len);
-    pos += len;
+    // decompress straight into the output, growing it geometrically
+    size_t pos = output.size();
+    size_t avail = max(size_t(CHUNK), min(pos - start, limit - (pos - start)));
+    output.resize(pos + avail);
+    inf_stream->next_out = (unsigned char *)&output[pos];
+    inf_stream->avail_out = (uInt)avail;
+
+    ret = inflate(inf_stream, Z_SYNC_FLUSH);
+    output.resize(pos + avail - inf_stream->avail_out);
     
-    inf_stream->avail_in = len;
-    inf_stream->next_in = in_buffer;
-
-    // run inflate() on input until output buffer not full
-    string tmp;
-    do {
-      inf_stream->avail_out = CHUNK;
-      inf_stream->next_out = out_buffer;
-      
-      ret = inflate(inf_stream, flush);
-      
-      if (ret < 0 && ret != Z_BUF_ERROR) {
-	cerr << "error: ret\n" << endl; // (before: avail_in = %d, avail_out = %d, after: avail_in = %d, avail_out = %d)\n", ret, len, CHUNK, inf_stream.avail_in, inf_stream.avail_out);
-	return "";
-      }
-      
-      unsigned int have = CHUNK - inf_stream->avail_out;
-      tmp.append((char*)out_buffer, have);
-    } while (inf_stream->avail_out == 0); // && ret != Z_STREAM_END);
-
-    assert(output_pos < data_offset + data_length);
-    if (output_pos + tmp.size() > data_offset) {
+    if (ret == Z_BUF_ERROR && !inf_stream->avail_in && in_pos >= input_size) {
+      break; // end of a flushed but unfinished stream
+    } else if (ret < 0 && ret != Z_BUF_ERROR) {
+      cerr << "inflate error " << ret << endl;
+      return false;
+    } else if (inf_stream->avail_out && !inf_stream->avail_in && in_pos >= input_size) {
+      break;
+    }
+  }
+  return true;
+}
 
-      unsigned int o1 = data_offset > output_pos ? data_offset - output_pos : 0;
-      unsigned int o2 = tmp.size() - (output_pos + tmp.size() > data_offset + data_length ? output_pos + tmp.size() - data_offset - data_length : 0);
+string
+Inflate::decompressString(unsigned int data_offset, unsigned int data_length) {
+  scratch.clear();
+  if (!run(scratch, size_t(data_offset) + data_length) || scratch.size() <= data_offset) {
+    return "";
+  }
+  return scratch.substr(data_offset, data_length);
+}
 
-      // cerr << "tmp = " << tmp << ", o1 = " << o1 << ", o2 = " << o2 << ", output_pos = " << output_pos << ", tmp_size = " << tmp.size() << ", data_offset = " << data_offset << ", data_length = " << data_length << endl;
+// decompresses the whole input buffer
+bool
+Inflate::decompress(std::string & output) {
+  return run(output, string::npos);
+}
 
-      assert(o1 <= tmp.size());
-      assert(o2 >= o1);
-      assert(o2 - o1 <= tmp.size());
-      output_string += tmp.substr(o1, o2 - o1);				  
+// inflates the input up to the end of the last range
+bool
+Inflate::decompressRanges(const std::pair<unsigned int, unsigned int> * ranges, size_t n, std::vector<std::string> & output) {
+  size_t end = 0;
+  for (size_t i = 0; i < n; i++) {
+    end = max(end, size_t(ranges[i].first) + ranges[i].second);
+  }
+  scratch.clear();
+  bool r = run(scratch, end);
+  output.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    if (ranges[i].first < scratch.size()) {
+      output[i].assign(scratch, ranges[i].first, ranges[i].second);
+    } else {
+      output[i].clear();
     }
-    output_pos += tmp.size();
-        
-    // done when inflate() says it's done
-  } while (ret != Z_STREAM_END && output_pos < data_offset + data_length);
-
-  delete[] in_buffer;
-  delete[] out_buffer;
-
-  return output_string;
+  }
+  return r;
 }
 
 #if 0
@@ -16,7 +16,7 @@ Louvain::Louvain(Graph * _g, int _max_num_passes, double _min_modularity)
   auto end = g->end_visible_nodes();
   for (auto it = g->begin_visible_nodes(); it != end; ++it) {
     // if (getNodeCommunity(*it) == -1) {
-    if (getGraph().getNodeTertiaryData(*it).parent_node == -1) {
+    if (getGraph().getParentNode(*it) == -1) {
       current_nodes.push_back(*it);
     }
   }
@@ -25,9 +25,9 @@ Louvain::Louvain(Graph * _g, int _max_num_passes, double _min_modularity)
 int
 Louvain::getNodeCommunity(int node) const {
   while ( 1 ) {
-    auto & td = getGraph().getNodeTertiaryData(node);
-    if (td.parent_node == -1) break;
-    node = td.parent_node;
+    int parent = getGraph().getParentNode(node);
+    if (parent == -1) break;
+    node = parent;
   }
   return node;
 }
@@ -64,7 +64,7 @@ Louvain::oneLevel() {
     g->convertParentToEdge(n);
 #endif
     int community_id = g->getNodeArray().createCommunity(n);
-    assert(getGraph().getNodeTertiaryData(community_id).parent_node == -1);
+    assert(getGraph().getParentNode(community_id) == -1);
     // g->getNodeArray().setPosition(community_id, g->getNodePosition(n));
     g->addChild(community_id, n, 0);
     g->getNodeArray().setPosition2(n, glm::vec3());
@@ -32,23 +32,23 @@ LouvainSimplifier::apply(Graph & target_graph, time_t start_time, time_t end_tim
 
       if (is_improved) {
 	for (auto cluster_id : c.getNodeIds()) {
-	  auto & td = target_graph.getNodeTertiaryData(cluster_id);
+	  auto & td = target_graph.getNodeHierarchyData(cluster_id);
 	  assert(td.parent_node == -1);
 	  float best_d = 0;
 	  int best_node = -1;
 	  for (int n = td.first_child; n != -1; ) {
 	    auto & pd = target_graph.getNodeArray().getNodeData(n);
-	    auto & ctd = target_graph.getNodeTertiaryData(n);
+	    auto & ctd = target_graph.getNodeHierarchyData(n);
 	    if (1) { // pd.type != NODE_ATTRIBUTE) {
 	      if (ctd.group_leader != -1) {
-		auto & ctd2 = target_graph.getNodeTertiaryData(ctd.group_leader);
+		auto & ctd2 = target_graph.getNodeDegreeData(ctd.group_leader);
 		if (best_node == -1 || ctd2.weighted_indegree > best_d) {
 		  best_node = ctd.group_leader;
 		  best_d = ctd2.weighted_indegree;
 		}
-	      } else if (best_node == -1 || ctd.weighted_indegree > best_d) {
+	      } else if (best_node == -1 || target_graph.getNodeDegreeData(n).weighted_indegree > best_d) {
 		best_node = n;
-		best_d = ctd.weighted_indegree;
+		best_d = target_graph.getNodeDegreeData(n).weighted_indegree;
 	      }
 	    }
 	    n = ctd.next_child;
@@ -1,10 +1,10 @@
 #include "NodeArray.h"
+#include "Parallel.h"
 
 #include <glm/gtc/packing.hpp>
 
 #include <algorithm>
 #include <cassert>
-#include <sstream>
 
 using namespace std;
 
@@ -26,24 +26,17 @@ NodeArray::getNodeLabel(int node_id) const {
   else if (type == NODE_LANG_ATTRIBUTE) return "(language)";
   else if (type == NODE_ATTRIBUTE) return "(attr)";
 
+  auto & table = getTable();
   if (label_method.getValue() == LabelMethod::AUTOMATIC_LABEL) {
-    for (auto & cd : getTable().getColumns()) {
-      auto & n = cd.first;
-      if (strcasecmp(n.c_str(), "label") == 0) {
-	label = cd.second->getText(node_id);
-      } else if (strcasecmp(n.c_str(), "uname") == 0) {
-	uname = cd.second->getText(node_id);
-      } else if (strcasecmp(n.c_str(), "name") == 0) {
-	name = cd.second->getText(node_id);
-      } else if (strcasecmp(n.c_str(), "id") == 0) {
-	id = cd.second->getInt64(node_id);
-      }
-    }
+    label = label_column.get(table).getText(node_id);
+    uname = uname_column.get(table).getText(node_id);
+    name = name_column.get(table).getText(node_id);
+    id = id_column.get(table).getInt64(node_id);
   }
   if (label_method.getValue() == LabelMethod::LABEL_FROM_COLUMN) {
-    label = getTable()[label_method.getColumn()].getText(node_id);
+    label = label_method_column.get(table).getText(node_id);
   } else if (label_method.getValue() == LabelMethod::AUTOMATIC_LABEL && label.empty()) {
-    int source_id = getTable()["source"].getInt(node_id);
+    int source_id = source_column.get(table).getInt(node_id);
     bool is_vimeo = source_id == 13 || source_id == 18 || source_id == 69;
     if (!uname.empty() && type != NODE_URL && type != NODE_IMAGE && !is_vimeo) {
       label = uname;
@@ -58,6 +51,60 @@ NodeArray::getNodeLabel(int node_id) const {
   return label;
 }
 
+template<class K>
+static void
+remapValues(std::unordered_map<K, int> & m, const std::vector<int> & remap) {
+  for (auto it = m.begin(); it != m.end(); ) {
+    int id = it->second >= 0 && it->second < int(remap.size()) ? remap[it->second] : -1;
+    if (id == -1) {
+      it = m.erase(it);
+    } else {
+      it->second = id;
+      it++;
+    }
+  }
+}
+
+skey
+NodeArray::getNodeKey(int node_id) const {
+  short source_id = source_column.get(nodes).getInt(node_id);
+  return skey(source_id, source_id ? key_column.get(nodes).getInt64(node_id) : node_id);
+}
+
+void
+NodeArray::remove(int node_id) {
+  if (node_id < 0 || node_id >= size() || isRemoved(node_id)) return;
+  nodes.markRemoved(node_id);
+  // the cache entry of the node is found through its source and id
+  auto source_column = nodes.getColumnSafe("source");
+  auto id_column = nodes.getColumnSafe("id");
+  if (source_column && id_column) {
+    auto it = node_cache.find(skey(short(source_column->getInt(node_id)), id_column->getInt64(node_id)));
+    if (it != node_cache.end() && it->second == node_id) node_cache.erase(it);
+  }
+  version++;
+}
+
+std::vector<int>
+NodeArray::compact() {
+  auto remap = nodes.compact();
+  size_t n = 0;
+  for (size_t i = 0; i < remap.size() && i < node_geometry.size(); i++) {
+    if (remap[i] != -1) node_geometry[n++] = node_geometry[i];
+  }
+  node_geometry.resize(n);
+
+  remapValues(node_cache, remap);
+  remapValues(node_position_cache, remap);
+  remapValues(communities, remap);
+  remapValues(languages, remap);
+  remapValues(applications, remap);
+  if (male_node_id != -1) male_node_id = remap[male_node_id];
+  if (female_node_id != -1) female_node_id = remap[female_node_id];
+  version++;
+  return remap;
+}
+
 #if 0
 static table::ColumnBase * sort_col = 0;
 
@@ -84,6 +131,39 @@ NodeArray::setInitialPosition(int node_id, bool use_2d) {
   // no need to update version for initial position
 }
 
+// a value in [-128, 128) mixed from x
+static inline float
+hashCoordinate(unsigned long long x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return float((x >> 40) / 16777216.0) * 256.0f - 128.0f;
+}
+
+int
+NodeArray::createNodes(size_t n, NodeType type) {
+  int first_node = (int)node_geometry.size();
+  node_geometry.resize(node_geometry.size() + n, { glm::vec3(), BLANK_NODE, 0, type });
+  if (nodes.size() < node_geometry.size()) nodes.addRows(node_geometry.size() - nodes.size());
+  if (isDynamic()) {
+    parallelFor(first_node, node_geometry.size(), [&](size_t i) {
+	unsigned long long k = (unsigned long long)i * 3;
+	node_geometry[i].position = glm::vec3(hashCoordinate(k), hashCoordinate(k + 1), hashCoordinate(k + 2));
+      }, 65536);
+  }
+  return first_node;
+}
+
+void
+NodeArray::setPositions(int first_node, const std::vector<glm::vec3> & v) {
+  assert(first_node >= 0 && first_node + v.size() <= node_geometry.size());
+  parallelFor(0, v.size(), [&](size_t i) {
+      node_geometry[first_node + i].position = v[i];
+    }, 65536);
+  version++;
+}
+
 void
 NodeArray::randomizeGeometry(bool use_2d) {
   assert(!hasSpatialData());
@@ -95,38 +175,28 @@ NodeArray::randomizeGeometry(bool use_2d) {
 
 int
 NodeArray::createNode2D(double x, double y) {
-  ostringstream key;
-  key << x << "/" << y;
-  auto it = node_position_cache.find(key.str());
-  if (it != node_position_cache.end()) {
-    return it->second;
-  } else {
-    int node_id = node_position_cache[key.str()] = add();
+  auto r = node_position_cache.emplace(vkey(x, y, 0.0, coordinate_tolerance), -1);
+  if (r.second || isRemoved(r.first->second)) {
+    int node_id = r.first->second = add();
     setPosition2(node_id, glm::vec3(x, y, 0.0f));
-    return node_id;  
   }
+  return r.first->second;
 }
 
 int
 NodeArray::createNode3D(double x, double y, double z) {
-  ostringstream key;
-  key << x << "/" << y << "/" << z;
-  auto it = node_position_cache.find(key.str());
-  if (it != node_position_cache.end()) {
-    return it->second;
-  } else {
-    int node_id = node_position_cache[key.str()] = add();
+  auto r = node_position_cache.emplace(vkey(x, y, z, coordinate_tolerance), -1);
+  if (r.second || isRemoved(r.first->second)) {
+    int node_id = r.first->second = add();
     setPosition2(node_id, glm::vec3(x, y, z));
-    return node_id;  
   }
+  return r.first->second;
 }
 
 bool
 NodeArray::hasNode(double x, double y, int * r) const {
-  ostringstream key;
-  key << x << "/" << y;
-  auto it = node_position_cache.find(key.str());
-  if (it != node_position_cache.end()) {
+  auto it = node_position_cache.find(vkey(x, y, 0.0, coordinate_tolerance));
+  if (it != node_position_cache.end() && !isRemoved(it->second)) {
     if (r) *r = it->second;
     return true;
   } else {
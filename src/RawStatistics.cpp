@@ -14,126 +14,126 @@
 
 using namespace std;
 
-static bool compareQuantityA1(const pair<string, int> & a, const pair<string, int> & b) {
+static bool compareQuantityB2(const pair<FilterType, int> & a, const pair<FilterType, int> & b) {
   return a.second > b.second;
 }
 
-static bool compareQuantityA2(const pair<skey, int> & a, const pair<skey, int> & b) {
+static bool compareQuantityB3(const pair<short, int> & a, const pair<short, int> & b) {
   return a.second > b.second;
 }
 
-static bool compareQuantityB1(const statistics_row_s & a, const statistics_row_s & b) {
-  return a.value > b.value;
+static bool compareQuantityB4(const pair<PoliticalParty, int> & a, const pair<PoliticalParty, int> & b) {
+  return a.second > b.second;
 }
 
-static bool compareQuantityB2(const pair<FilterType, int> & a, const pair<FilterType, int> & b) {
-  return a.second > b.second;
+void
+FoldedCounter::add(const std::string & text, int text_count, int weight) {
+  string lc = StringUtils::toLower(text);
+  counts.add(lc, weight);
+  auto & s = spellings[lc];
+  if (s.first.empty() || s.first == text || text_count > s.second) {
+    s.first = text;
+    s.second = text_count;
+  }
+  if (counts.getCapacity() && spellings.size() > 2 * counts.getCapacity() + 16) {
+    prune();
+  }
 }
 
-static bool compareQuantityB3(const pair<short, int> & a, const pair<short, int> & b) {
-  return a.second > b.second;
+void
+FoldedCounter::prune() {
+  if (!counts.getCapacity()) return;
+  for (auto it = spellings.begin(); it != spellings.end(); ) {
+    if (counts.contains(it->first)) it++;
+    else it = spellings.erase(it);
+  }
 }
 
-static bool compareQuantityB4(const pair<PoliticalParty, int> & a, const pair<PoliticalParty, int> & b) {
-  return a.second > b.second;
+std::vector<std::pair<std::string, int> >
+FoldedCounter::getTop(size_t k) const {
+  auto top = counts.getTop(k);
+  for (auto & p : top) {
+    auto it = spellings.find(p.first);
+    if (it != spellings.end()) p.first = it->second.first;
+  }
+  return top;
 }
 
 void
 RawStatistics::finalize(const Graph & graph, StatisticsData & output) const {
-  if (version == output.getVersion()) return;
+  bool rebuild_all = output.source != this;
+  if (version == output.getVersion() && !rebuild_all) return;
   output.setVersion(version);
-  output.clear();
+  output.source = this;
 
   output.setTimeRange(start_time, end_time);
   output.setSentimentRange(start_sentiment, end_sentiment);
 
-  vector<pair<string, int> > tmp_hashtags, tmp_links;
-  
-  for (auto & p : hashtags) tmp_hashtags.push_back(p);
-  for (auto & p : links) tmp_links.push_back(p);
-  
-  sort(tmp_hashtags.begin(), tmp_hashtags.end(), compareQuantityA1);
-  sort(tmp_links.begin(), tmp_links.end(), compareQuantityA1);
-
-  map<string, pair<string, int> > tmp_hashtags2, tmp_links2;
-  for (auto & p : tmp_hashtags) {
-    string lc = StringUtils::toLower(p.first);
-    auto it = tmp_hashtags2.find(lc);
-    if (it != tmp_hashtags2.end()) {
-      it->second.second += p.second;
-    } else {
-      tmp_hashtags2[lc] = p;
-    }
-  }
-  for (auto & p : tmp_links) {
-    string lc = StringUtils::toLower(p.first);
-    auto it = tmp_links2.find(lc);
-    if (it != tmp_links2.end()) {
-      it->second.second += p.second;
-    } else {
-      tmp_links2[lc] = p;
-    }
+  // the folded counts and their top are kept up to date while adding
+  if (rebuild_all || output.tag_version != tag_version) {
+    output.tag_version = tag_version;
+    output.sorted_hashtags.clear();
+    output.sorted_links.clear();
+    for (auto & p : folded_hashtags.getTop(STATISTICS_TOP_TAGS)) output.sorted_hashtags.push_back( { 0, p.first, p.second } );
+    for (auto & p : folded_links.getTop(STATISTICS_TOP_TAGS)) output.sorted_links.push_back( { 0, p.first, p.second } );
   }
 
-  for (auto & p : tmp_hashtags2) output.sorted_hashtags.push_back( { 0, p.second.first, p.second.second } );
-  for (auto & p : tmp_links2) output.sorted_links.push_back( { 0, p.second.first, p.second.second } );
+  if (rebuild_all || output.user_version != user_version) {
+    output.user_version = user_version;
+    output.most_active_users.clear();
+    output.most_popular_users.clear();
 
-  sort(output.sorted_hashtags.begin(), output.sorted_hashtags.end(), compareQuantityB1);
-  sort(output.sorted_links.begin(), output.sorted_links.end(), compareQuantityB1);
- 
-  while (output.sorted_hashtags.size() > 100) output.sorted_hashtags.pop_back();  
-  while (output.sorted_links.size() > 100) output.sorted_links.pop_back();
+    auto most_active_users0 = user_activity.getTop(STATISTICS_TOP_USERS);
 
-  vector<pair<skey, int> > most_active_users0;
-  for (auto & ua : user_activity) {
-    most_active_users0.push_back(pair<skey, int>(ua.first, ua.second));
-  }
-  sort(most_active_users0.begin(), most_active_users0.end(), compareQuantityA2);
-  while (most_active_users0.size() > 25) most_active_users0.pop_back();
-
-  if (!most_active_users0.empty()) {
-    auto & username = graph.getNodeArray().getTable()["uname"];
-    for (auto & ud : most_active_users0) {
-      int i = graph.getNodeArray().getNodeId(ud.first.source_id, ud.first.source_object_id);
-      string uname;
-      if (i == -1) {
-	uname = "(not available)";
-      } else {
-	uname = "@" + username.getText(i);
+    if (!most_active_users0.empty()) {
+      auto & username = graph.getNodeArray().getTable()["uname"];
+      for (auto & ud : most_active_users0) {
+	int i = graph.getNodeArray().getNodeId(ud.first.source_id, ud.first.source_object_id);
+	string uname;
+	if (i == -1) {
+	  uname = "(not available)";
+	} else {
+	  uname = "@" + username.getText(i);
+	}
+	output.most_active_users.push_back({ ud.first.source_id, uname, ud.second });
       }
-      output.most_active_users.push_back({ ud.first.source_id, uname, ud.second });
     }
-  }
 
-  vector<pair<skey, int> > most_popular_users0;
-  for (auto & ua : user_popularity) {
-    most_popular_users0.push_back(pair<skey, int>(ua.first, ua.second));
-  }
-  sort(most_popular_users0.begin(), most_popular_users0.end(), compareQuantityA2);
-  while (most_popular_users0.size() > 25) most_popular_users0.pop_back();
+    auto most_popular_users0 = user_popularity.getTop(STATISTICS_TOP_USERS);
   
-  if (!most_popular_users0.empty()) {
-    auto & name_column = graph.getNodeArray().getTable()["name"];
-    auto & username_column = graph.getNodeArray().getTable()["uname"];
-    for (auto & ud : most_popular_users0) {
-      int i = graph.getNodeArray().getNodeId(ud.first.source_id, ud.first.source_object_id);
-      string title;
-      if (i == -1) {
-	title = "(not available)";
-      } else {
-	string name, uname;
-	name = name_column.getText(i);
-	uname = username_column.getText(i);
-	if (!uname.empty()) {
-	  title = "@" + uname;
+    if (!most_popular_users0.empty()) {
+      auto & name_column = graph.getNodeArray().getTable()["name"];
+      auto & username_column = graph.getNodeArray().getTable()["uname"];
+      for (auto & ud : most_popular_users0) {
+	int i = graph.getNodeArray().getNodeId(ud.first.source_id, ud.first.source_object_id);
+	string title;
+	if (i == -1) {
+	  title = "(not available)";
 	} else {
-	  title = name;
+	  string name, uname;
+	  name = name_column.getText(i);
+	  uname = username_column.getText(i);
+	  if (!uname.empty()) {
+	    title = "@" + uname;
+	  } else {
+	    title = name;
+	  }
 	}
+	output.most_popular_users.push_back({ ud.first.source_id, title, ud.second });
       }
-      output.most_popular_users.push_back({ ud.first.source_id, title, ud.second });
     }
   }
 
+  if (rebuild_all || output.app_version != app_version) {
+    finalizeApplications(output, rebuild_all || output.app_version < app_clear_version);
+    output.app_version = app_version;
+  }
+
+  // the remaining sections are small and rebuilt every time
+  output.top_filters.clear();
+  output.top_languages.clear();
+  output.top_political_parties.clear();
+
   for (auto & p : filter_usage) {
     output.top_filters.push_back(p);
   }
@@ -150,102 +150,192 @@ RawStatistics::finalize(const Graph & graph, StatisticsData & output) const {
   sort(output.top_languages.begin(), output.top_languages.end(), compareQuantityB3);
   sort(output.top_political_parties.begin(), output.top_political_parties.end(), compareQuantityB4);
 
-  std::map<skey, std::map<AppPlatform, int> > user_platforms;
-  std::map<skey, std::map<AppInfo::Device, int> > user_devices;
+  output.hours = hours;
+  output.weekdays = weekdays;
+  output.user_types = user_types;
+  output.political_parties = political_parties;
+}
+
+void
+RawStatistics::finalizeApplications(StatisticsData & output, bool rebuild_all) const {
+  // the users changed since the output was built, or everyone
+  vector<const skey *> changed;
+  if (rebuild_all) {
+    output.device_users.clear();
+    output.platform_users.clear();
+    output.user_apps.clear();
+    for (auto & ua : user_apps) changed.push_back(&(ua.first));
+  } else {
+    for (auto it = app_changes.rbegin(); it != app_changes.rend() && it->first > output.app_version; it++) {
+      auto & ua = user_apps.find(it->second)->second;
+      if (ua.version == it->first) changed.push_back(&(it->second));
+    }
+  }
   
-  for (auto & ud : application_usage) {
-    auto & key = ud.first;
-    for (auto & ad : ud.second) {
-      if (ad.first != -1) {
-	auto app = AppRegistry::getInstance().getApp(ad.first);
+  for (auto key : changed) {
+    std::map<AppPlatform, int> platforms;
+    std::map<AppInfo::Device, int> devices;
+    for (auto & a : user_apps.find(*key)->second.apps) {
+      // each app is looked up from the registry only once
+      auto it = output.apps.find(a.first);
+      if (it == output.apps.end()) {
+	auto p = make_pair(AppInfo::UNKNOWN_DEVICE, UNKNOWN_PLATFORM);
+	auto app = AppRegistry::getInstance().getApp(a.first);
 	if (app.getId()) {
-	  user_devices[key][app.getDevice()] += ad.second;
-	  user_platforms[key][app.getPlatform()] += ad.second;
+	  p = make_pair(app.getDevice(), app.getPlatform());
 	} else {
-	  cerr << "app " << ad.first << " not found\n";
-	  user_devices[key][AppInfo::UNKNOWN_DEVICE] += ad.second;
-	  user_platforms[key][UNKNOWN_PLATFORM] += ad.second;
+	  cerr << "app " << a.first << " not found\n";
 	}
-      } else {
-	user_devices[key][AppInfo::UNKNOWN_DEVICE] += ad.second;
-	user_platforms[key][UNKNOWN_PLATFORM] += ad.second;
+	it = output.apps.insert(make_pair(a.first, p)).first;
       }
+      devices[it->second.first] += a.second;
+      platforms[it->second.second] += a.second;
     }
-  }
-  
-  for (auto & ud : user_devices) {
+
     AppInfo::Device best_dev = AppInfo::UNKNOWN_DEVICE;
     int best_count = 0;
-    for (auto & p : ud.second) {
+    for (auto & p : devices) {
       if (p.first != AppInfo::UNKNOWN_DEVICE && p.second > best_count) {
 	best_dev = p.first;
 	best_count = p.second;
       }
     }
-    output.device_users[best_dev]++;
-  }
-
-  for (auto & ud : user_platforms) {
     AppPlatform best_plat = UNKNOWN_PLATFORM;
-    int best_count = 0;
-    for (auto & p : ud.second) {
+    best_count = 0;
+    for (auto & p : platforms) {
       if (p.second > best_count) {
 	best_plat = p.first;
 	best_count = p.second;
       }
     }
-    if (best_count > 0) {
-      output.platform_users[best_plat]++;
+
+    // the user is moved from the device and platform it was counted under
+    auto it = output.user_apps.find(*key);
+    if (it != output.user_apps.end()) {
+      if (--output.device_users[it->second.first] == 0) output.device_users.erase(it->second.first);
+      if (--output.platform_users[it->second.second] == 0) output.platform_users.erase(it->second.second);
+      it->second = make_pair(best_dev, best_plat);
+    } else {
+      output.user_apps[*key] = make_pair(best_dev, best_plat);
     }
+    output.device_users[best_dev]++;
+    output.platform_users[best_plat]++;
   }
+}
 
-  output.hours = hours;
-  output.weekdays = weekdays;
-  output.user_types = user_types;
-  output.political_parties = political_parties;
+void
+RawStatistics::addApplicationUsage(const skey & user, long long app_id, int count) {
+  app_version++;
+  auto & ua = user_apps[user];
+  bool found = false;
+  for (auto & a : ua.apps) {
+    if (a.first == app_id) {
+      a.second += count;
+      found = true;
+      break;
+    }
+  }
+  if (!found) ua.apps.push_back(make_pair(app_id, count));
+  ua.version = app_version;
+  app_changes.push_back(make_pair(app_version, user));
+
+  if (app_changes.size() > 2 * user_apps.size() + 16) {
+    size_t n = 0;
+    for (auto & c : app_changes) {
+      if (user_apps[c.second].version == c.first) app_changes[n++] = c;
+    }
+    app_changes.resize(n);
+  }
 }
 
 void
 RawStatistics::addLink(const std::string & title, const std::string & url) {
-  links[url]++;
+  int count = links.add(url);
+  folded_links.add(url, count);
+  tag_version++;
   version++;
 }
 
 void
 RawStatistics::addHashtag(const std::string & h) {
-  hashtags[h]++;
+  int count = hashtags.add(h);
+  folded_hashtags.add(h, count);
+  tag_version++;
   version++;
 }
 
 void
 RawStatistics::addReceivedActivity(time_t t, short source_id, long long source_object_id, long long app_id, long long filter_id) {
   skey key(source_id, source_object_id);
-  user_popularity[key]++;
+  user_popularity.add(key);
+  user_version++;
   version++;
 }
 
 void
 RawStatistics::addActivity(time_t t, short source_id, long long source_object_id, short lang, long long app_id, long long filter_id, PoliticalParty party) { 
-  DateTime dt(t);
-  assert(dt.getHour() >= 0 && dt.getHour() < 24);
-  hours[dt.getHour()]++;
-  assert(dt.getDayOfWeek() >= 1 && dt.getDayOfWeek() <= 7);
-  weekdays[dt.getDayOfWeek() - 1]++;
+  // time zone offsets are multiples of 15 minutes, so the local hour and
+  // weekday are the same within such a block and the conversion is reused
+  time_t block = t >= 0 ? t / 900 : (t - 899) / 900;
+  if (block != cached_time_block) {
+    DateTime dt(t);
+    assert(dt.getHour() >= 0 && dt.getHour() < 24);
+    assert(dt.getDayOfWeek() >= 1 && dt.getDayOfWeek() <= 7);
+    cached_time_block = block;
+    cached_hour = dt.getHour();
+    cached_weekday = dt.getDayOfWeek() - 1;
+  }
+  hours[cached_hour]++;
+  weekdays[cached_weekday]++;
 
   skey key(source_id, source_object_id);
 
-  user_activity[key]++;
+  user_activity.add(key);
 
   if (lang) {
     language_usage[lang]++;
   }
   if (app_id != -1) {
-    application_usage[key][app_id]++;
+    addApplicationUsage(key, app_id, 1);
   }
   if (filter_id) {
     filter_usage[FilterType(filter_id)]++;
   }
   political_parties[party]++;
 
+  user_version++;
+  version++;
+}
+
+void
+RawStatistics::merge(const RawStatistics & other) {
+  // the folded counters are fed with the merged count of each spelling
+  for (auto & e : other.links.getEntries()) {
+    folded_links.add(e.key, links.add(e.key, e.count, e.error), e.count);
+  }
+  for (auto & e : other.hashtags.getEntries()) {
+    folded_hashtags.add(e.key, hashtags.add(e.key, e.count, e.error), e.count);
+  }
+  for (auto & p : other.headlines) headlines[p.first] += p.second;
+  for (auto & p : other.user_types) user_types[p.first] += p.second;
+  for (auto & p : other.political_parties) political_parties[p.first] += p.second;
+  for (unsigned int i = 0; i < hours.size() && i < other.hours.size(); i++) hours[i] += other.hours[i];
+  for (unsigned int i = 0; i < weekdays.size() && i < other.weekdays.size(); i++) weekdays[i] += other.weekdays[i];
+  for (auto & ua : other.user_apps) {
+    for (auto & a : ua.second.apps) addApplicationUsage(ua.first, a.first, a.second);
+  }
+  user_activity.merge(other.user_activity);
+  user_popularity.merge(other.user_popularity);
+  for (auto & p : other.filter_usage) filter_usage[p.first] += p.second;
+  for (auto & p : other.language_usage) language_usage[p.first] += p.second;
+
+  if (other.start_time && (!start_time || other.start_time < start_time)) start_time = other.start_time;
+  if (other.end_time > end_time) end_time = other.end_time;
+  num_raw_nodes = max(num_raw_nodes, other.num_raw_nodes);
+  num_raw_edges = max(num_raw_edges, other.num_raw_edges);
+  num_posts = max(num_posts, other.num_posts);
+  num_active_users = max(num_active_users, other.num_active_users);
+  tag_version++;
+  user_version++;
   version++;
 }
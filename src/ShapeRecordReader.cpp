@@ -0,0 +1,247 @@
+#include "ShapeRecordReader.h"
+
+#include <Parallel.h>
+
+#include <shapefil.h>
+#include <cstring>
+#include <cctype>
+#include <iostream>
+
+#define MAX_QUEUED_BATCHES	2
+
+using namespace std;
+
+static inline unsigned int
+readBigEndian32(const unsigned char * p) {
+  return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+static inline int
+readLittleEndian32(const unsigned char * p) {
+  return (int)((unsigned int)p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24));
+}
+
+static inline double
+readLittleEndianDouble(const unsigned char * p) {
+  unsigned long long v = 0;
+  for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+  double d;
+  memcpy(&d, &v, sizeof(d));
+  return d;
+}
+
+// opens basename + extension, or the same with an upper case extension
+static FILE *
+openWithExtension(const string & basename, const string & extension) {
+  FILE * f = fopen((basename + extension).c_str(), "rb");
+  if (!f) {
+    string upper = extension;
+    for (auto & c : upper) c = toupper(c);
+    f = fopen((basename + upper).c_str(), "rb");
+  }
+  return f;
+}
+
+ShapeRecordReader::~ShapeRecordReader() {
+  close();
+}
+
+bool
+ShapeRecordReader::open(const std::string & filename) {
+  close();
+
+  // like SHPOpen, accept the name with or without the .shp extension
+  string basename = filename;
+  if (basename.size() >= 4) {
+    string ext = basename.substr(basename.size() - 4);
+    if (ext == ".shp" || ext == ".SHP") basename.erase(basename.size() - 4);
+  }
+  FILE * shx = openWithExtension(basename, ".shx");
+  if (!shx) {
+    cerr << "failed to open shape index " << basename << ".shx" << endl;
+    return false;
+  }
+  unsigned char header[100];
+  if (fread(header, 1, 100, shx) != 100 || readBigEndian32(header) != 9994) {
+    cerr << "invalid shape index\n";
+    fclose(shx);
+    return false;
+  }
+  shape_type = readLittleEndian32(header + 32);
+  unsigned long long file_length = (unsigned long long)readBigEndian32(header + 24) * 2;
+  size_t record_count = file_length > 100 ? (file_length - 100) / 8 : 0;
+  vector<unsigned char> data(record_count * 8);
+  size_t n = fread(data.data(), 1, data.size(), shx);
+  fclose(shx);
+  record_count = n / 8;
+  index.reserve(record_count);
+  for (size_t i = 0; i < record_count; i++) {
+    const unsigned char * p = data.data() + i * 8;
+    index.push_back(make_pair((unsigned long long)readBigEndian32(p) * 2, readBigEndian32(p + 4) * 2));
+  }
+
+  shp = openWithExtension(basename, ".shp");
+  if (!shp) {
+    cerr << "failed to open shapefile " << basename << ".shp" << endl;
+    index.clear();
+    return false;
+  }
+
+  stop = false;
+  batches_read = batches_returned = 0;
+  num_batches = (index.size() + batch_size - 1) / batch_size;
+  reader = std::thread(&ShapeRecordReader::readerLoop, this);
+  return true;
+}
+
+void
+ShapeRecordReader::close() {
+  if (reader.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stop = true;
+    }
+    cond.notify_all();
+    reader.join();
+  }
+  queue.clear();
+  index.clear();
+  if (shp) {
+    fclose(shp);
+    shp = 0;
+  }
+}
+
+void
+ShapeRecordReader::readerLoop() {
+  for (size_t b = 0; b < num_batches; b++) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [&]() { return stop || queue.size() < MAX_QUEUED_BATCHES; });
+      if (stop) return;
+    }
+
+    raw_batch_s batch;
+    batch.first_record = b * batch_size;
+    batch.num_records = min(batch_size, index.size() - batch.first_record);
+    batch.ok = true;
+
+    // records are normally stored in order, so a batch is one read
+    unsigned long long start = index[batch.first_record].first, end = start;
+    for (size_t i = 0; i < batch.num_records; i++) {
+      auto & r = index[batch.first_record + i];
+      start = min(start, r.first);
+      end = max(end, r.first + 8 + r.second);
+    }
+    batch.base_offset = start;
+    batch.data.resize(end - start);
+    if (fseeko(shp, (off_t)start, SEEK_SET) != 0 ||
+	fread(batch.data.data(), 1, batch.data.size(), shp) != batch.data.size()) {
+      cerr << "failed to read shape records\n";
+      batch.ok = false;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queue.push_back(std::move(batch));
+      batches_read++;
+    }
+    cond.notify_all();
+  }
+}
+
+bool
+ShapeRecordReader::readBatch(std::vector<shape_record_s> & records) {
+  records.clear();
+  if (batches_returned >= num_batches) return false;
+
+  raw_batch_s batch;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&]() { return !queue.empty(); });
+    batch = std::move(queue.front());
+    queue.pop_front();
+  }
+  cond.notify_all();
+  batches_returned++;
+
+  records.resize(batch.num_records);
+  if (!batch.ok) return true;
+
+  parallelFor(0, batch.num_records, [&](size_t i) {
+      auto & r = index[batch.first_record + i];
+      size_t pos = r.first - batch.base_offset + 8;
+      decodeRecord(batch.data.data() + pos, r.second, records[i]);
+    }, 64);
+
+  return true;
+}
+
+void
+ShapeRecordReader::decodeRecord(const unsigned char * p, size_t len, shape_record_s & r) {
+  if (len < 4) return;
+  r.type = readLittleEndian32(p);
+  switch (r.type) {
+  case SHPT_NULL:
+    r.valid = true;
+    break;
+  case SHPT_POINT:
+  case SHPT_POINTZ:
+  case SHPT_POINTM:
+    if (len >= 20) {
+      r.points.push_back(glm::dvec2(readLittleEndianDouble(p + 4), readLittleEndianDouble(p + 12)));
+      r.valid = true;
+    }
+    break;
+  case SHPT_MULTIPOINT:
+  case SHPT_MULTIPOINTZ:
+  case SHPT_MULTIPOINTM:
+    if (len >= 40) {
+      int num_points = readLittleEndian32(p + 36);
+      if (num_points < 0 || 40 + (size_t)num_points * 16 > len) break;
+      const unsigned char * q = p + 40;
+      r.points.reserve(num_points);
+      for (int i = 0; i < num_points; i++, q += 16) {
+	r.points.push_back(glm::dvec2(readLittleEndianDouble(q), readLittleEndianDouble(q + 8)));
+      }
+      r.valid = true;
+    }
+    break;
+  case SHPT_ARC:
+  case SHPT_ARCZ:
+  case SHPT_ARCM:
+  case SHPT_POLYGON:
+  case SHPT_POLYGONZ:
+  case SHPT_POLYGONM:
+    if (len >= 44) {
+      int num_parts = readLittleEndian32(p + 36), num_points = readLittleEndian32(p + 40);
+      if (num_parts < 0 || num_points < 0 || 44 + (size_t)num_parts * 4 + (size_t)num_points * 16 > len) break;
+      const unsigned char * q = p + 44;
+      r.part_starts.reserve(num_parts);
+      for (int i = 0; i < num_parts; i++, q += 4) {
+	int start = readLittleEndian32(q);
+	if (start < 0 || start > num_points) start = num_points;
+	r.part_starts.push_back(start);
+      }
+      r.points.reserve(num_points);
+      for (int i = 0; i < num_points; i++, q += 16) {
+	r.points.push_back(glm::dvec2(readLittleEndianDouble(q), readLittleEndianDouble(q + 8)));
+      }
+      if (r.type == SHPT_ARC || r.type == SHPT_ARCZ || r.type == SHPT_ARCM) {
+	r.arcs.resize(num_parts);
+	for (int j = 0; j < num_parts; j++) {
+	  int start = num_parts > 1 ? r.part_starts[j] : 0;
+	  int end = j + 1 < num_parts ? r.part_starts[j + 1] : num_points;
+	  if (end > start) r.arcs[j].data.assign(r.points.begin() + start, r.points.begin() + end);
+	}
+	r.points.clear();
+	r.part_starts.clear();
+      }
+      r.valid = true;
+    }
+    break;
+  default:
+    r.valid = true; // no geometry, the caller reports the type
+    break;
+  }
+}
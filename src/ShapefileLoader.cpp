@@ -5,46 +5,162 @@
 
 #include <Table.h>
 #include <DBase3File.h>
+#include <Parallel.h>
+#include <ShapeRecordReader.h>
 
 #include <cassert>
 #include <shapefil.h>
 #include <iostream>
 #include <cmath>
-#include <sstream>
-#include <deque>
+#include <algorithm>
+#include <unordered_map>
+
+#define POLYGON_BATCH_SIZE	4096
 
 using namespace std;
 
+struct polygon_ring_s {
+  unsigned int first_vertex, num_vertices;
+};
+
+struct polygon_shape_s {
+  unsigned int first_ring, num_rings;
+};
+
+// arcs of a single polygon, split at junction nodes
+struct polygon_arcs_s {
+  glm::dvec2 centroid;
+  vector<ArcData2D> arcs;
+  vector<int> face_nodes; // per ring: arc count + 1 nodes, first and last are the same
+  vector<unsigned long long> arc_keys; // second and second to last vertex of each arc
+  vector<int> ring_arcs; // number of arcs per ring, 0 for islands and degenerate rings
+};
+
+// an arc is identified by its second and second to last vertex, and its
+// reverse has the same vertices swapped
+static inline unsigned long long makeArcKey(int second_vertex, int penultimate_vertex) {
+  return ((unsigned long long)(unsigned int)second_vertex << 32) | (unsigned int)penultimate_vertex;
+}
+
+static inline unsigned long long reverseArcKey(unsigned long long key) {
+  return (key << 32) | (key >> 32);
+}
+
+static void splitPolygon(const polygon_shape_s & shape, const vector<polygon_ring_s> & rings, const vector<int> & ring_vertices, const vector<glm::dvec2> & vertex_coords, const vector<int> & vertex_nodes, polygon_arcs_s & output) {
+  double area = 0, centroid_x = 0, centroid_y = 0;
+  for (unsigned int j = 0; j < shape.num_rings; j++) {
+    auto & ring = rings[shape.first_ring + j];
+    const int * v = ring_vertices.data() + ring.first_vertex;
+    unsigned int n = ring.num_vertices;
+    for (unsigned int k = 0; k < n; k++) {
+      auto & v1 = vertex_coords[v[k]], & v2 = vertex_coords[v[(k + 1) % n]];
+      double a = v1.x * v2.y - v1.y * v2.x;
+      area -= a;
+      centroid_x -= (v1.x + v2.x) * a;
+      centroid_y -= (v1.y + v2.y) * a;
+    }
+
+    int start = -1;
+    if (n >= 3) {
+      for (unsigned int k = 0; k < n; k++) {
+	if (vertex_nodes[v[k]] != -1) {
+	  start = k;
+	  break;
+	}
+      }
+    }
+    if (start == -1) { // island or degenerate
+      output.ring_arcs.push_back(0);
+      continue;
+    }
+
+    unsigned int num_arcs = 0, arc_start = 0;
+    for (unsigned int k = 0; k <= n; k++) {
+      int vertex = v[(start + k) % n];
+      auto & c = vertex_coords[vertex];
+      int node = vertex_nodes[vertex];
+      if (node != -1) {
+	if (k) {
+	  output.arcs.back().data.push_back(c);
+	  output.arc_keys.push_back(makeArcKey(v[(start + arc_start + 1) % n], v[(start + k - 1) % n]));
+	}
+	output.face_nodes.push_back(node);
+	if (k == n) break;
+	output.arcs.push_back(ArcData2D());
+	arc_start = k;
+	num_arcs++;
+      }
+      output.arcs.back().data.push_back(c);
+    }
+    output.ring_arcs.push_back(num_arcs);
+  }
+  area *= 0.5;
+  output.centroid = glm::dvec2(centroid_x / (6.0 * area), centroid_y / (6.0 * area));
+}
+
 ShapefileLoader::ShapefileLoader() : FileTypeHandler("ESRI Shapefile", false) {
   addExtension("shp");
 }
 
 std::shared_ptr<Graph>
 ShapefileLoader::openGraph(const char * filename, const std::shared_ptr<NodeArray> & initial_nodes) {
-  SHPHandle shp = SHPOpen(filename, "rb");
-  if (!shp) {
+  ShapeRecordReader reader;
+  if (!reader.open(filename)) {
     cerr << "failed to open shapefile\n";
     return 0;
   }
 
-  double minb[4], maxb[4];
-  int shape_count, global_shape_type;
-  SHPGetInfo(shp, &shape_count, &global_shape_type, minb, maxb);
+  int shape_count = (int)reader.getRecordCount();
   
   std::shared_ptr<Graph> graph;
 
-  map<string, pair<glm::dvec2, set<string> > > node_edges;
-  map<string, int> waiting_faces;
+  // polygon vertices are interned once and rings are stored as vertex ids
+  unordered_map<vkey, int> vertex_index;
+  vector<glm::dvec2> vertex_coords;
+  vector<int> ring_vertices;
+  vector<polygon_ring_s> rings;
+  vector<polygon_shape_s> polygons;
+  vector<unsigned long long> segments;
 
   cerr << "loading shapefile (" << shape_count << ")\n";
 
   bool has_polygons = false;
+  int file_type = reader.getShapeType();
+  bool is_polygon_file = file_type == SHPT_POLYGON || file_type == SHPT_POLYGONZ || file_type == SHPT_POLYGONM;
+
+  // every record gets a face, so that face ids match the rows of the DBF.
+  // Empty faces of records before the graph is created are added with it.
+  int pending_faces = 0;
+  auto addPendingFaces = [&]() {
+    for (; pending_faces > 0; pending_faces--) graph->addFace();
+  };
 
+  // shapes are decoded in parallel batches and merged in file order
+  vector<shape_record_s> records;
+  size_t record_pos = 0;
   for (int i = 0; i < shape_count; i++) {
-    SHPObject * o = SHPReadObject(shp, i);
-    assert(o);
-    
-    switch (o->nSHPType) {
+    if (record_pos == records.size()) {
+      if (!reader.readBatch(records)) {
+	cerr << "failed to read shape records after " << i << " of " << shape_count << endl;
+	break;
+      }
+      record_pos = 0;
+    }
+    auto & o = records[record_pos++];
+    if (!o.valid || o.type == SHPT_NULL) {
+      if (!o.valid) {
+	cerr << "invalid shape record " << i << endl;
+      }
+      if (is_polygon_file || has_polygons) {
+	polygons.push_back({ (unsigned int)rings.size(), 0 });
+      } else if (graph.get()) {
+	graph->addFace();
+      } else {
+	pending_faces++;
+      }
+      continue;
+    }
+    switch (o.type) {
     case SHPT_POINT:
     case SHPT_POINTZ:
     case SHPT_POINTM:
@@ -56,10 +172,11 @@ ShapefileLoader::openGraph(const char * filename, const std::shared_ptr<NodeArra
 	graph->setEdgeVisibility(false);
 	graph->setFaceVisibility(false);
       }
-      assert(o->nVertices == 1);
+      addPendingFaces();
+      assert(o.points.size() == 1);
       {
 	int face_id = graph->addFace();
-	double x = o->padfX[0], y = o->padfY[0], z = o->padfZ[0];
+	double x = o.points[0].x, y = o.points[0].y;
 	int node_id = graph->getNodeArray().createNode2D(x, y);
 	graph->addEdge(node_id, node_id, face_id, 0.0f);
 	auto & fd = graph->getFaceAttributes(face_id);
@@ -76,8 +193,8 @@ ShapefileLoader::openGraph(const char * filename, const std::shared_ptr<NodeArra
 	graph->setNodeArray(initial_nodes);
 	graph->getNodeArray().setHasSpatialData(true);
       }
-      for (int j = 0; j < o->nVertices; j++) {
-	double x = o->padfX[j], y = o->padfY[j], z = o->padfZ[j];
+      for (auto & p : o.points) {
+	double x = p.x, y = p.y;
 	int node_id = graph->getNodeArray().createNode2D(x, y);
 	graph->addEdge(node_id, node_id, -1, 0.0f);
       }
@@ -95,23 +212,16 @@ ShapefileLoader::openGraph(const char * filename, const std::shared_ptr<NodeArra
 	graph->setEdgeVisibility(true);
 	graph->setFaceVisibility(false);
       }
+      addPendingFaces();
       {
 	int hyperedge_id = graph->addFace();
-	for (int j = 0; j < o->nParts; j++) {
-	  int start = o->nParts > 1 ? o->panPartStart[j] : 0;
-	  int end = o->nParts > 1 && j + 1 < o->nParts ? o->panPartStart[j + 1] : o->nVertices;
-	  ArcData2D arc;
-	  for (int k0 = start; k0 < end; k0++) {
-	    double x = o->padfX[k0], y = o->padfY[k0], z = o->padfZ[k0];
-	    arc.data.push_back(glm::dvec2(x, y));
-	  }
-
-	  int arc_id = graph->getNodeArray().addArcGeometry(arc);
+	for (auto & arc : o.arcs) {
 	  pair<int, int> n = graph->getNodeArray().createNodesForArc(arc);
+	  int arc_id = graph->getNodeArray().addArcGeometry(std::move(arc));
 	  assert(arc_id);
 	  assert(arc_id >= 1 && arc_id <= graph->getNodeArray().getArcGeometry().size());
 	  int edge_id = graph->addEdge(n.first, n.second, hyperedge_id, 1.0f, arc_id);
-	  assert(graph->getEdgeAttributes(edge_id).arc == arc_id);
+	  assert(graph->getEdgeSecondaryAttributes(edge_id).arc == arc_id);
 	}
       }
       break;
@@ -129,23 +239,41 @@ ShapefileLoader::openGraph(const char * filename, const std::shared_ptr<NodeArra
 	graph->setFaceVisibility(true);
       }
       has_polygons = true;
-      for (int j = 0; j < o->nParts; j++) {
-	int start = o->nParts > 1 ? o->panPartStart[j] : 0;
-	int end = o->nParts > 1 && j + 1 < o->nParts ? o->panPartStart[j + 1] : o->nVertices;
-	int n = end - start;
-	for (int k0 = 0; k0 + 1 < n; k0++) {
-	  int k1 = start + (k0 % n), k2 = start + ((k0 + 1) % n);
-	  glm::dvec2 v1(o->padfX[k1], o->padfY[k1]); //, o->padfZ[k]);
-	  glm::dvec2 v2(o->padfX[k2], o->padfY[k2]); // o->padfZ[k + 1]);
-	  ostringstream key1, key2;
-	  key1 << v1.x << "/" << v1.y;
-	  key2 << v2.x << "/" << v2.y;
-	  pair<glm::dvec2, set<string> > & ne1 = node_edges[key1.str()];
-	  pair<glm::dvec2, set<string> > & ne2 = node_edges[key2.str()];
-	  ne1.first = v1;
-	  ne2.first = v2;
-	  ne1.second.insert(key2.str());
-	  ne2.second.insert(key1.str());
+      for (; pending_faces > 0; pending_faces--) {
+	polygons.push_back({ (unsigned int)rings.size(), 0 });
+      }
+      {
+	double tolerance = graph->getNodeArray().getCoordinateTolerance();
+	polygons.push_back({ (unsigned int)rings.size(), 0 });
+	int num_parts = (int)o.part_starts.size(), num_points = (int)o.points.size();
+	for (int j = 0; j < num_parts; j++) {
+	  int start = o.part_starts[j];
+	  if (j == 0 && start > 0) {
+	    cerr << "invalid start " << start << endl;
+	    start = 0;
+	  }
+	  int end = j + 1 < num_parts ? o.part_starts[j + 1] : num_points;
+	  polygon_ring_s ring = { (unsigned int)ring_vertices.size(), 0 };
+	  int prev = -1;
+	  for (int k = start; k < end; k++) {
+	    auto & p = o.points[k];
+	    auto r = vertex_index.emplace(vkey(p.x, p.y, 0.0, tolerance), int(vertex_coords.size()));
+	    if (r.second) vertex_coords.push_back(p);
+	    int vertex = r.first->second;
+	    if (vertex == prev) continue;
+	    if (prev != -1) {
+	      segments.push_back(prev < vertex ? ((unsigned long long)prev << 32) | (unsigned int)vertex : ((unsigned long long)vertex << 32) | (unsigned int)prev);
+	    }
+	    ring_vertices.push_back(vertex);
+	    prev = vertex;
+	  }
+	  ring.num_vertices = (unsigned int)ring_vertices.size() - ring.first_vertex;
+	  if (ring.num_vertices > 1 && ring_vertices.back() == ring_vertices[ring.first_vertex]) {
+	    ring_vertices.pop_back(); // closing vertex
+	    ring.num_vertices--;
+	  }
+	  rings.push_back(ring);
+	  polygons.back().num_rings++;
 	}
       }
       break;
@@ -157,141 +285,120 @@ ShapefileLoader::openGraph(const char * filename, const std::shared_ptr<NodeArra
       cerr << "unhandled type\n";
       assert(0);
     }
-    SHPDestroyObject(o);
   }
 
   if (has_polygons) {
-    unsigned int connected_face_arcs = 0;
-    cerr << "creating nodes (" << node_edges.size() << ")\n";
-    for (map<string, pair<glm::dvec2, set<string> > >::iterator it = node_edges.begin(); it != node_edges.end(); it++) {
-      if (it->second.second.size() >= 3) {
-	graph->getNodeArray().createNode2D(it->second.first.x, it->second.first.y);
+    vertex_index.clear();
+    
+    // junctions are vertices with at least three distinct neighbours
+    sort(segments.begin(), segments.end());
+    segments.erase(unique(segments.begin(), segments.end()), segments.end());
+    vector<unsigned int> degrees(vertex_coords.size(), 0);
+    for (auto seg : segments) {
+      degrees[seg >> 32]++;
+      degrees[seg & 0xffffffff]++;
+    }
+    segments.clear();
+    segments.shrink_to_fit();
+    
+    cerr << "creating nodes (" << vertex_coords.size() << " vertices)\n";
+    auto & nodes = graph->getNodeArray();
+    vector<int> vertex_nodes(vertex_coords.size(), -1);
+    for (unsigned int v = 0; v < vertex_coords.size(); v++) {
+      auto & c = vertex_coords[v];
+      if (degrees[v] >= 3) {
+	vertex_nodes[v] = nodes.createNode2D(c.x, c.y);
+      } else {
+	nodes.hasNode(c.x, c.y, &vertex_nodes[v]); // node might exist already
       }
     }
-    cerr << "creating faces\n";    
-    for (int i = 0; i < shape_count; i++) {
-      SHPObject * o = SHPReadObject(shp, i);
-      assert(o);
-      assert(o->nSHPType == SHPT_POLYGON || o->nSHPType == SHPT_POLYGONZ || o->nSHPType == SHPT_POLYGONM);
-      // int region_id = graph->addRegion();
-      int face_id = graph->addFace();
-      double area = 0, centroid_x = 0, centroid_y = 0;	
-      assert(o->nParts >= 1); // could be zero to
-      for (int j = 0; j < o->nParts; j++) {
-	// int face_id = graph->addFace(region_id);
-	// cerr << "handling polygon " << i << ", part " << j << endl;
-	int start = o->panPartStart[j];
-	if (j == 0 && start > 0) {
-	  cerr << "invalid start " << start << endl;
-	  start = 0;
-	}
-	int end = j + 1 < o->nParts ? o->panPartStart[j + 1] : o->nVertices;
-	deque<glm::dvec2> input;
-	for (int k = start; k < end; k++) {
-	  double x = o->padfX[k], y = o->padfY[k], z = o->padfZ[k];
-	  input.push_back(glm::dvec2(x, y));
-	  if (k + 1 < end) {
-	    double a = o->padfX[k] * o->padfY[k + 1] - o->padfY[k] * o->padfX[k + 1];
-	    area -= a;
-	    centroid_x -= (o->padfX[k] + o->padfX[k + 1]) * a;
-	    centroid_y -= (o->padfY[k] + o->padfY[k + 1]) * a;
-	  }
-	}	
-	if (input.size() > 1 &&
-	    input.front().x == input.back().x &&
-	    input.front().y == input.back().y) {
-	  input.pop_back();
-	}
-	// cerr << "rolling vertices (" << input.size() << ")\n";
-	bool node_found = false;
-	for (int step = 0; step < input.size(); step++) {
-	  if (graph->getNodeArray().hasNode(input.front().x, input.front().y)) {
-	    node_found = true;
-	    break;
-	  } else {
-	    input.push_back(input.front());
-	    input.pop_front();
-	  }
-	}
-	input.push_back(input.front());
-	assert(input.size() >= 4);
-	if (!node_found) { // island
-	  graph->getNodeArray().createNode2D(input.front().x, input.front().y);
-	}
-	// ArcData2D arc;
-	// for (list<glm::dvec3>::iterator it = input.begin(); it != input.end(); it++) {
-	//   arc.data.push_back(*it);
-	// }
-	// pair<int, int> n = graph->getNodeArray().createNodesForArc(arc);
-	// assert(n.first == n.second);
-	// int edge_id = graph->addEdge(n.first, n.second, face_id);
-	// geometries.setArc(edge_id, arc);
-	vector<ArcData2D> arcs;
-	vector<int> face_nodes;
-	for (auto & v : input) {
-	  int n;
-	  if (graph->getNodeArray().hasNode(v.x, v.y, &n)) {
-	    if (!arcs.empty()) {
-	      arcs.back().data.push_back(v);
-	    }
-	    face_nodes.push_back(n);
-	    arcs.push_back(ArcData2D());
-	  }
-	  assert(!arcs.empty());
-	  arcs.back().data.push_back(v);		
-	}
-	assert(face_nodes.front() == face_nodes.back());
-	for (int l = 0; l + 1 < face_nodes.size(); l++) {
-	  int node1 = face_nodes[l], node2 = face_nodes[l + 1];
-	  if (node1 == node2) {
-	    // cerr << "same nodes, size = " << face_nodes.size() << endl;
-	  }
 
-	  int arc_id = 0, pair_edge = -1;
-	  ostringstream key1;
-	  key1 << node2 << "/" << node1;
-	  map<string, int>::iterator it = waiting_faces.find(key1.str());
-	  if (it != waiting_faces.end()) {
-	    pair_edge = it->second;
-	    auto & ed = graph->getEdgeAttributes(pair_edge);
-	    assert(ed.arc >= 1 && ed.arc <= graph->getNodeArray().getArcGeometry().size());
-	    arc_id = -ed.arc;
-	    waiting_faces.erase(it);
-	    connected_face_arcs++;
-	  } else {
-	    arc_id = graph->getNodeArray().addArcGeometry(arcs[l]);
-	    assert(arc_id >= 1 && arc_id <= graph->getNodeArray().getArcGeometry().size());
-	  }
+    cerr << "creating faces\n";
+    unsigned int connected_face_arcs = 0, islands = 0;
+    unordered_map<unsigned long long, int> waiting_faces;
 
-	  assert(arc_id);
-	  
-	  int edge_id = graph->addEdge(node1, node2, face_id, 1.0f, arc_id);
-	  if (pair_edge != -1) {
-	    graph->connectEdgePair(edge_id, pair_edge);
-	  } else {
-	    ostringstream key2;
-	    key2 << node1 << "/" << node2;
-	    waiting_faces[key2.str()] = edge_id;
-	  }
-	  assert(graph->getEdgeAttributes(edge_id).arc == arc_id);
-	}
+    // an arc traversed in the opposite direction by an earlier face shares its geometry
+    auto addFaceArc = [&](int face_id, int node1, int node2, unsigned long long arc_key, ArcData2D & arc) {
+      int arc_id = 0, pair_edge = -1;
+      auto it = waiting_faces.find(reverseArcKey(arc_key));
+      if (it != waiting_faces.end() && graph->getEdgeAttributes(it->second).tail == node2 && graph->getEdgeAttributes(it->second).head == node1) {
+	pair_edge = it->second;
+	auto & sd = graph->getEdgeSecondaryAttributes(pair_edge);
+	assert(sd.arc >= 1 && sd.arc <= nodes.getArcGeometry().size());
+	arc_id = -sd.arc;
+	waiting_faces.erase(it);
+	connected_face_arcs++;
+      } else {
+	arc_id = nodes.addArcGeometry(std::move(arc));
+	assert(arc_id >= 1 && arc_id <= nodes.getArcGeometry().size());
+      }
+
+      int edge_id = graph->addEdge(node1, node2, face_id, 1.0f, arc_id);
+      if (pair_edge != -1) {
+	graph->connectEdgePair(edge_id, pair_edge);
+      } else {
+	waiting_faces[arc_key] = edge_id;
       }
+      assert(graph->getEdgeSecondaryAttributes(edge_id).arc == arc_id);
+    };
+    
+    vector<polygon_arcs_s> batch;
+    for (size_t batch_start = 0; batch_start < polygons.size(); batch_start += POLYGON_BATCH_SIZE) {
+      size_t batch_end = min(polygons.size(), batch_start + POLYGON_BATCH_SIZE);
 
-      area *= 0.5;
-      centroid_x /= (6.0*area);
-      centroid_y /= (6.0*area);
-      graph->getFaceAttributes(face_id).centroid = glm::vec2(centroid_x, centroid_y);
+      // splitting is independent per polygon, graph is only modified below
+      batch.clear();
+      batch.resize(batch_end - batch_start);
+      parallelFor(batch_start, batch_end, [&](size_t i) {
+	  splitPolygon(polygons[i], rings, ring_vertices, vertex_coords, vertex_nodes, batch[i - batch_start]);
+	}, 64);
+
+      for (size_t i = batch_start; i < batch_end; i++) {
+	auto & shape = polygons[i];
+	auto & pa = batch[i - batch_start];
+	int face_id = graph->addFace();
+	graph->getFaceAttributes(face_id).centroid = glm::vec2(pa.centroid.x, pa.centroid.y);
 	
-      SHPDestroyObject(o);
+	unsigned int arc_pos = 0, node_pos = 0;
+	for (unsigned int j = 0; j < shape.num_rings; j++) {
+	  auto & ring = rings[shape.first_ring + j];
+	  int num_arcs = pa.ring_arcs[j];
+	  if (num_arcs) {
+	    for (int l = 0; l < num_arcs; l++) {
+	      addFaceArc(face_id, pa.face_nodes[node_pos + l], pa.face_nodes[node_pos + l + 1], pa.arc_keys[arc_pos + l], pa.arcs[arc_pos + l]);
+	    }
+	    arc_pos += num_arcs;
+	    node_pos += num_arcs + 1;
+	  } else if (ring.num_vertices >= 3) {
+	    // island: it may start from a node created for an identical island
+	    const int * v = ring_vertices.data() + ring.first_vertex;
+	    unsigned int start = 0;
+	    while (start < ring.num_vertices && vertex_nodes[v[start]] == -1) start++;
+	    if (start == ring.num_vertices) {
+	      start = 0;
+	      auto & c = vertex_coords[v[0]];
+	      vertex_nodes[v[0]] = nodes.createNode2D(c.x, c.y);
+	    }
+	    ArcData2D arc;
+	    for (unsigned int k = 0; k <= ring.num_vertices; k++) {
+	      arc.data.push_back(vertex_coords[v[(start + k) % ring.num_vertices]]);
+	    }
+	    int node = vertex_nodes[v[start]];
+	    unsigned int n = ring.num_vertices;
+	    addFaceArc(face_id, node, node, makeArcKey(v[(start + 1) % n], v[(start + n - 1) % n]), arc);
+	    islands++;
+	  }
+	}
+      }
     }
-    cerr << "ARCS: connected face arcs = " << connected_face_arcs << ", unconnected = " << waiting_faces.size() << endl;
+    cerr << "ARCS: connected face arcs = " << connected_face_arcs << ", unconnected = " << waiting_faces.size() << ", islands = " << islands << endl;
   }
 
-  SHPClose(shp);
+  reader.close();
 
   assert(graph.get());
   
-  auto dbf = std::make_shared<table::DBase3File>(filename);
+  auto dbf = std::make_shared<table::DBase3File>(filename, true);
   
   if (dbf->getRecordCount() != shape_count) {
     cerr << "bad number of records\n";
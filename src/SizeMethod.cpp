@@ -5,7 +5,7 @@
 using namespace std;
 
 float
-SizeMethod::calculateSize(const node_tertiary_data_s & data, unsigned int total_indegree, unsigned int total_outdegree, size_t node_count) const {
+SizeMethod::calculateSize(const node_degree_data_s & data, unsigned int child_count, unsigned int total_indegree, unsigned int total_outdegree, size_t node_count, double column_value) const {
   switch (method) {
   case CONSTANT: return constant;    
   case SIZE_FROM_DEGREE:
@@ -19,7 +19,7 @@ SizeMethod::calculateSize(const node_tertiary_data_s & data, unsigned int total_
 	a = 0;
       }
       
-      return 5.0f + 5.0f * (log(1.0 + a) / log(2.0)) + 5.0f * sqrtf(25 * data.child_count);
+      return 5.0f + 5.0f * (log(1.0 + a) / log(2.0)) + 5.0f * sqrtf(25 * child_count);
     }
   case SIZE_FROM_INDEGREE:
     {
@@ -31,7 +31,18 @@ SizeMethod::calculateSize(const node_tertiary_data_s & data, unsigned int total_
       } else {
 	a = 0;
       }
-      return 4.0f + log(1.0 + a) / log(1.3) + 5.0f * sqrtf(25 * data.child_count);
+      return 4.0f + log(1.0 + a) / log(1.3) + 5.0f * sqrtf(25 * child_count);
+    }
+  case SIZE_FROM_COLUMN:
+    {
+      // node area grows linearly with the value
+      float a = 0;
+      if (column_max > column_min) {
+	a = float((column_value - column_min) / (column_max - column_min));
+	if (a < 0) a = 0;
+	else if (a > 1) a = 1;
+      }
+      return 5.0f + 20.0f * sqrtf(a) + 5.0f * sqrtf(25 * child_count);
     }
   case SIZE_FROM_NODE_COUNT:
     {
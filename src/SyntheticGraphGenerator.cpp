@@ -0,0 +1,469 @@
+#include "SyntheticGraphGenerator.h"
+
+#include <Parallel.h>
+#include <UserType.h>
+
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+
+#define GENERATOR_GRAIN		65536
+#define USER_EDGES_PER_NODE	8
+// jitter of the Delaunay lattice, small enough to keep every cell convex
+#define LATTICE_JITTER		0.2
+
+// separate random streams for each kind of item
+#define STREAM_RMAT	1
+#define STREAM_BA	2
+#define STREAM_POSTS	3
+#define STREAM_USERS	4
+#define STREAM_LATTICE	5
+
+using namespace std;
+
+static inline unsigned long long
+mix(unsigned long long x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// a splitmix64 sequence starting from a hash of the seed, stream and index
+class IndexedRandom {
+public:
+  IndexedRandom(unsigned long long seed, unsigned int stream, unsigned long long index)
+    : state(mix(mix(seed ^ mix(stream)) ^ index)) { }
+
+  unsigned long long next() { return mix(state += 0x9e3779b97f4a7c15ULL); }
+  // uniform in [0, n)
+  size_t below(size_t n) { return n ? size_t(next() % n) : 0; }
+  // uniform in [0, 1)
+  double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+  // in [0, n) with a heavy head, small values are the most popular
+  size_t skewed(size_t n) {
+    double u = uniform();
+    return size_t(n * u * u * u);
+  }
+
+private:
+  unsigned long long state;
+};
+
+struct rmat_thresholds_s {
+  unsigned int a, ab, abc; // out of 65536
+};
+
+static rmat_thresholds_s
+getRMATThresholds(float a, float b, float c) {
+  return { (unsigned int)(a * 65536), (unsigned int)((a + b) * 65536), (unsigned int)((a + b + c) * 65536) };
+}
+
+// an R-MAT edge before scrambling, each level uses 16 random bits
+static inline pair<unsigned long long, unsigned long long>
+getRMATEdge(IndexedRandom & rnd, unsigned int scale, const rmat_thresholds_s & th) {
+  unsigned long long u = 0, v = 0, bits = 0;
+  for (unsigned int l = 0; l < scale; l++) {
+    if (l % 4 == 0) bits = rnd.next();
+    unsigned int r = (unsigned int)(bits & 0xffff);
+    bits >>= 16;
+    u <<= 1;
+    v <<= 1;
+    if (r < th.a) {
+    } else if (r < th.ab) {
+      v |= 1;
+    } else if (r < th.abc) {
+      u |= 1;
+    } else {
+      u |= 1;
+      v |= 1;
+    }
+  }
+  return make_pair(u, v);
+}
+
+// a bijection of [0, 2^scale), multiplying by an odd number and xor-shifting
+// are both invertible modulo 2^scale
+static inline unsigned long long
+scrambleId(unsigned long long x, unsigned int scale, unsigned long long key) {
+  unsigned long long mask = (1ULL << scale) - 1;
+  unsigned int shift = scale / 2 + 1;
+  x = ((x ^ key) * 0x9e3779b97f4a7c15ULL) & mask;
+  x ^= x >> shift;
+  x = (x * 0xbf58476d1ce4e5b9ULL) & mask;
+  x ^= x >> shift;
+  return x;
+}
+
+// The head of edge e of a Barabási–Albert graph with m edges per node.
+// Copying the head of an earlier edge repeats the choice of that edge,
+// which is resolved the same way, so each edge is found from its index
+// alone (Sanders and Schulz, Scalable generation of scale-free graphs).
+static unsigned long long
+getBarabasiAlbertHead(unsigned long long seed, unsigned long long e, unsigned int m) {
+  while ( 1 ) {
+    IndexedRandom rnd(seed, STREAM_BA, e);
+    unsigned long long tail = e / m + 1, num_earlier_edges = (tail - 1) * m;
+    unsigned long long r = rnd.next();
+    if (!num_earlier_edges || (r & 1)) return rnd.below(tail);
+    unsigned long long k = rnd.next() % num_earlier_edges;
+    if (r & 2) return k / m + 1;
+    e = k;
+  }
+}
+
+static unsigned int
+getScale(size_t n) {
+  unsigned int scale = 1;
+  while ((size_t(1) << scale) < n) scale++;
+  return scale;
+}
+
+void
+SyntheticGraphGenerator::generateRMATEdges(unsigned int scale, size_t num_edges, std::vector<int> & tails, std::vector<int> & heads) const {
+  assert(scale >= 1 && scale <= 30);
+  tails.resize(num_edges);
+  heads.resize(num_edges);
+  auto th = getRMATThresholds(rmat_a, rmat_b, rmat_c);
+  unsigned long long key = mix(seed) & ((1ULL << scale) - 1);
+  parallelFor(0, num_edges, [&](size_t e) {
+      IndexedRandom rnd(seed, STREAM_RMAT, e);
+      auto uv = getRMATEdge(rnd, scale, th);
+      tails[e] = int(scrambleId(uv.first, scale, key));
+      heads[e] = int(scrambleId(uv.second, scale, key));
+    }, GENERATOR_GRAIN);
+}
+
+void
+SyntheticGraphGenerator::generateBarabasiAlbertEdges(size_t num_nodes, unsigned int edges_per_node, std::vector<int> & tails, std::vector<int> & heads) const {
+  size_t num_edges = num_nodes > 1 ? (num_nodes - 1) * edges_per_node : 0;
+  tails.resize(num_edges);
+  heads.resize(num_edges);
+  parallelFor(0, num_edges, [&](size_t e) {
+      tails[e] = int(e / edges_per_node + 1);
+      heads[e] = int(getBarabasiAlbertHead(seed, e, edges_per_node));
+    }, GENERATOR_GRAIN);
+}
+
+static void
+offsetNodes(std::vector<int> & v, int offset) {
+  if (offset) {
+    parallelFor(0, v.size(), [&](size_t i) { v[i] += offset; }, GENERATOR_GRAIN);
+  }
+}
+
+std::shared_ptr<Graph>
+SyntheticGraphGenerator::createRMAT(unsigned int scale, size_t num_edges, const std::shared_ptr<NodeArray> & nodes) const {
+  auto graph = std::make_shared<Graph>();
+  graph->setNodeArray(nodes);
+  int first_node = nodes->createNodes(size_t(1) << scale);
+  vector<int> tails, heads;
+  generateRMATEdges(scale, num_edges, tails, heads);
+  offsetNodes(tails, first_node);
+  offsetNodes(heads, first_node);
+  graph->addEdges(tails, heads);
+  return graph;
+}
+
+std::shared_ptr<Graph>
+SyntheticGraphGenerator::createBarabasiAlbert(size_t num_nodes, unsigned int edges_per_node, const std::shared_ptr<NodeArray> & nodes) const {
+  auto graph = std::make_shared<Graph>();
+  graph->setNodeArray(nodes);
+  int first_node = nodes->createNodes(num_nodes);
+  vector<int> tails, heads;
+  generateBarabasiAlbertEdges(num_nodes, edges_per_node, tails, heads);
+  offsetNodes(tails, first_node);
+  offsetNodes(heads, first_node);
+  graph->addEdges(tails, heads);
+  return graph;
+}
+
+struct post_model_s {
+  SyntheticGraphGenerator::Model model;
+  const social_media_params_s * params;
+  unsigned long long seed;
+  unsigned int scale;
+  unsigned long long key;
+  rmat_thresholds_s th;
+  int first_user, first_hashtag, first_link;
+  size_t num_hashtags, num_links;
+};
+
+// Generates post p. Its face attributes are stored in fd if given, and
+// emit(tail, head) is called for each of its edges.
+template<class F>
+static void
+generatePost(const post_model_s & m, size_t p, face_data_s * fd, F emit) {
+  auto & params = *(m.params);
+  IndexedRandom rnd(m.seed, STREAM_POSTS, p);
+
+  // posts are spread evenly in order of time
+  time_t t = params.start_time + time_t((p + rnd.uniform()) * double(params.duration) / double(params.num_posts));
+  float sentiment = float(rnd.uniform() + rnd.uniform() - 1.0);
+  short lang = short(1 + rnd.skewed(20));
+  size_t app = rnd.skewed(16);
+  if (fd) {
+    fd->timestamp = t;
+    fd->sentiment = sentiment;
+    fd->lang = lang;
+    fd->app_id = app ? (long long)app : -1;
+  }
+
+  unsigned long long author, mentioned;
+  size_t num_users = params.num_users;
+  if (m.model == SyntheticGraphGenerator::RMAT) {
+    // ids beyond the users are drawn again
+    do {
+      auto uv = getRMATEdge(rnd, m.scale, m.th);
+      author = scrambleId(uv.first, m.scale, m.key);
+      mentioned = scrambleId(uv.second, m.scale, m.key);
+    } while (author >= num_users || mentioned >= num_users || author == mentioned);
+  } else {
+    unsigned long long num_model_edges = (num_users - 1) * USER_EDGES_PER_NODE;
+    author = getBarabasiAlbertHead(m.seed, rnd.next() % num_model_edges, USER_EDGES_PER_NODE);
+    do {
+      mentioned = getBarabasiAlbertHead(m.seed, rnd.next() % num_model_edges, USER_EDGES_PER_NODE);
+    } while (mentioned == author);
+  }
+
+  bool has_mention = rnd.uniform() < params.mention_probability;
+  unsigned int num_hashtags = params.max_hashtags ? (unsigned int)rnd.below(params.max_hashtags + 1) : 0;
+  bool has_link = rnd.uniform() < params.link_probability;
+  if (!has_mention && !num_hashtags && !has_link) has_mention = true;
+
+  int tail = m.first_user + int(author);
+  if (has_mention) emit(tail, m.first_user + int(mentioned));
+  for (unsigned int i = 0; i < num_hashtags; i++) {
+    emit(tail, m.first_hashtag + int(rnd.skewed(m.num_hashtags)));
+  }
+  if (has_link) emit(tail, m.first_link + int(rnd.skewed(m.num_links)));
+}
+
+std::shared_ptr<Graph>
+SyntheticGraphGenerator::createSocialMedia(Model model, const social_media_params_s & params, const std::shared_ptr<NodeArray> & nodes) const {
+  auto graph = std::make_shared<Graph>();
+  graph->setNodeArray(nodes);
+  if (params.num_users < 2 || params.num_users > (1U << 30)) {
+    cerr << "SyntheticGraphGenerator: invalid number of users " << params.num_users << endl;
+    return graph;
+  }
+  nodes->setPersonality(NodeArray::SOCIAL_MEDIA);
+  nodes->setTemporal(true);
+  nodes->setDynamic(true);
+
+  size_t num_users = params.num_users;
+  size_t num_hashtags = params.num_hashtags ? params.num_hashtags : max(num_users / 20, size_t(1));
+  size_t num_links = params.num_links ? params.num_links : max(num_users / 50, size_t(1));
+  int first_user = nodes->createNodes(num_users, NODE_ANY);
+  int first_hashtag = nodes->createNodes(num_hashtags, NODE_HASHTAG);
+  int first_link = nodes->createNodes(num_links, NODE_URL);
+  int end_node = first_link + int(num_links);
+
+  // existing columns are kept, since the node array may have other nodes
+  auto & table = nodes->getTable();
+  auto & source_column = table.getColumnSafe("source") ? table["source"] : table.addIntColumn("source");
+  auto & id_column = table.getColumnSafe("id") ? table["id"] : table.addBigIntColumn("id");
+  auto & name_column = table.getColumnSafe("name") ? table["name"] : table.addTextColumn("name");
+  auto & uname_column = table.getColumnSafe("uname") ? table["uname"] : table.addTextColumn("uname");
+  auto & type_column = table.getColumnSafe("type") ? table["type"] : table.addIntColumn("type");
+  auto & party_column = table.getColumnSafe("party") ? table["party"] : table.addIntColumn("party");
+
+  // the columns are filled in row order, which appends to them
+  auto & node_cache = nodes->getNodeCache();
+  node_cache.reserve(node_cache.size() + num_users);
+  for (int n = first_user; n < end_node; n++) {
+    if (n < first_hashtag) {
+      size_t i = n - first_user;
+      // ids follow the node ids, so that repeated calls do not collide in the node cache
+      long long id = 1000000000LL + (long long)n;
+      IndexedRandom rnd(seed, STREAM_USERS, i);
+      unsigned long long r = rnd.next() % 10;
+      source_column.setValue(n, params.source_id);
+      id_column.setValue(n, id);
+      name_column.setValue(n, "User " + to_string(i));
+      uname_column.setValue(n, "user" + to_string(i));
+      type_column.setValue(n, int(r < 4 ? MALE : r < 8 ? FEMALE : UNKNOWN_TYPE));
+      node_cache[skey(params.source_id, id)] = n;
+    } else if (n < first_link) {
+      source_column.setValue(n, 0);
+      id_column.setValue(n, 0LL);
+      name_column.setValue(n, "#tag" + to_string(n - first_hashtag));
+      uname_column.setValue(n, "");
+      type_column.setValue(n, int(UNKNOWN_TYPE));
+    } else {
+      source_column.setValue(n, 0);
+      id_column.setValue(n, 0LL);
+      name_column.setValue(n, "Link " + to_string(n - first_link));
+      uname_column.setValue(n, "http://example.com/" + to_string(n - first_link));
+      type_column.setValue(n, int(UNKNOWN_TYPE));
+    }
+    party_column.setValue(n, 0);
+  }
+
+  post_model_s m;
+  m.model = model;
+  m.params = &params;
+  m.seed = seed;
+  m.scale = getScale(num_users);
+  m.key = mix(seed) & ((1ULL << m.scale) - 1);
+  m.th = getRMATThresholds(rmat_a, rmat_b, rmat_c);
+  m.first_user = first_user;
+  m.first_hashtag = first_hashtag;
+  m.first_link = first_link;
+  m.num_hashtags = num_hashtags;
+  m.num_links = num_links;
+
+  // the edges of each chunk of posts are counted first, so that the
+  // second pass can write them in place
+  size_t num_posts = params.num_posts;
+  size_t num_chunks = (num_posts + GENERATOR_GRAIN - 1) / GENERATOR_GRAIN;
+  vector<size_t> offsets(num_chunks + 1, 0);
+  parallelForRanges(0, num_posts, GENERATOR_GRAIN, [&](unsigned int thread_index, size_t b, size_t e) {
+      size_t n = 0;
+      for (size_t p = b; p < e; p++) {
+	generatePost(m, p, 0, [&](int tail, int head) { n++; });
+      }
+      offsets[b / GENERATOR_GRAIN + 1] = n;
+    });
+  for (size_t i = 0; i < num_chunks; i++) offsets[i + 1] += offsets[i];
+
+  int first_face = graph->createFaces(num_posts);
+  vector<int> tails(offsets.back()), heads(offsets.back()), faces(offsets.back());
+  parallelForRanges(0, num_posts, GENERATOR_GRAIN, [&](unsigned int thread_index, size_t b, size_t e) {
+      size_t pos = offsets[b / GENERATOR_GRAIN];
+      for (size_t p = b; p < e; p++) {
+	int face = first_face + int(p);
+	generatePost(m, p, &(graph->getFaceAttributes(face)), [&](int tail, int head) {
+	    tails[pos] = tail;
+	    heads[pos] = head;
+	    faces[pos] = face;
+	    pos++;
+	  });
+      }
+    });
+
+  graph->addEdges(tails, heads, vector<float>(), faces);
+  return graph;
+}
+
+// links the edge pairs of a planar graph. The secondary edge data is
+// allocated first, after which it can be written in parallel.
+template<class F>
+static void
+connectEdgePairs(PlanarGraph & graph, size_t num_cells, F f) {
+  if (!graph.getEdgeCount()) return;
+  graph.getEdgeSecondaryAttributes(int(graph.getEdgeCount()) - 1);
+  parallelFor(0, num_cells, f, GENERATOR_GRAIN);
+}
+
+std::shared_ptr<PlanarGraph>
+SyntheticGraphGenerator::createGrid(size_t rows, size_t cols, const std::shared_ptr<NodeArray> & nodes) const {
+  auto graph = std::make_shared<PlanarGraph>();
+  graph->setNodeArray(nodes);
+  if (rows < 2 || cols < 2) return graph;
+  nodes->setHasSpatialData(true);
+
+  int first_node = nodes->createNodes(rows * cols);
+  vector<glm::vec3> positions(rows * cols);
+  parallelFor(0, positions.size(), [&](size_t i) {
+      positions[i] = glm::vec3(float(i % cols), float(i / cols), 0.0f);
+    }, GENERATOR_GRAIN);
+  nodes->setPositions(first_node, positions);
+
+  // the edges of cell i are 4 * i + k: bottom, right, top and left, counterclockwise
+  size_t cell_cols = cols - 1, num_cells = (rows - 1) * cell_cols;
+  int first_face = graph->createFaces(num_cells);
+  vector<int> tails(4 * num_cells), heads(4 * num_cells), faces(4 * num_cells);
+  parallelFor(0, num_cells, [&](size_t i) {
+      size_t r = i / cell_cols, c = i % cell_cols;
+      int a = first_node + int(r * cols + c), b = a + 1, e = a + int(cols), d = e + 1;
+      int v[] = { a, b, d, e };
+      for (unsigned int k = 0; k < 4; k++) {
+	tails[4 * i + k] = v[k];
+	heads[4 * i + k] = v[(k + 1) % 4];
+	faces[4 * i + k] = first_face + int(i);
+      }
+      graph->getFaceAttributes(first_face + int(i)).centroid = glm::vec2(c + 0.5f, r + 0.5f);
+    }, GENERATOR_GRAIN);
+  int first_edge = graph->addEdges(tails, heads, vector<float>(), faces);
+
+  connectEdgePairs(*graph, num_cells, [&](size_t i) {
+      int e = first_edge + int(4 * i);
+      if (i >= cell_cols) graph->connectEdgePair(e, e - int(4 * cell_cols) + 2);
+      if ((i + 1) % cell_cols) graph->connectEdgePair(e + 1, e + 4 + 3);
+    });
+  return graph;
+}
+
+// true if d is inside the circumcircle of the counterclockwise triangle a, b, c
+static bool
+isInCircle(const glm::vec3 & a, const glm::vec3 & b, const glm::vec3 & c, const glm::vec3 & d) {
+  double adx = a.x - d.x, ady = a.y - d.y;
+  double bdx = b.x - d.x, bdy = b.y - d.y;
+  double cdx = c.x - d.x, cdy = c.y - d.y;
+  double det = (adx * adx + ady * ady) * (bdx * cdy - cdx * bdy)
+    - (bdx * bdx + bdy * bdy) * (adx * cdy - cdx * ady)
+    + (cdx * cdx + cdy * cdy) * (adx * bdy - bdx * ady);
+  return det > 0;
+}
+
+std::shared_ptr<PlanarGraph>
+SyntheticGraphGenerator::createDelaunay(size_t rows, size_t cols, const std::shared_ptr<NodeArray> & nodes) const {
+  auto graph = std::make_shared<PlanarGraph>();
+  graph->setNodeArray(nodes);
+  if (rows < 2 || cols < 2) return graph;
+  nodes->setHasSpatialData(true);
+
+  int first_node = nodes->createNodes(rows * cols);
+  vector<glm::vec3> positions(rows * cols);
+  parallelFor(0, positions.size(), [&](size_t i) {
+      IndexedRandom rnd(seed, STREAM_LATTICE, i);
+      double dx = (rnd.uniform() * 2.0 - 1.0) * LATTICE_JITTER, dy = (rnd.uniform() * 2.0 - 1.0) * LATTICE_JITTER;
+      positions[i] = glm::vec3(float(i % cols + dx), float(i / cols + dy), 0.0f);
+    }, GENERATOR_GRAIN);
+  nodes->setPositions(first_node, positions);
+
+  // Each cell a, b, d, e (counterclockwise from the lower left) has the
+  // triangles a, b, d and a, d, e, or if e is inside the circumcircle of
+  // the first, a, b, e and b, d, e. The edges of cell i are 6 * i + 3 * t + k.
+  size_t cell_cols = cols - 1, num_cells = (rows - 1) * cell_cols;
+  vector<char> flipped(num_cells);
+  int first_face = graph->createFaces(2 * num_cells);
+  vector<int> tails(6 * num_cells), heads(6 * num_cells), faces(6 * num_cells);
+  parallelFor(0, num_cells, [&](size_t i) {
+      size_t r = i / cell_cols, c = i % cell_cols;
+      size_t a = r * cols + c, b = a + 1, e = a + cols, d = e + 1;
+      bool flip = isInCircle(positions[a], positions[b], positions[d], positions[e]);
+      flipped[i] = flip;
+      size_t v[2][3] = { { a, b, d }, { a, d, e } };
+      if (flip) {
+	v[0][2] = e;
+	v[1][0] = b;
+      }
+      for (unsigned int t = 0; t < 2; t++) {
+	int face = first_face + int(2 * i + t);
+	glm::vec3 centroid(0.0f);
+	for (unsigned int k = 0; k < 3; k++) {
+	  size_t j = 6 * i + 3 * t + k;
+	  tails[j] = first_node + int(v[t][k]);
+	  heads[j] = first_node + int(v[t][(k + 1) % 3]);
+	  faces[j] = face;
+	  centroid += positions[v[t][k]];
+	}
+	graph->getFaceAttributes(face).centroid = glm::vec2(centroid.x / 3.0f, centroid.y / 3.0f);
+      }
+    }, GENERATOR_GRAIN);
+  int first_edge = graph->addEdges(tails, heads, vector<float>(), faces);
+
+  // positions of the sides of a cell among its edges
+  auto getRightEdge = [&](size_t i) { return first_edge + int(6 * i) + (flipped[i] ? 3 : 1); };
+  auto getLeftEdge = [&](size_t i) { return first_edge + int(6 * i) + (flipped[i] ? 2 : 5); };
+  connectEdgePairs(*graph, num_cells, [&](size_t i) {
+      int e = first_edge + int(6 * i);
+      if (flipped[i]) graph->connectEdgePair(e + 1, e + 5);
+      else graph->connectEdgePair(e + 2, e + 3);
+      if (i >= cell_cols) graph->connectEdgePair(e, first_edge + int(6 * (i - cell_cols)) + 4);
+      if ((i + 1) % cell_cols) graph->connectEdgePair(getRightEdge(i), getLeftEdge(i + 1));
+    });
+  return graph;
+}
@@ -1,65 +1,464 @@
 #include "Table.h"
 
-#include <StringUtils.h>
-
 #include "TextColumn.h"
 #include "CompressedTextColumn.h"
+#include "DictionaryTextColumn.h"
 #include "TimeSeriesColumn.h"
 
+#include <Parallel.h>
+
 #include <fstream>
+#include <algorithm>
 #include <iostream>
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <strings.h>
 
 using namespace std;
 using namespace table;
 
-void
-Table::loadCSV(const char * filename, char delimiter) {
-  ifstream in;
-  in.open(filename);
-  assert(in);
+struct csv_field_s {
+  const char * ptr;
+  size_t len;
+};
+
+enum CSVValueType {
+  CSV_EMPTY = 0,
+  CSV_INT,
+  CSV_BIGINT,
+  CSV_DOUBLE,
+  CSV_TEXT
+};
+
+static bool readFile(const char * filename, string & data) {
+  ifstream in(filename, ios::in | ios::binary);
+  if (!in) {
+    return false;
+  }
+  in.seekg(0, ios::end);
+  auto len = in.tellg();
+  in.seekg(0, ios::beg);
+  if (len > 0) {
+    data.resize(size_t(len));
+    in.read(&data[0], len);
+    data.resize(size_t(in.gcount()));
+  }
+  return true;
+}
+
+// splits the next line starting at p into fields without copying and returns the start of the following line
+static const char * splitLine(const char * p, const char * end, char delimiter, vector<csv_field_s> & fields) {
+  fields.clear();
+  const char * field_start = p;
+  bool in_quotes = false;
+  for ( ; p < end; p++) {
+    char c = *p;
+    if (c == '"') {
+      in_quotes = !in_quotes;
+    } else if (!in_quotes && (c == delimiter || c == '\n')) {
+      fields.push_back({ field_start, size_t(p - field_start) });
+      if (c == '\n') return p + 1;
+      field_start = p + 1;
+    }
+  }
+  fields.push_back({ field_start, size_t(p - field_start) });
+  return end;
+}
+
+static void trimField(csv_field_s & f) {
+  while (f.len && (f.ptr[0] == ' ' || f.ptr[0] == '\t')) { f.ptr++; f.len--; }
+  while (f.len && (f.ptr[f.len - 1] == '\r' || f.ptr[f.len - 1] == ' ' || f.ptr[f.len - 1] == '\t')) f.len--;
+  if (f.len >= 2 && f.ptr[0] == '"' && f.ptr[f.len - 1] == '"') {
+    f.ptr++;
+    f.len -= 2;
+  }
+}
+
+static bool isBlankLine(const vector<csv_field_s> & fields) {
+  for (auto & f : fields) {
+    if (f.len) return false;
+  }
+  return true;
+}
+
+static bool parseInt64(const csv_field_s & f, long long & r) {
+  if (!f.len) return false;
+  char * endptr = 0;
+  r = strtoll(f.ptr, &endptr, 10);
+  return endptr == f.ptr + f.len;
+}
+
+static bool parseDouble(const csv_field_s & f, double & r) {
+  if (!f.len) return false;
+  char * endptr = 0;
+  r = strtod(f.ptr, &endptr);
+  return endptr == f.ptr + f.len;
+}
+
+static CSVValueType detectType(const vector<csv_field_s> & cells) {
+  CSVValueType type = CSV_EMPTY;
+  for (auto & f : cells) {
+    if (!f.len) continue;
+    long long i;
+    double d;
+    if (parseInt64(f, i)) {
+      CSVValueType t = i >= INT_MIN && i <= INT_MAX ? CSV_INT : CSV_BIGINT;
+      if (t > type) type = t;
+    } else if (parseDouble(f, d)) {
+      type = CSV_DOUBLE;
+    } else {
+      return CSV_TEXT;
+    }
+  }
+  return type;
+}
+
+// returns the text of a field with doubled quotes unescaped
+static string getFieldText(const csv_field_s & f) {
+  string s;
+  s.reserve(f.len);
+  for (size_t i = 0; i < f.len; i++) {
+    s += f.ptr[i];
+    if (f.ptr[i] == '"' && i + 1 < f.len && f.ptr[i + 1] == '"') i++;
+  }
+  return s;
+}
+
+static bool hasQuotes(const csv_field_s & f) {
+  return f.len && memchr(f.ptr, '"', f.len) != 0;
+}
+
+// the type that cells are parsed to for an existing column
+static CSVValueType getColumnType(const ColumnBase & col) {
+  if (getTypedColumn<double>(col) || getTypedColumn<float>(col)) {
+    return CSV_DOUBLE;
+  } else if (getTypedColumn<int>(col) || getTypedColumn<long long>(col) ||
+	     getTypedColumn<short>(col) || getTypedColumn<unsigned short>(col)) {
+    return CSV_BIGINT;
+  } else {
+    return CSV_TEXT;
+  }
+}
+
+// Writes cells to rows. Numeric cells are parsed once into a typed buffer
+// that is written with a single scatter, text cells are copied only when
+// they contain escaped quotes or the column does not store text directly.
+// Returns the number of cells that could not be parsed as type.
+static size_t assignValues(ColumnBase & col, CSVValueType type, const vector<int> & rows, const vector<csv_field_s> & cells) {
+  assert(rows.size() == cells.size());
+  vector<int> value_rows;
+  value_rows.reserve(rows.size());
+  size_t num_invalid = 0;
+  switch (type) {
+  case CSV_INT:
+  case CSV_BIGINT:
+    {
+      vector<long long> values;
+      values.reserve(rows.size());
+      for (size_t i = 0; i < rows.size(); i++) {
+	auto & f = cells[i];
+	if (!f.len) continue;
+	long long v;
+	double d;
+	if (!parseInt64(f, v)) {
+	  if (!parseDouble(f, d)) {
+	    num_invalid++;
+	    continue;
+	  }
+	  v = (long long)d;
+	}
+	value_rows.push_back(rows[i]);
+	values.push_back(v);
+      }
+      col.scatter(value_rows.data(), value_rows.size(), values.data());
+    }
+    break;
+  case CSV_DOUBLE:
+    {
+      vector<double> values;
+      values.reserve(rows.size());
+      for (size_t i = 0; i < rows.size(); i++) {
+	auto & f = cells[i];
+	if (!f.len) continue;
+	double v;
+	if (!parseDouble(f, v)) {
+	  num_invalid++;
+	  continue;
+	}
+	value_rows.push_back(rows[i]);
+	values.push_back(v);
+      }
+      col.scatter(value_rows.data(), value_rows.size(), values.data());
+    }
+    break;
+  default:
+    {
+      auto text_col = dynamic_cast<TextColumn *>(&col);
+      for (size_t i = 0; i < rows.size(); i++) {
+	auto & f = cells[i];
+	if (!f.len) continue;
+	if (text_col && !hasQuotes(f)) {
+	  text_col->setValue(rows[i], f.ptr, f.len);
+	} else {
+	  col.setValue(rows[i], getFieldText(f));
+	}
+      }
+    }
+  }
+  return num_invalid;
+}
+
+size_t
+Table::loadCSV(const char * filename, char delimiter, unsigned int first_column) {
+  string data;
+  if (!readFile(filename, data)) {
+    cerr << "Cannot open " << filename << endl;
+    return 0;
+  }
+
+  vector<int> rows;
+  vector<vector<csv_field_s> > cells;
+  vector<csv_field_s> fields;
   
-  cerr << "reading csv\n";
-
-  unsigned int n = 0;
-  while (!in.eof() && !in.fail()) {
-    string s;
-    getline(in, s);
-    StringUtils::trim(s);
-    if (s.empty()) continue;
-    vector<string> row = StringUtils::split(s, delimiter);
-
-    cerr << "got " << row.size() << " columns\n";
-
-    assert(n < size());
-	     
-    for (unsigned int i = 0; i < row.size(); i++) {
-      assert(i < columns_in_order.size());
-      cerr << "setting value to column " << i << ": " << row[i] << endl;
-      columns_in_order[9 + i]->setValue(n, row[i]);
+  const char * p = data.data(), * end = data.data() + data.size();
+  unsigned int n = 0, skipped_rows = 0;
+  while (p < end) {
+    p = splitLine(p, end, delimiter, fields);
+    for (auto & f : fields) trimField(f);
+    if (isBlankLine(fields)) continue;
+    if (n >= size()) {
+      skipped_rows++;
+      continue;
     }
-    cerr << "done setting values\n";
-    n++;
+    if (cells.size() < fields.size()) cells.resize(fields.size(), vector<csv_field_s>(rows.size(), csv_field_s{ 0, 0 }));
+    for (unsigned int i = 0; i < cells.size(); i++) {
+      cells[i].push_back(i < fields.size() ? fields[i] : csv_field_s{ 0, 0 });
+    }
+    rows.push_back(n++);
+  }
+
+  if (first_column + cells.size() > columns_in_order.size()) {
+    cerr << "Table::loadCSV: " << filename << " has " << cells.size() << " fields, but only " << (columns_in_order.size() - first_column) << " columns are available\n";
+  }
+  size_t num_invalid = 0;
+  for (unsigned int i = 0; i < cells.size() && first_column + i < columns_in_order.size(); i++) {
+    auto & col = *columns_in_order[first_column + i];
+    num_invalid += assignValues(col, getColumnType(col), rows, cells[i]);
+  }
+  if (num_invalid) {
+    cerr << "Table::loadCSV: ignored " << num_invalid << " non-numeric values in numeric columns\n";
+  }
+  if (skipped_rows) {
+    cerr << "Table::loadCSV: skipped " << skipped_rows << " rows beyond table size\n";
+  }
+
+  return rows.size();
+}
+
+size_t
+Table::loadCSV(const char * filename, const char * key_column, char delimiter) {
+  auto it = columns.find(key_column);
+  if (it == columns.end()) {
+    cerr << "Table::loadCSV: no key column " << key_column << endl;
+    return 0;
+  }
+  // Keys are parsed to the type of the column, so numeric keys compare as
+  // numbers. Without an existing index a temporary one is built.
+  auto & col = *(it->second);
+  const ColumnIndex * index = col.getIndex();
+  std::shared_ptr<ColumnIndex> tmp_index;
+  if (!index) {
+    tmp_index = createColumnIndex(col, INDEX_HASH);
+    for (size_t i = 0; i < num_rows && i < col.size(); i++) tmp_index->insert(col, int(i));
+    index = tmp_index.get();
+  }
+  vector<int> rows;
+  string tmp;
+  return joinCSV(filename, key_column, delimiter, [&](const char * key, size_t len) {
+      if (!len) return -1;
+      tmp.assign(key, len);
+      rows.clear();
+      index->findRows(tmp, rows);
+      return rows.empty() ? -1 : *min_element(rows.begin(), rows.end());
+    });
+}
+
+size_t
+Table::loadCSV(const char * filename, const char * key_column, short source_id, const std::unordered_map<skey, int> & key_cache, char delimiter) {
+  return joinCSV(filename, key_column, delimiter, [&](const char * key, size_t len) {
+      long long id;
+      if (!parseInt64({ key, len }, id)) return -1;
+      auto it = key_cache.find(skey(source_id, id));
+      return it != key_cache.end() ? it->second : -1;
+    });
+}
+
+size_t
+Table::joinCSV(const char * filename, const char * key_column, char delimiter, const std::function<int(const char *, size_t)> & lookup_row) {
+  string data;
+  if (!readFile(filename, data)) {
+    cerr << "Cannot open " << filename << endl;
+    return 0;
+  }
+
+  const char * p = data.data(), * end = data.data() + data.size();
+  vector<csv_field_s> fields;
+  vector<string> header;
+
+  while (p < end && header.empty()) {
+    p = splitLine(p, end, delimiter, fields);
+    for (auto & f : fields) trimField(f);
+    if (isBlankLine(fields)) continue;
+    for (auto & f : fields) header.push_back(getFieldText(f));
+  }
+
+  int key_field = -1;
+  for (unsigned int i = 0; i < header.size(); i++) {
+    if (strcasecmp(header[i].c_str(), key_column) == 0) {
+      key_field = int(i);
+      break;
+    }
+  }
+  if (key_field == -1) {
+    cerr << "Table::loadCSV: " << filename << " has no key field " << key_column << endl;
+    return 0;
+  }
+
+  vector<int> rows;
+  vector<vector<csv_field_s> > cells(header.size());
+  unsigned int unmatched_rows = 0;
+  size_t num_invalid = 0;
+  while (p < end) {
+    p = splitLine(p, end, delimiter, fields);
+    for (auto & f : fields) trimField(f);
+    if (isBlankLine(fields)) continue;
+    int row = -1;
+    if (key_field < fields.size()) {
+      auto & f = fields[key_field];
+      if (hasQuotes(f)) {
+	string key = getFieldText(f);
+	row = lookup_row(key.data(), key.size());
+      } else {
+	row = lookup_row(f.ptr, f.len);
+      }
+    }
+    if (row < 0 || row >= int(num_rows)) {
+      unmatched_rows++;
+      continue;
+    }
+    rows.push_back(row);
+    for (unsigned int i = 0; i < header.size(); i++) {
+      cells[i].push_back(i < fields.size() ? fields[i] : csv_field_s{ 0, 0 });
+    }
+  }
+
+  for (unsigned int i = 0; i < header.size(); i++) {
+    if (int(i) == key_field || header[i].empty()) continue;
+    auto it = columns.find(header[i]);
+    if (it != columns.end()) {
+      num_invalid += assignValues(*(it->second), getColumnType(*(it->second)), rows, cells[i]);
+    } else {
+      CSVValueType type = detectType(cells[i]);
+      const char * name = header[i].c_str();
+      switch (type) {
+      case CSV_INT: assignValues(addIntColumn(name), type, rows, cells[i]); break;
+      case CSV_BIGINT: assignValues(addBigIntColumn(name), type, rows, cells[i]); break;
+      case CSV_DOUBLE: assignValues(addDoubleColumn(name), type, rows, cells[i]); break;
+      default: assignValues(addTextColumn(name), CSV_TEXT, rows, cells[i]);
+      }
+    }
+  }
+
+  cerr << "Table::loadCSV: joined " << rows.size() << " rows from " << filename << " (" << unmatched_rows << " unmatched)\n";
+  if (num_invalid) {
+    cerr << "Table::loadCSV: ignored " << num_invalid << " non-numeric values in numeric columns\n";
+  }
+  
+  return rows.size();
+}
+
+std::vector<int>
+Table::compact() {
+  vector<int> remap(num_rows), kept_rows;
+  kept_rows.reserve(num_rows - num_removed_rows);
+  for (size_t i = 0; i < num_rows; i++) {
+    if (isRemoved(int(i))) {
+      remap[i] = -1;
+    } else {
+      remap[i] = int(kept_rows.size());
+      kept_rows.push_back(int(i));
+    }
+  }
+  parallelFor(0, columns_in_order.size(), [&](size_t i) {
+      auto & col = columns_in_order[i];
+      if (num_removed_rows) {
+	col->retainRows(kept_rows);
+      } else if (auto text = dynamic_cast<TextColumn *>(col.get())) {
+	// replaced text is reclaimed here rather than on the write that replaced it
+	if (text->getGarbageSize() > text->getArenaSize() / 2) text->compact();
+      }
+    }, 1);
+  num_rows = kept_rows.size();
+  removed_rows.clear();
+  num_removed_rows = 0;
+  return remap;
+}
+
+const ColumnIndex *
+Table::createIndex(const char * name, IndexType type) {
+  auto it = columns.find(name);
+  if (it == columns.end()) {
+    cerr << "Table::createIndex: no column " << name << endl;
+    return 0;
+  }
+  it->second->setIndex(createColumnIndex(*(it->second), type));
+  return it->second->getIndex();
+}
+
+std::vector<int>
+Table::findRows(const char * name, const std::string & key) const {
+  vector<int> rows;
+  auto col = getColumnSafe(name);
+  if (!col) return rows;
+  if (col->getIndex()) {
+    col->getIndex()->findRows(key, rows);
+  } else {
+    // unindexed columns are scanned, create an index for repeated lookups
+    scanColumn(*col, key, rows);
+  }
+  sort(rows.begin(), rows.end());
+  return rows;
+}
+
+ColumnBase &
+Table::addTextColumn(const char * name, bool intern) {
+  auto it = columns.find(name);
+  if (it != columns.end()) {
+    return *(it->second);
+  } else {
+    return addColumn(name, std::make_shared<TextColumn>(intern));
   }
 }
 
 ColumnBase &
-Table::addTextColumn(const char * name) {
+Table::addCompressedTextColumn(const char * name, TextCodecType codec) {
   auto it = columns.find(name);
   if (it != columns.end()) {
     return *(it->second);
   } else {
-    return addColumn(name, std::make_shared<TextColumn>());
+    return addColumn(name, std::make_shared<CompressedTextColumn>(codec));
   }
 }
 
 ColumnBase &
-Table::addCompressedTextColumn(const char * name) {
+Table::addDictionaryTextColumn(const char * name) {
   auto it = columns.find(name);
   if (it != columns.end()) {
     return *(it->second);
   } else {
-    return addColumn(name, std::make_shared<CompressedTextColumn>());
+    return addColumn(name, std::make_shared<DictionaryTextColumn>());
   }
 }
 
@@ -0,0 +1,69 @@
+#include "TableIndex.h"
+
+#define SCAN_BLOCK_SIZE	256
+
+using namespace std;
+using namespace table;
+
+template<class K>
+static std::shared_ptr<ColumnIndex>
+createIndex(IndexType type) {
+  if (type == INDEX_SORTED) {
+    return std::make_shared<SortedColumnIndex<K> >();
+  } else {
+    return std::make_shared<HashColumnIndex<K> >();
+  }
+}
+
+// numeric columns are read in blocks with one virtual call per block
+template<class K>
+static void
+scanRows(const ColumnBase & col, const std::string & s, std::vector<int> & rows) {
+  K key;
+  if (!ColumnKey<K>::parse(s, key)) return;
+  int block_rows[SCAN_BLOCK_SIZE];
+  K values[SCAN_BLOCK_SIZE];
+  for (size_t b = 0; b < col.size(); b += SCAN_BLOCK_SIZE) {
+    size_t n = min(col.size() - b, size_t(SCAN_BLOCK_SIZE));
+    for (size_t i = 0; i < n; i++) block_rows[i] = int(b + i);
+    col.gather(block_rows, n, values);
+    for (size_t i = 0; i < n; i++) {
+      if (values[i] == key) rows.push_back(block_rows[i]);
+    }
+  }
+}
+
+// text is compared in place where the column allows it
+template<>
+void
+scanRows<std::string>(const ColumnBase & col, const std::string & s, std::vector<int> & rows) {
+  TextView key(s);
+  std::string buffer;
+  for (size_t i = 0; i < col.size(); i++) {
+    if (col.getTextView(int(i), buffer) == key) rows.push_back(int(i));
+  }
+}
+
+std::shared_ptr<ColumnIndex>
+table::createColumnIndex(const ColumnBase & col, IndexType type) {
+  if (getTypedColumn<double>(col) || getTypedColumn<float>(col)) {
+    return createIndex<double>(type);
+  } else if (getTypedColumn<int>(col) || getTypedColumn<long long>(col) ||
+	     getTypedColumn<short>(col) || getTypedColumn<unsigned short>(col)) {
+    return createIndex<long long>(type);
+  } else {
+    return createIndex<std::string>(type);
+  }
+}
+
+void
+table::scanColumn(const ColumnBase & col, const std::string & key, std::vector<int> & rows) {
+  if (getTypedColumn<double>(col) || getTypedColumn<float>(col)) {
+    scanRows<double>(col, key, rows);
+  } else if (getTypedColumn<int>(col) || getTypedColumn<long long>(col) ||
+	     getTypedColumn<short>(col) || getTypedColumn<unsigned short>(col)) {
+    scanRows<long long>(col, key, rows);
+  } else {
+    scanRows<std::string>(col, key, rows);
+  }
+}
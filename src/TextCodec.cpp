@@ -0,0 +1,161 @@
+#include "TextCodec.h"
+
+#include <Inflate.h>
+
+#include <cstring>
+#include <iostream>
+
+#define LZ_HASH_BITS		12
+#define LZ_MIN_MATCH		4
+#define LZ_MAX_OFFSET		65535
+
+using namespace std;
+
+bool
+TextCodec::decompressRanges(const std::basic_string<unsigned char> & input, const std::pair<unsigned int, unsigned int> * ranges, size_t n, std::vector<std::string> & output) {
+  string block;
+  bool r = decompress(input, block);
+  output.resize(n);
+  for (size_t i = 0; i < n; i++) {
+    if (ranges[i].first < block.size()) {
+      output[i].assign(block, ranges[i].first, ranges[i].second);
+    } else {
+      output[i].clear();
+    }
+  }
+  return r;
+}
+
+void
+ZlibCodec::compress(const char * input, size_t input_len, std::basic_string<unsigned char> & output) {
+  deflate.reset();
+  deflate.compress(input, input_len, true);
+  deflate.swapData(output);
+}
+
+bool
+ZlibCodec::decompress(const std::basic_string<unsigned char> & input, std::string & output) {
+  Inflate & inflate = Inflate::getThreadInstance();
+  inflate.setInput(&input);
+  return inflate.decompress(output);
+}
+
+// inflates only up to the last range, with the stream state of the thread
+bool
+ZlibCodec::decompressRanges(const std::basic_string<unsigned char> & input, const std::pair<unsigned int, unsigned int> * ranges, size_t n, std::vector<std::string> & output) {
+  Inflate & inflate = Inflate::getThreadInstance();
+  inflate.setInput(&input);
+  return inflate.decompressRanges(ranges, n, output);
+}
+
+static inline void
+writeLength(std::basic_string<unsigned char> & output, size_t len) {
+  for ( ; len >= 255; len -= 255) output.push_back(255);
+  output.push_back((unsigned char)len);
+}
+
+// a sequence is a token (literal length and match length nibbles), the
+// literals and, unless this is the last sequence, a 16-bit match offset
+static void
+writeSequence(std::basic_string<unsigned char> & output, const unsigned char * literals, size_t literal_len, size_t offset, size_t match_len) {
+  size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+  output.push_back((unsigned char)((min(literal_len, size_t(15)) << 4) | min(ml, size_t(15))));
+  if (literal_len >= 15) writeLength(output, literal_len - 15);
+  output.append(literals, literal_len);
+  if (match_len) {
+    output.push_back((unsigned char)(offset & 0xff));
+    output.push_back((unsigned char)(offset >> 8));
+    if (ml >= 15) writeLength(output, ml - 15);
+  }
+}
+
+void
+LZCodec::compress(const char * input, size_t input_len, std::basic_string<unsigned char> & output) {
+  output.clear();
+  output.reserve(input_len / 2 + 16);
+  hash_table.assign(1 << LZ_HASH_BITS, -1);
+
+  const unsigned char * src = (const unsigned char *)input;
+  size_t pos = 0, anchor = 0;
+  while (pos + LZ_MIN_MATCH <= input_len) {
+    unsigned int seq;
+    memcpy(&seq, src + pos, 4);
+    unsigned int h = (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+    int ref = hash_table[h];
+    hash_table[h] = (int)pos;
+    if (ref >= 0 && pos - ref <= LZ_MAX_OFFSET && memcmp(src + ref, src + pos, LZ_MIN_MATCH) == 0) {
+      size_t match_len = LZ_MIN_MATCH;
+      while (pos + match_len < input_len && src[ref + match_len] == src[pos + match_len]) match_len++;
+      writeSequence(output, src + anchor, pos - anchor, pos - ref, match_len);
+      pos += match_len;
+      anchor = pos;
+    } else {
+      pos++;
+    }
+  }
+  writeSequence(output, src + anchor, input_len - anchor, 0, 0);
+}
+
+bool
+LZCodec::decompress(const std::basic_string<unsigned char> & input, std::string & output) {
+  const unsigned char * ip = input.data(), * end = ip + input.size();
+  size_t base = output.size();
+  
+  while (ip < end) {
+    unsigned int token = *ip++;
+    size_t literal_len = token >> 4;
+    if (literal_len == 15) {
+      unsigned char c;
+      do {
+	if (ip >= end) return false;
+	c = *ip++;
+	literal_len += c;
+      } while (c == 255);
+    }
+    if (literal_len > size_t(end - ip)) {
+      cerr << "corrupt LZ block\n";
+      return false;
+    }
+    output.append((const char *)ip, literal_len);
+    ip += literal_len;
+    if (ip == end) break; // last sequence
+
+    if (end - ip < 2) return false;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    size_t match_len = (token & 15) + LZ_MIN_MATCH;
+    if ((token & 15) == 15) {
+      unsigned char c;
+      do {
+	if (ip >= end) return false;
+	c = *ip++;
+	match_len += c;
+      } while (c == 255);
+    }
+    if (!offset || offset > output.size() - base) {
+      cerr << "corrupt LZ block\n";
+      return false;
+    }
+    // a match may overlap the bytes being written, so it is copied in
+    // growing multiples of the offset
+    size_t pos = output.size();
+    output.resize(pos + match_len);
+    char * dest = &output[0];
+    for (size_t dist = offset; match_len; dist *= 2) {
+      size_t n = min(dist, match_len);
+      memcpy(dest + pos, dest + pos - dist, n);
+      pos += n;
+      match_len -= n;
+    }
+  }
+  return true;
+}
+
+std::unique_ptr<TextCodec>
+createTextCodec(TextCodecType type) {
+  switch (type) {
+  case CODEC_LZ: return std::unique_ptr<TextCodec>(new LZCodec());
+  case CODEC_ZLIB: break;
+  }
+  return std::unique_ptr<TextCodec>(new ZlibCodec());
+}
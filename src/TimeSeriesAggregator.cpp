@@ -0,0 +1,173 @@
+#include "TimeSeriesAggregator.h"
+
+#include <Parallel.h>
+
+#include <algorithm>
+#include <limits>
+
+#define AGGREGATOR_GRAIN	256
+
+using namespace std;
+using namespace table;
+
+void
+TimeSeriesAggregator::build(const TimeSeriesColumn & col) {
+  column = &col;
+  version = col.getVersion();
+  rewrite_version = col.getRewriteVersion();
+  garbage = 0;
+
+  size_t num_rows = col.size(), total = 0;
+  rows.resize(num_rows);
+  for (size_t i = 0; i < num_rows; i++) {
+    size_t n = col.getSampleCount(int(i));
+    rows[i] = { total, n, n };
+    total += n;
+  }
+  times.resize(total);
+  prefix.resize(total);
+
+  parallelFor(0, num_rows, [&](size_t i) {
+      size_t p = rows[i].offset;
+      double sum = 0.0;
+      col.forEach(int(i), [&](time_t time, double value) {
+	  times[p] = time;
+	  sum += value;
+	  prefix[p++] = sum;
+	});
+    }, AGGREGATOR_GRAIN);
+}
+
+void
+TimeSeriesAggregator::update(const TimeSeriesColumn & col) {
+  if (column != &col || rewrite_version != col.getRewriteVersion() || col.size() < rows.size()) {
+    build(col);
+    return;
+  }
+  if (version == col.getVersion()) {
+    return;
+  }
+  version = col.getVersion();
+  while (rows.size() < col.size()) {
+    rows.push_back({ times.size(), 0, 0 });
+  }
+  for (size_t i = 0; i < rows.size(); i++) {
+    size_t n = col.getSampleCount(int(i));
+    if (n != rows[i].count && !append(col, int(i), n)) {
+      build(col);
+      return;
+    }
+  }
+  if (garbage > times.size() / 2) {
+    build(col);
+  }
+}
+
+// adds the samples after the last one of the row, so that it has count samples
+bool
+TimeSeriesAggregator::append(const TimeSeriesColumn & col, int row, size_t count) {
+  auto & r = rows[row];
+  if (count < r.count) {
+    return false;
+  }
+  if (count > r.capacity) {
+    // move the row to the end with room to grow
+    size_t capacity = max(count, 2 * r.capacity);
+    size_t offset = times.size();
+    times.resize(offset + capacity);
+    prefix.resize(offset + capacity);
+    copy(times.begin() + r.offset, times.begin() + r.offset + r.count, times.begin() + offset);
+    copy(prefix.begin() + r.offset, prefix.begin() + r.offset + r.count, prefix.begin() + offset);
+    garbage += r.capacity;
+    r.offset = offset;
+    r.capacity = capacity;
+  }
+  bool has_last = r.count > 0;
+  time_t last = has_last ? times[r.offset + r.count - 1] : numeric_limits<time_t>::min();
+  double sum = getPrefixSum(row, r.count);
+  size_t p = r.offset + r.count, end = r.offset + count;
+  col.forEach(row, last, numeric_limits<time_t>::max(), [&](time_t time, double value) {
+      if ((has_last && time == last) || p == end) return;
+      times[p] = time;
+      sum += value;
+      prefix[p++] = sum;
+    });
+  r.count = p - r.offset;
+  return r.count == count;
+}
+
+std::pair<size_t, size_t>
+TimeSeriesAggregator::getRange(int row, time_t start_time, time_t end_time) const {
+  if (row < 0 || row >= int(size()) || end_time <= start_time) return make_pair(size_t(0), size_t(0));
+  auto begin = times.begin() + rows[row].offset, end = begin + rows[row].count;
+  size_t a = lower_bound(begin, end, start_time) - begin;
+  size_t b = lower_bound(begin + a, end, end_time) - begin;
+  return make_pair(a, b);
+}
+
+std::vector<double>
+TimeSeriesAggregator::getHistogram(int row, time_t start_time, time_t end_time, time_t bucket_width) const {
+  vector<double> r;
+  if (bucket_width <= 0 || end_time <= start_time || row < 0 || row >= int(size())) return r;
+  size_t num_buckets = (end_time - start_time + bucket_width - 1) / bucket_width;
+  r.resize(num_buckets);
+  auto begin = times.begin() + rows[row].offset, end = begin + rows[row].count;
+  size_t a = lower_bound(begin, end, start_time) - begin;
+  for (size_t i = 0; i < num_buckets; i++) {
+    time_t bucket_end = min(end_time, time_t(start_time + (i + 1) * bucket_width));
+    size_t b = lower_bound(begin + a, end, bucket_end) - begin;
+    r[i] = getPrefixSum(row, b) - getPrefixSum(row, a);
+    a = b;
+  }
+  return r;
+}
+
+std::vector<double>
+TimeSeriesAggregator::getSums(time_t start_time, time_t end_time) const {
+  vector<double> r(size());
+  parallelFor(0, r.size(), [&](size_t i) {
+      r[i] = getSum(int(i), start_time, end_time);
+    }, 4096);
+  return r;
+}
+
+std::vector<std::pair<int, double> >
+TimeSeriesAggregator::getTopK(time_t start_time, time_t end_time, size_t k) const {
+  auto sums = getSums(start_time, end_time);
+  vector<pair<int, double> > r;
+  r.reserve(sums.size());
+  for (size_t i = 0; i < sums.size(); i++) {
+    if (sums[i] != 0.0) r.push_back(make_pair(int(i), sums[i]));
+  }
+  auto cmp = [](const pair<int, double> & a, const pair<int, double> & b) {
+    return a.second > b.second || (a.second == b.second && a.first < b.first);
+  };
+  if (r.size() > k) {
+    partial_sort(r.begin(), r.begin() + k, r.end(), cmp);
+    r.resize(k);
+  } else {
+    sort(r.begin(), r.end(), cmp);
+  }
+  return r;
+}
+
+std::vector<double>
+TimeSeriesAggregator::getTotalHistogram(time_t start_time, time_t end_time, time_t bucket_width) const {
+  vector<double> total;
+  if (bucket_width <= 0 || end_time <= start_time) return total;
+  total.resize((end_time - start_time + bucket_width - 1) / bucket_width);
+  unsigned int num_threads = getThreadCount();
+  vector<vector<double> > partial(num_threads, vector<double>(total.size(), 0.0));
+  parallelForRanges(0, size(), AGGREGATOR_GRAIN, [&](unsigned int thread_index, size_t b, size_t e) {
+      auto & p = partial[thread_index];
+      for (size_t i = b; i < e; i++) {
+	if (!rows[i].count) continue;
+	auto h = getHistogram(int(i), start_time, end_time, bucket_width);
+	for (size_t j = 0; j < h.size(); j++) p[j] += h[j];
+      }
+    }, num_threads);
+  for (auto & p : partial) {
+    for (size_t j = 0; j < total.size(); j++) total[j] += p[j];
+  }
+  return total;
+}
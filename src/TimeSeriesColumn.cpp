@@ -0,0 +1,164 @@
+#include "TimeSeriesColumn.h"
+
+#include <algorithm>
+
+using namespace std;
+using namespace table;
+
+static inline void
+writeSigned(vector<unsigned char> & out, long long v) {
+  uint64_t u = (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+  while (u >= 0x80) {
+    out.push_back((unsigned char)(u | 0x80));
+    u >>= 7;
+  }
+  out.push_back((unsigned char)u);
+}
+
+static void
+encodeSegment(const time_t * times, const double * values, size_t n, vector<unsigned char> & out) {
+  long long prev_time = 0, prev_delta = 0;
+  uint64_t prev_bits = 0;
+  for (size_t i = 0; i < n; i++) {
+    long long t = (long long)times[i];
+    if (i == 0) {
+      writeSigned(out, t);
+    } else {
+      long long delta = t - prev_time;
+      writeSigned(out, delta - prev_delta);
+      prev_delta = delta;
+    }
+    prev_time = t;
+
+    uint64_t bits;
+    memcpy(&bits, &values[i], sizeof(bits));
+    uint64_t x = bits ^ prev_bits;
+    prev_bits = bits;
+    if (!x) {
+      out.push_back(0);
+      continue;
+    }
+    int lead = 0, trail = 0;
+    while (lead < 7 && !(x >> (56 - lead * 8) & 0xff)) lead++;
+    while (trail < 7 && !(x >> (trail * 8) & 0xff)) trail++;
+    out.push_back((unsigned char)(0x80 | (lead << 3) | trail));
+    for (int j = 8 - lead - 1; j >= trail; j--) out.push_back((unsigned char)(x >> (j * 8)));
+  }
+}
+
+void
+TimeSeriesColumn::addValue(int i, time_t t, double val) {
+  assert(i >= 0);
+  while (i >= data.size()) data.push_back(series_s());
+  version++;
+  auto & s = data[i];
+  if ((!s.tail_times.empty() && t <= s.tail_times.back()) || (!s.segments.empty() && t <= s.segments.back().max_time)) {
+    rewrite_version++;
+  }
+  if (!s.segments.empty() && t <= s.segments.back().max_time) {
+    // rare: the sample falls into sealed data
+    unseal(s, t);
+  }
+  auto it = lower_bound(s.tail_times.begin(), s.tail_times.end(), t);
+  size_t pos = it - s.tail_times.begin();
+  if (it != s.tail_times.end() && *it == t) {
+    s.tail_values[pos] = val;
+    return;
+  }
+  s.tail_times.insert(it, t);
+  s.tail_values.insert(s.tail_values.begin() + pos, val);
+  if (s.tail_times.size() >= TIME_SERIES_SEGMENT_SIZE) {
+    seal(s);
+  }
+}
+
+void
+TimeSeriesColumn::setValues(int i, const std::map<time_t, double> & values) {
+  assert(i >= 0);
+  while (i >= data.size()) data.push_back(series_s());
+  version++;
+  rewrite_version++;
+  auto & s = data[i];
+  for (auto & seg : s.segments) garbage_size += seg.size;
+  s.segments.clear();
+  s.tail_times.clear();
+  s.tail_values.clear();
+  for (auto & v : values) {
+    s.tail_times.push_back(v.first);
+    s.tail_values.push_back(v.second);
+    if (s.tail_times.size() >= TIME_SERIES_SEGMENT_SIZE) seal(s);
+  }
+}
+
+void
+TimeSeriesColumn::seal(series_s & s) {
+  if (s.tail_times.empty()) return;
+  segment_s seg;
+  seg.offset = arena.size();
+  seg.count = (unsigned int)s.tail_times.size();
+  seg.min_time = s.tail_times.front();
+  seg.max_time = s.tail_times.back();
+  encodeSegment(s.tail_times.data(), s.tail_values.data(), s.tail_times.size(), arena);
+  seg.size = (unsigned int)(arena.size() - seg.offset);
+  s.segments.push_back(seg);
+  s.tail_times.clear();
+  s.tail_values.clear();
+  // idle series do not keep a full buffer
+  s.tail_times.shrink_to_fit();
+  s.tail_values.shrink_to_fit();
+}
+
+// moves the segments that end at or after t back to the tail
+void
+TimeSeriesColumn::unseal(series_s & s, time_t t) {
+  size_t first = s.segments.size();
+  while (first > 0 && s.segments[first - 1].max_time >= t) first--;
+
+  vector<time_t> times;
+  vector<double> values;
+  for (size_t j = first; j < s.segments.size(); j++) {
+    auto & seg = s.segments[j];
+    TimeSeriesDecoder dec(arena.data() + seg.offset, seg.count);
+    time_t tt;
+    double v;
+    while (dec.next(tt, v)) {
+      times.push_back(tt);
+      values.push_back(v);
+    }
+    garbage_size += seg.size;
+  }
+  times.insert(times.end(), s.tail_times.begin(), s.tail_times.end());
+  values.insert(values.end(), s.tail_values.begin(), s.tail_values.end());
+  s.segments.resize(first);
+  s.tail_times.swap(times);
+  s.tail_values.swap(values);
+
+  if (garbage_size > 65536 && garbage_size > arena.size() / 2) {
+    compact();
+  }
+}
+
+void
+TimeSeriesColumn::compact() {
+  vector<unsigned char> old_arena;
+  old_arena.swap(arena);
+  if (garbage_size < old_arena.size()) arena.reserve(old_arena.size() - garbage_size);
+  for (auto & s : data) {
+    for (auto & seg : s.segments) {
+      size_t offset = arena.size();
+      arena.insert(arena.end(), old_arena.begin() + seg.offset, old_arena.begin() + seg.offset + seg.size);
+      seg.offset = offset;
+    }
+  }
+  garbage_size = 0;
+}
+
+size_t
+TimeSeriesColumn::getMemoryUsage() const {
+  size_t n = arena.capacity() + data.capacity() * sizeof(series_s);
+  for (auto & s : data) {
+    n += s.segments.capacity() * sizeof(segment_s);
+    n += s.tail_times.capacity() * sizeof(time_t) + s.tail_values.capacity() * sizeof(double);
+  }
+  return n;
+}
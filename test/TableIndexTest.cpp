@@ -0,0 +1,107 @@
+#include <Table.h>
+#include <TableIndex.h>
+
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cstdio>
+
+using namespace std;
+using namespace table;
+
+// keys that do not parse completely as numbers must not match numeric columns
+static void
+testNonNumericKeys() {
+  Table t;
+  auto & id = t.addBigIntColumn("id");
+  auto & w = t.addDoubleColumn("w");
+  for (int i = 0; i < 4; i++) {
+    id.pushValue((long long)i);
+    w.pushValue(i * 0.5);
+    t.addRow();
+  }
+
+  // a scan of an unindexed column
+  assert(t.findRow("id", "2") == 2);
+  assert(t.findRows("id", "abc").empty());
+  assert(t.findRows("id", "2abc").empty());
+  assert(t.findRows("id", "").empty());
+  assert(t.findRows("w", "0.5x").empty());
+
+  t.createIndex("id");
+  t.createIndex("w", INDEX_SORTED);
+  assert(t.findRow("id", "2") == 2);
+  assert(t.findRow("w", "0.5") == 1);
+  assert(t.findRows("id", "abc").empty());
+  assert(t.findRows("id", "0x").empty());
+  assert(t.findRows("id", "99999999999999999999").empty());
+  assert(t.findRows("w", "1.0.0").empty());
+
+  // the join skips the rows whose key does not parse
+  const char * filename = "TableIndexTest.csv";
+  {
+    ofstream out(filename);
+    out << "id;extra\n1;one\nabc;zero\n3x;three\n";
+  }
+  size_t n = t.loadCSV(filename, "id");
+  remove(filename);
+  assert(n == 1);
+  assert(t["extra"].getText(1) == "one");
+  assert(t["extra"].getText(0).empty() && t["extra"].getText(3).empty());
+}
+
+// the index follows updates and removals without a copy of the keys
+static void
+testUpdates() {
+  Table t;
+  auto & name = t.addTextColumn("name");
+  for (int i = 0; i < 10; i++) {
+    name.pushValue("n" + to_string(i % 4));
+    t.addRow();
+  }
+  t.createIndex("name");
+  auto rows = t.findRows("name", "n1");
+  assert(rows.size() == 3 && rows[0] == 1 && rows[1] == 5 && rows[2] == 9);
+  name.setValue(5, string("zz"));
+  assert(t.findRows("name", "n1").size() == 2 && t.findRow("name", "zz") == 5);
+  // row 9 moves to 1
+  t.removeRow(1);
+  rows = t.findRows("name", "n1");
+  assert(rows.size() == 1 && rows[0] == 1);
+  name.setValue(20, string("far"));
+  assert(t.findRow("name", "far") == 20);
+}
+
+// unindexed numeric keys are joined by value, and quoted cells are unescaped
+static void
+testJoinByValue() {
+  Table t;
+  auto & id = t.addBigIntColumn("id");
+  auto & n = t.addIntColumn("n");
+  for (int i = 0; i < 4; i++) {
+    id.pushValue((long long)i * 10);
+    n.pushValue(0);
+    t.addRow();
+  }
+
+  const char * filename = "TableIndexTest.csv";
+  {
+    ofstream out(filename);
+    out << "id;n;text\n010;7;\"say \"\"hi\"\"\"\n\"30\";x;plain\n";
+  }
+  size_t r = t.loadCSV(filename, "id");
+  remove(filename);
+  assert(r == 2);
+  assert(n.getInt(1) == 7 && t["text"].getText(1) == "say \"hi\"");
+  // a non-numeric cell leaves the numeric column unchanged
+  assert(n.getInt(3) == 0 && t["text"].getText(3) == "plain");
+}
+
+int
+main() {
+  testNonNumericKeys();
+  testUpdates();
+  testJoinByValue();
+  cout << "TableIndexTest: ok\n";
+  return 0;
+}